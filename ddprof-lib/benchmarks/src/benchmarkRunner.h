@@ -0,0 +1,65 @@
+#pragma once
+
+#include "benchmarkConfig.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Shared state, defined in unwindFailuresBenchmark.cpp
+extern std::vector<BenchmarkResult> results;
+extern BenchmarkConfig config;
+
+// Individual benchmark suites
+void benchmarkUnwindFailures();
+void benchmarkPerfSyscalls();
+void benchmarkTimestamps();
+void benchmarkSymbolCache();
+void benchmarkCounters();
+void benchmarkPprof();
+void benchmarkEventWriter();
+
+// Helper function to run a benchmark with warmup
+template <typename F>
+BenchmarkResult runBenchmark(const std::string &name, F &&func, double rng_overhead = 0.0) {
+    std::cout << "\n--- Benchmark: " << name << " ---" << std::endl;
+
+    // Warmup phase
+    if (config.warmup_iterations > 0) {
+        std::cout << "Warming up with " << config.warmup_iterations << " iterations..."
+                  << std::endl;
+        for (int i = 0; i < config.warmup_iterations; i++) {
+            func(i);
+        }
+    }
+
+    // Measurement phase
+    std::cout << "Running " << config.measurement_iterations << " iterations..." << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (int i = 0; i < config.measurement_iterations; i++) {
+        func(i);
+        if (config.debug && i % 100000 == 0) {
+            std::cout << "Progress: " << (i * 100 / config.measurement_iterations) << "%"
+                      << std::endl;
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+
+    double avg_time = (double)duration.count() / config.measurement_iterations;
+    if (rng_overhead > 0) {
+        avg_time -= rng_overhead;
+    }
+
+    std::cout << "Total time: " << duration.count() << " ns" << std::endl;
+    std::cout << "Average time per operation: " << avg_time << " ns" << std::endl;
+    if (rng_overhead > 0) {
+        std::cout << "  (RNG overhead of " << rng_overhead << " ns has been subtracted)"
+                  << std::endl;
+    }
+
+    return {name, static_cast<long long>(avg_time * config.measurement_iterations),
+            config.measurement_iterations, avg_time};
+}
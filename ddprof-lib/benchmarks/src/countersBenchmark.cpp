@@ -0,0 +1,79 @@
+#include "benchmarkRunner.h"
+#include <atomic>
+#include <thread>
+
+// Measures the cost of a counter increment made by many threads at once, the
+// way the signal handlers of all the sampled threads update the unwinding
+// time and call trace storage counters. A single shared slot, as Counters used
+// to have, is compared with the sharded Counters.
+
+#ifndef COUNTERS
+#define COUNTERS
+#endif
+#include "counters.h"
+
+alignas(128) static volatile long long global_slot;
+
+template <typename F>
+static void runThreaded(const std::string &name, int threads, F &&func) {
+    int iterations = config.measurement_iterations;
+    std::cout << "\n--- Benchmark: " << name << " ---" << std::endl;
+    std::cout << "Running " << iterations << " iterations on " << threads << " threads..."
+              << std::endl;
+
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (int i = 0; i < config.warmup_iterations; i++) {
+                func();
+            }
+            ready++;
+            while (!go.load()) {
+            }
+            for (int i = 0; i < iterations; i++) {
+                func();
+            }
+        });
+    }
+    while (ready.load() < threads) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    go.store(true);
+    for (auto &w : workers) {
+        w.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    long long duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    // the time a thread spends per increment, all threads running concurrently
+    double avg_time = (double)duration / iterations;
+    std::cout << "Total time: " << duration << " ns" << std::endl;
+    std::cout << "Average time per operation: " << avg_time << " ns" << std::endl;
+    results.push_back({name, duration, iterations, avg_time});
+}
+
+void benchmarkCounters() {
+    std::cout << "=== Benchmarking concurrent counter increments ===" << std::endl;
+    int cpus = (int)std::thread::hardware_concurrency();
+    std::vector<int> thread_counts = {1};
+    for (int threads = 4; threads < cpus; threads *= 4) {
+        thread_counts.push_back(threads);
+    }
+    if (cpus > 1) {
+        thread_counts.push_back(cpus);
+    }
+
+    for (int threads : thread_counts) {
+        std::string suffix = " (" + std::to_string(threads) + " threads)";
+        runThreaded("Shared slot" + suffix, threads, []() { atomicInc(global_slot); });
+        runThreaded("Sharded counter" + suffix, threads,
+                    []() { Counters::increment(UNWINDING_TIME_ASYNC); });
+    }
+    std::cout << "Sum of the shards: " << Counters::getCounter(UNWINDING_TIME_ASYNC)
+              << std::endl;
+
+    std::cout << "\n=== Benchmark Complete ===" << std::endl;
+}
@@ -0,0 +1,107 @@
+#include "benchmarkRunner.h"
+#include "buffers.h"
+#include "eventSchemas.h"
+#include <random>
+
+// Compares the encoding of an execution sample event field by field through
+// the Buffer put methods, each checking the limit of the buffer, with the
+// EventWriter, which reserves room for the largest event of the schema once.
+// The events are written by a single thread into a recording buffer flushed
+// to nowhere, as a core does while sampling, with the schema the recording
+// uses for them.
+
+const int CONTEXT_ATTRIBUTES = 2;
+const int VALUE_COUNT = 4096;
+
+struct SampleValues {
+    unsigned long long ticks;
+    int tid;
+    unsigned int call_trace_id;
+    unsigned long long weight;
+    unsigned long long hw_counters[HW_COUNTER_COUNT];
+    Context context;
+};
+
+static std::vector<SampleValues> values;
+
+static ssize_t discard(char *data, int len) {
+    return len;
+}
+
+static void setup() {
+    std::mt19937_64 rng(42);
+    values.resize(VALUE_COUNT);
+    unsigned long long ticks = 1ULL << 40;
+    for (SampleValues &v : values) {
+        ticks += rng() % 100000;
+        v.ticks = ticks;
+        v.tid = 1000 + rng() % 200;
+        v.call_trace_id = rng() % 100000;
+        v.weight = 1 + rng() % 3;
+        for (int i = 0; i < HW_COUNTER_COUNT; i++) {
+            v.hw_counters[i] = rng() % 10000000;
+        }
+        memset(&v.context, 0, sizeof(v.context));
+        v.context.spanId = rng();
+        v.context.rootSpanId = rng();
+        for (int i = 0; i < CONTEXT_ATTRIBUTES; i++) {
+            v.context.tags[i].value = rng() % 1000;
+        }
+    }
+}
+
+static void reportRate(const BenchmarkResult &result) {
+    std::cout << "Events per second on one core: " << (long long)(1e9 / result.avg_time_ns)
+              << std::endl;
+}
+
+void benchmarkEventWriter() {
+    std::cout << "=== Benchmarking event serialization ===" << std::endl;
+    setup();
+    RecordingBuffer buf;
+
+    results.push_back(runBenchmark("Buffer put per field", [&](int i) {
+        const SampleValues &v = values[i & (VALUE_COUNT - 1)];
+        int start = buf.skip(1);
+        buf.putVar64(1);
+        buf.putVar64(v.ticks);
+        buf.putVar64(v.tid);
+        buf.putVar64(v.call_trace_id);
+        buf.put8(2);
+        buf.put8(1);
+        buf.putVar64(v.weight);
+        buf.putVar64(10000000);
+        for (int j = 0; j < HW_COUNTER_COUNT; j++) {
+            buf.putVar64(v.hw_counters[j]);
+        }
+        buf.putVar64(v.context.spanId);
+        buf.putVar64(v.context.rootSpanId);
+        for (int j = 0; j < CONTEXT_ATTRIBUTES; j++) {
+            buf.putVar32(v.context.tags[j].value);
+        }
+        buf.put8(start, buf.offset() - start);
+        buf.flushIfNeeded(discard);
+    }));
+    reportRate(results.back());
+    buf.reset();
+
+    results.push_back(runBenchmark("EventWriter", [&](int i) {
+        const SampleValues &v = values[i & (VALUE_COUNT - 1)];
+        EventWriter<ExecutionSampleSchema>(&buf)
+            .put(1)
+            .put(v.ticks)
+            .put(v.tid)
+            .put(v.call_trace_id)
+            .put(2)
+            .put(1)
+            .put(v.weight)
+            .put(10000000)
+            .put(v.hw_counters)
+            .put(v.context, CONTEXT_ATTRIBUTES)
+            .commit();
+        buf.flushIfNeeded(discard);
+    }));
+    reportRate(results.back());
+
+    std::cout << "\n=== Benchmark Complete ===" << std::endl;
+}
@@ -0,0 +1,259 @@
+#include "benchmarkRunner.h"
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef F_SETOWN_EX
+#define F_SETOWN_EX 15
+#define F_OWNER_TID 0
+
+struct f_owner_ex {
+    int type;
+    pid_t pid;
+};
+#endif // F_SETOWN_EX
+
+// Mirrors the two sample handling modes of PerfEvents::signalHandler:
+//  - read/ioctl: read(si_fd) + PERF_EVENT_IOC_RESET + PERF_EVENT_IOC_REFRESH
+//  - perfmmap:   PERF_SAMPLE_PERIOD taken from the mmap ring, event kept armed
+// Syscalls are counted by the kernel through the raw_syscalls tracepoint, when
+// it is accessible; the count includes rt_sigreturn.
+
+const long SAMPLE_PERIOD_NS = 100 * 1000; // 100 us of task clock
+
+static long page_size;
+static int perf_fd = -1;
+static perf_event_mmap_page *perf_page = nullptr;
+static bool mmap_mode = false;
+
+static std::atomic<long> samples;
+static std::atomic<long long> handler_time_ns;
+static volatile unsigned long long sink;
+
+static long long nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts); // vDSO, not a syscall
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int perfEventOpen(perf_event_attr *attr, int tid, int group_fd) {
+    return syscall(__NR_perf_event_open, attr, tid, -1, group_fd, 0);
+}
+
+static unsigned long long readRingPeriod() {
+    unsigned long long head = perf_page->data_head;
+    unsigned long long tail = perf_page->data_tail;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    const char *data = (const char *)perf_page + page_size;
+    unsigned long long period = 0;
+    while (tail < head) {
+        const perf_event_header *hdr =
+            (const perf_event_header *)(data + (tail & (page_size - 1)));
+        if (hdr->type == PERF_RECORD_SAMPLE) {
+            period = *(const unsigned long long *)(data + ((tail + sizeof(*hdr)) & (page_size - 1)));
+        }
+        tail += hdr->size;
+    }
+    perf_page->data_tail = head;
+    return period;
+}
+
+static void signalHandler(int signo, siginfo_t *siginfo, void *ucontext) {
+    long long start = nowNs();
+    unsigned long long counter = 0;
+    if (mmap_mode) {
+        counter = readRingPeriod();
+    } else {
+        if (read(siginfo->si_fd, &counter, sizeof(counter)) != sizeof(counter)) {
+            counter = 1;
+        }
+        ioctl(siginfo->si_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(siginfo->si_fd, PERF_EVENT_IOC_REFRESH, 1);
+    }
+    sink += counter;
+    handler_time_ns += nowNs() - start;
+    samples++;
+}
+
+// Counts syscalls of the current thread via the raw_syscalls:sys_enter
+// tracepoint; returns -1 if tracefs is not accessible
+static int openSyscallCounter() {
+    const char *paths[] = {"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+                           "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"};
+    for (const char *path : paths) {
+        FILE *f = fopen(path, "r");
+        if (f == nullptr) {
+            continue;
+        }
+        int id = 0;
+        int n = fscanf(f, "%d", &id);
+        fclose(f);
+        if (n != 1 || id <= 0) {
+            continue;
+        }
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.config = id;
+        attr.disabled = 1;
+        return perfEventOpen(&attr, 0, -1);
+    }
+    return -1;
+}
+
+static bool openSampler(bool mmap_samples) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_TASK_CLOCK;
+    attr.sample_period = SAMPLE_PERIOD_NS;
+    attr.sample_type = PERF_SAMPLE_CALLCHAIN;
+    if (mmap_samples) {
+        attr.sample_type |= PERF_SAMPLE_PERIOD;
+    }
+    attr.disabled = 1;
+    attr.wakeup_events = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_callchain_user = 1;
+
+    int tid = syscall(__NR_gettid);
+    perf_fd = perfEventOpen(&attr, tid, -1);
+    if (perf_fd == -1) {
+        std::cout << "perf_event_open failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    void *page = mmap(nullptr, 2 * page_size, PROT_READ | PROT_WRITE, MAP_SHARED, perf_fd, 0);
+    perf_page = page == MAP_FAILED ? nullptr : (perf_event_mmap_page *)page;
+    if (mmap_samples && perf_page == nullptr) {
+        std::cout << "perf_event mmap failed: " << strerror(errno) << std::endl;
+        close(perf_fd);
+        return false;
+    }
+
+    struct f_owner_ex ex;
+    ex.type = F_OWNER_TID;
+    ex.pid = tid;
+    fcntl(perf_fd, F_SETFL, O_ASYNC);
+    fcntl(perf_fd, F_SETSIG, SIGPROF);
+    fcntl(perf_fd, F_SETOWN_EX, &ex);
+    return true;
+}
+
+static void closeSampler() {
+    ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (perf_page != nullptr) {
+        munmap(perf_page, 2 * page_size);
+        perf_page = nullptr;
+    }
+    close(perf_fd);
+    perf_fd = -1;
+}
+
+static void runSampler(const char *name, bool mmap_samples, long target_samples) {
+    std::cout << "\n--- Benchmark: " << name << " ---" << std::endl;
+    if (!openSampler(mmap_samples)) {
+        std::cout << "Skipped" << std::endl;
+        return;
+    }
+    mmap_mode = mmap_samples;
+    samples = 0;
+    handler_time_ns = 0;
+
+    int syscall_fd = openSyscallCounter();
+
+    ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+    if (syscall_fd != -1) {
+        ioctl(syscall_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(syscall_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    if (mmap_samples) {
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    } else {
+        ioctl(perf_fd, PERF_EVENT_IOC_REFRESH, 1);
+    }
+
+    // Burn CPU (without syscalls) until enough samples have been taken
+    auto start = std::chrono::high_resolution_clock::now();
+    unsigned long long x = 1;
+    while (samples.load(std::memory_order_relaxed) < target_samples) {
+        for (int i = 0; i < 10000; i++) {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+    }
+    sink += x;
+
+    ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    long long kernel_syscalls = -1;
+    if (syscall_fd != -1) {
+        ioctl(syscall_fd, PERF_EVENT_IOC_DISABLE, 0);
+        unsigned long long count;
+        if (read(syscall_fd, &count, sizeof(count)) == sizeof(count)) {
+            // minus the two ioctls issued around the measured region
+            kernel_syscalls = (long long)count - 2;
+        }
+        close(syscall_fd);
+    }
+    closeSampler();
+
+    long n = samples.load();
+    double avg_time = (double)handler_time_ns.load() / n;
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    std::cout << "Samples: " << n << " in " << duration.count() << " ns" << std::endl;
+    std::cout << "Average handler time per sample: " << avg_time << " ns" << std::endl;
+    if (kernel_syscalls >= 0) {
+        std::cout << "Syscalls per sample (incl. rt_sigreturn): "
+                  << (double)kernel_syscalls / n << std::endl;
+    } else {
+        std::cout << "raw_syscalls tracepoint is not accessible, syscalls not counted"
+                  << std::endl;
+    }
+
+    results.push_back({name, (long long)handler_time_ns.load(), (int)n, avg_time});
+}
+
+void benchmarkPerfSyscalls() {
+    std::cout << "=== Benchmarking perf_events sample handling ===" << std::endl;
+    page_size = sysconf(_SC_PAGESIZE);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = signalHandler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    struct sigaction old_sa;
+    sigaction(SIGPROF, &sa, &old_sa);
+
+    long target_samples = std::min(config.measurement_iterations, 20000);
+    runSampler("Perf Samples (read/ioctl)", false, target_samples);
+    runSampler("Perf Samples (perfmmap)", true, target_samples);
+
+    sigaction(SIGPROF, &old_sa, nullptr);
+    std::cout << "\n=== Benchmark Complete ===" << std::endl;
+}
+
+#else
+
+void benchmarkPerfSyscalls() {
+    std::cout << "perf_events are not available on this platform, skipping" << std::endl;
+}
+
+#endif // __linux__
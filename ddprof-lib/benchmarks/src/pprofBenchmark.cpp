@@ -0,0 +1,239 @@
+#include "benchmarkRunner.h"
+#include "buffers.h"
+#include "pprof.h"
+#include <algorithm>
+#include <random>
+
+// Compares the pprof output with the JFR one for the same aggregated profile:
+// the encoding time and the size of the output. The JFR side writes what a
+// chunk of an aggregated recording holds for the samples: one event per
+// aggregate and the stack trace, method, class and symbol constant pools.
+// The pprof side writes the samples, locations, functions and string table.
+
+const int METHOD_COUNT = 4096;
+const int CLASS_COUNT = 512;
+const int TRACE_COUNT = 8192;
+const int SAMPLE_COUNT = 16384;
+const int MIN_DEPTH = 16;
+const int MAX_DEPTH = 96;
+
+struct Frame {
+    int method;
+    int line;
+};
+
+struct Sample {
+    int trace;
+    int state;
+    unsigned long long span_id;
+    unsigned long long samples;
+    unsigned long long weight;
+};
+
+static std::vector<std::string> class_names;
+static std::vector<std::string> method_names;
+static std::vector<int> method_classes;
+static std::vector<std::vector<Frame>> traces;
+static std::vector<Sample> samples;
+static size_t jfr_bytes;
+
+static ssize_t countBytes(char *data, int len) {
+    jfr_bytes += len;
+    return len;
+}
+
+static void setup() {
+    std::mt19937_64 rng(42);
+    for (int i = 0; i < CLASS_COUNT; i++) {
+        class_names.push_back("com/example/service/module" + std::to_string(i % 16) +
+                              "/Class" + std::to_string(i));
+    }
+    for (int i = 0; i < METHOD_COUNT; i++) {
+        method_names.push_back("method" + std::to_string(i));
+        method_classes.push_back(rng() % CLASS_COUNT);
+    }
+    // Roughly Zipfian: a few methods show up in most of the stacks
+    std::geometric_distribution<int> rank(8.0 / METHOD_COUNT);
+    for (int i = 0; i < TRACE_COUNT; i++) {
+        int depth = MIN_DEPTH + rng() % (MAX_DEPTH - MIN_DEPTH);
+        std::vector<Frame> frames(depth);
+        for (int j = 0; j < depth; j++) {
+            frames[j].method = std::min(rank(rng), METHOD_COUNT - 1);
+            // a method is sampled at a few of its lines
+            frames[j].line = 10 + frames[j].method % 500 + rng() % 4;
+        }
+        traces.push_back(frames);
+    }
+    for (int i = 0; i < SAMPLE_COUNT; i++) {
+        Sample sample;
+        sample.trace = rng() % TRACE_COUNT;
+        sample.state = rng() % 10;
+        sample.span_id = rng() % 4 == 0 ? 0 : rng();
+        sample.samples = 1 + rng() % 20;
+        sample.weight = sample.samples;
+        samples.push_back(sample);
+    }
+}
+
+static size_t encodeJfr() {
+    RecordingBuffer buf;
+    jfr_bytes = 0;
+    for (const Sample &sample : samples) {
+        int start = buf.skip(1);
+        buf.putVar64(129);
+        buf.putVar64(1000);
+        buf.putVar64(1000000);
+        buf.putVar64(sample.trace + 1);
+        buf.put8(sample.state);
+        buf.put8(0);
+        buf.putVar64(sample.samples);
+        buf.putVar64(sample.weight);
+        buf.putVar64(10000000);
+        buf.putVar64(sample.span_id);
+        buf.putVar64(sample.span_id);
+        buf.put8(start, buf.offset() - start);
+        buf.flushIfNeeded(countBytes, RECORDING_BUFFER_LIMIT);
+    }
+
+    std::vector<bool> used_traces(TRACE_COUNT);
+    for (const Sample &sample : samples) {
+        used_traces[sample.trace] = true;
+    }
+    std::vector<bool> used_methods(METHOD_COUNT);
+    for (int i = 0; i < TRACE_COUNT; i++) {
+        if (!used_traces[i]) {
+            continue;
+        }
+        buf.putVar64(i + 1);
+        buf.put8(0);
+        buf.putVar64(traces[i].size());
+        for (const Frame &frame : traces[i]) {
+            used_methods[frame.method] = true;
+            buf.putVar64(frame.method + 1);
+            buf.putVar32(frame.line);
+            buf.putVar32(frame.line * 4);
+            buf.put8(1);
+            buf.flushIfNeeded(countBytes, RECORDING_BUFFER_LIMIT);
+        }
+    }
+    std::vector<bool> used_classes(CLASS_COUNT);
+    for (int i = 0; i < METHOD_COUNT; i++) {
+        if (used_methods[i]) {
+            used_classes[method_classes[i]] = true;
+            buf.putVar64(i + 1);
+            buf.putVar64(method_classes[i] + 1);
+            buf.putVar64(i + 1);
+            buf.putVar64(0);
+            buf.putVar64(1);
+            buf.putVar64(0);
+            buf.putVar64(i + 1);
+            buf.putUtf8(method_names[i].c_str(), method_names[i].size());
+            buf.flushIfNeeded(countBytes, RECORDING_BUFFER_LIMIT);
+        }
+    }
+    for (int i = 0; i < CLASS_COUNT; i++) {
+        if (used_classes[i]) {
+            buf.putVar64(i + 1);
+            buf.putVar64(0);
+            buf.putVar64(i + 1);
+            buf.putVar64(0);
+            buf.putVar64(0);
+            buf.putVar64(i + 1);
+            buf.putUtf8(class_names[i].c_str(), class_names[i].size());
+            buf.flushIfNeeded(countBytes, RECORDING_BUFFER_LIMIT);
+        }
+    }
+    buf.flushIfNeeded(countBytes, 0);
+    return jfr_bytes;
+}
+
+static size_t encodePprof() {
+    PprofWriter writer(-1);
+    writer.sampleType("cpu-samples", "count");
+    writer.sampleType("cpu-time", "nanoseconds");
+    u64 state_key = writer.string("thread state");
+    u64 span_key = writer.string("span id");
+    u64 states[10];
+    for (int i = 0; i < 10; i++) {
+        states[i] = writer.string(("STATE" + std::to_string(i)).c_str());
+    }
+
+    // the location ids by method and line, and the location ids of each trace,
+    // which are shared by its samples, as in Recording::writeProfile
+    std::unordered_map<u64, u64> locations;
+    std::unordered_map<u32, std::pair<size_t, int>> trace_locations;
+    std::vector<u64> location_ids;
+    std::vector<bool> used_methods(METHOD_COUNT);
+    for (const Sample &sample : samples) {
+        std::unordered_map<u32, std::pair<size_t, int>>::iterator trace =
+            trace_locations.find(sample.trace);
+        if (trace == trace_locations.end()) {
+            size_t start = location_ids.size();
+            for (const Frame &frame : traces[sample.trace]) {
+                u64 key = (u64)frame.method << 32 | frame.line;
+                std::unordered_map<u64, u64>::const_iterator location = locations.find(key);
+                u64 id;
+                if (location != locations.end()) {
+                    id = location->second;
+                } else {
+                    id = locations.size() + 1;
+                    locations[key] = id;
+                    writer.location(id, frame.method + 1, frame.line);
+                }
+                used_methods[frame.method] = true;
+                location_ids.push_back(id);
+            }
+            trace = trace_locations
+                        .insert(std::make_pair(sample.trace,
+                                               std::make_pair(start, location_ids.size() - start)))
+                        .first;
+        }
+        u64 values[2] = {sample.samples, sample.weight * 10000000};
+        PprofLabel labels[2] = {{state_key, states[sample.state], 0},
+                                {span_key, 0, sample.span_id}};
+        writer.sample(location_ids.data() + trace->second.first, trace->second.second, values,
+                      2, labels, sample.span_id != 0 ? 2 : 1);
+    }
+
+    std::string name;
+    for (int i = 0; i < METHOD_COUNT; i++) {
+        if (used_methods[i]) {
+            name = class_names[method_classes[i]];
+            std::replace(name.begin(), name.end(), '/', '.');
+            name += '.';
+            name += method_names[i];
+            writer.function(i + 1, writer.string(name.data(), name.size()));
+        }
+    }
+    return writer.finish();
+}
+
+template <typename F>
+static void runProfiles(const std::string &name, F &&encode) {
+    // each profile holds SAMPLE_COUNT aggregates
+    int profiles = std::max(1, config.measurement_iterations / SAMPLE_COUNT);
+    std::cout << "\n--- Benchmark: " << name << " ---" << std::endl;
+    std::cout << "Encoding " << profiles << " profiles..." << std::endl;
+    size_t size = encode();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < profiles; i++) {
+        size = encode();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    long long duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    double avg_time = (double)duration / profiles;
+    std::cout << "Output size: " << size << " bytes" << std::endl;
+    std::cout << "Average time per profile: " << avg_time << " ns" << std::endl;
+    results.push_back({name, duration, profiles, avg_time});
+}
+
+void benchmarkPprof() {
+    std::cout << "=== Benchmarking pprof and JFR profile encoding ===" << std::endl;
+    setup();
+
+    runProfiles("JFR events and constant pools", encodeJfr);
+    runProfiles("pprof", encodePprof);
+
+    std::cout << "\n=== Benchmark Complete ===" << std::endl;
+}
@@ -0,0 +1,92 @@
+#include "benchmarkRunner.h"
+#include "symbolCache.h"
+#include <algorithm>
+#include <random>
+
+// Compares the binary search done by Profiler::findNativeMethod on every
+// native frame with the same search behind a SymbolCache. The library is a
+// synthetic sorted symbol table the size of libjvm, and the sampled PCs follow
+// a skewed distribution over a few thousand hot return addresses.
+
+const int SYMBOL_COUNT = 64 * 1024;
+const int HOT_PCS = 4096;
+const int SAMPLED_PCS = 1 << 16;
+
+struct Symbol {
+    unsigned long long start;
+    const char *name;
+};
+
+static std::vector<Symbol> symbols;
+static std::vector<const void *> sampled_pcs;
+static SymbolCache symbol_cache;
+static volatile unsigned long long sink;
+
+static const char *binarySearch(const void *pc) {
+    unsigned long long address = (unsigned long long)pc;
+    int low = 0;
+    int high = SYMBOL_COUNT - 1;
+    while (low <= high) {
+        int mid = (unsigned int)(low + high) >> 1;
+        if (symbols[mid].start < address) {
+            low = mid + 1;
+        } else if (symbols[mid].start > address) {
+            high = mid - 1;
+        } else {
+            return symbols[mid].name;
+        }
+    }
+    return low > 0 ? symbols[low - 1].name : NULL;
+}
+
+static void setup() {
+    std::mt19937_64 rng(42);
+    unsigned long long address = 0x7f0000000000ULL;
+    symbols.resize(SYMBOL_COUNT);
+    for (int i = 0; i < SYMBOL_COUNT; i++) {
+        address += 16 + rng() % 512;
+        symbols[i].start = address;
+        symbols[i].name = (const char *)(uintptr_t)(i + 1);
+    }
+
+    std::vector<const void *> hot(HOT_PCS);
+    for (int i = 0; i < HOT_PCS; i++) {
+        const Symbol &s = symbols[rng() % SYMBOL_COUNT];
+        hot[i] = (const void *)(uintptr_t)(s.start + 1 + rng() % 16);
+    }
+    // Roughly Zipfian: the lower ranked addresses dominate the samples
+    std::geometric_distribution<int> rank(4.0 / HOT_PCS);
+    sampled_pcs.resize(SAMPLED_PCS);
+    for (int i = 0; i < SAMPLED_PCS; i++) {
+        sampled_pcs[i] = hot[std::min(rank(rng), HOT_PCS - 1)];
+    }
+}
+
+void benchmarkSymbolCache() {
+    std::cout << "=== Benchmarking native symbol lookup ===" << std::endl;
+    setup();
+
+    results.push_back(runBenchmark("Binary search", [&](int i) {
+        sink += (uintptr_t)binarySearch(sampled_pcs[i & (SAMPLED_PCS - 1)]);
+    }));
+
+    long long hits = 0;
+    long long lookups = 0;
+    results.push_back(runBenchmark("SymbolCache + binary search", [&](int i) {
+        const void *pc = sampled_pcs[i & (SAMPLED_PCS - 1)];
+        CodeCache *lib;
+        const char *name;
+        lookups++;
+        if (symbol_cache.lookup(pc, 1, &lib, &name)) {
+            hits++;
+        } else {
+            name = binarySearch(pc);
+            symbol_cache.insert(pc, 1, NULL, name);
+        }
+        sink += (uintptr_t)name;
+    }));
+    std::cout << "Hit ratio: " << (lookups > 0 ? hits * 100.0 / lookups : 0) << "%"
+              << std::endl;
+
+    std::cout << "\n=== Benchmark Complete ===" << std::endl;
+}
@@ -0,0 +1,30 @@
+#include "benchmarkRunner.h"
+#include "tsc.h"
+#include <time.h>
+
+static volatile unsigned long long sink;
+
+// Compares the raw counter behind TSC::ticks() with the vDSO clock_gettime
+// path taken by OS::nanotime() when the counter is not supported
+void benchmarkTimestamps() {
+    std::cout << "=== Benchmarking timestamp sources ===" << std::endl;
+
+    if (TSC_SUPPORTED) {
+#if defined(__aarch64__)
+        std::cout << "Counter frequency (cntfrq_el0): " << cntfrq() << " Hz" << std::endl;
+#endif
+        results.push_back(runBenchmark("Counter (rdtsc/cntvct_el0)", [&](int) {
+            sink += rdtsc();
+        }));
+    } else {
+        std::cout << "No user-space counter on this platform" << std::endl;
+    }
+
+    results.push_back(runBenchmark("clock_gettime(CLOCK_MONOTONIC)", [&](int) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        sink += (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }));
+
+    std::cout << "\n=== Benchmark Complete ===" << std::endl;
+}
@@ -1,4 +1,5 @@
 #include "benchmarkConfig.h"
+#include "benchmarkRunner.h"
 #include "unwindStats.h"
 #include <chrono>
 #include <cstring>
@@ -83,51 +84,6 @@ void exportResultsToJSON(const std::string &filename) {
     std::cout << "Results exported to JSON: " << filename << std::endl;
 }
 
-// Helper function to run a benchmark with warmup
-template <typename F>
-BenchmarkResult runBenchmark(const std::string &name, F &&func, double rng_overhead = 0.0) {
-    std::cout << "\n--- Benchmark: " << name << " ---" << std::endl;
-
-    // Warmup phase
-    if (config.warmup_iterations > 0) {
-        std::cout << "Warming up with " << config.warmup_iterations << " iterations..."
-                  << std::endl;
-        for (int i = 0; i < config.warmup_iterations; i++) {
-            func(i);
-        }
-    }
-
-    // Measurement phase
-    std::cout << "Running " << config.measurement_iterations << " iterations..." << std::endl;
-    auto start = std::chrono::high_resolution_clock::now();
-
-    for (int i = 0; i < config.measurement_iterations; i++) {
-        func(i);
-        if (config.debug && i % 100000 == 0) {
-            std::cout << "Progress: " << (i * 100 / config.measurement_iterations) << "%"
-                      << std::endl;
-        }
-    }
-
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
-
-    double avg_time = (double)duration.count() / config.measurement_iterations;
-    if (rng_overhead > 0) {
-        avg_time -= rng_overhead;
-    }
-
-    std::cout << "Total time: " << duration.count() << " ns" << std::endl;
-    std::cout << "Average time per operation: " << avg_time << " ns" << std::endl;
-    if (rng_overhead > 0) {
-        std::cout << "  (RNG overhead of " << rng_overhead << " ns has been subtracted)"
-                  << std::endl;
-    }
-
-    return {name, static_cast<long long>(avg_time * config.measurement_iterations),
-            config.measurement_iterations, avg_time};
-}
-
 // Benchmark just the RNG overhead
 BenchmarkResult measureRNGOverhead() {
     std::mt19937 rng(42);
@@ -145,7 +101,6 @@ BenchmarkResult measureRNGOverhead() {
 // Main benchmark function
 void benchmarkUnwindFailures() {
     UnwindFailures failures;
-    results.clear(); // Clear any previous results
 
     std::cout << "=== Benchmarking UnwindFailures ===" << std::endl;
     std::cout << "Configuration:" << std::endl;
@@ -219,6 +174,19 @@ void benchmarkUnwindFailures() {
     std::cout << "\n=== Benchmark Complete ===" << std::endl;
 }
 
+struct BenchmarkSuite {
+    const char *name;
+    void (*run)();
+};
+
+const BenchmarkSuite SUITES[] = {{"unwind_failures", benchmarkUnwindFailures},
+                                 {"perf_syscalls", benchmarkPerfSyscalls},
+                                 {"timestamps", benchmarkTimestamps},
+                                 {"symbol_cache", benchmarkSymbolCache},
+                                 {"counters", benchmarkCounters},
+                                 {"pprof", benchmarkPprof},
+                                 {"event_writer", benchmarkEventWriter}};
+
 void printUsage(const char *programName) {
     std::cout << "Usage: " << programName << " [options]\n"
               << "Options:\n"
@@ -226,11 +194,16 @@ void printUsage(const char *programName) {
               << "  --json <filename>   Export results to JSON file\n"
               << "  --warmup <n>        Number of warmup iterations (default: 100000)\n"
               << "  --iterations <n>    Number of measurement iterations (default: 1000000)\n"
+              << "  --benchmark <name>  Run only the given suite (unwind_failures, perf_syscalls,\n"
+              << "                      timestamps, symbol_cache, counters, pprof,\n"
+              << "                      event_writer)\n"
               << "  --debug            Enable debug output\n"
               << "  -h, --help         Show this help message\n";
 }
 
 int main(int argc, char *argv[]) {
+    const char *suite = nullptr;
+
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
@@ -241,6 +214,8 @@ int main(int argc, char *argv[]) {
             config.warmup_iterations = std::atoi(argv[++i]);
         } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
             config.measurement_iterations = std::atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            suite = argv[++i];
         } else if (strcmp(argv[i], "--debug") == 0) {
             config.debug = true;
         } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
@@ -253,8 +228,19 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    std::cout << "Running UnwindFailures benchmark..." << std::endl;
-    benchmarkUnwindFailures();
+    bool found = false;
+    for (const auto &s : SUITES) {
+        if (suite == nullptr || strcmp(suite, s.name) == 0) {
+            std::cout << "Running " << s.name << " benchmark..." << std::endl;
+            s.run();
+            found = true;
+        }
+    }
+    if (!found) {
+        std::cerr << "Unknown benchmark: " << suite << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
 
     // Export results if requested
     if (!config.csv_file.empty()) {
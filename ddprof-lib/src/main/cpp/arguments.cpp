@@ -101,6 +101,61 @@ static const Multiplier UNIVERSAL[] = {
 //                          MODE is 'fp', 'dwarf', 'lbr', 'vm' or 'no'
 //     allkernel          - include only kernel-mode events
 //     alluser            - include only user-mode events
+//     hwcounters[=BOOL]  - sample on CPU cycles with perf_events and attach
+//                          instructions, cache-misses and branch-misses deltas
+//                          to each CPU sample (default: false)
+//     perfmmap[=BOOL]    - keep perf_events armed and take sample values from
+//                          the mmap ring instead of read()/ioctl() in the
+//                          signal handler (default: false)
+//     percpu[=BOOL]      - open one perf event per CPU filtered to this
+//                          process instead of one per thread. Samples are
+//                          forwarded to the sampled thread with a queued
+//                          realtime signal (SIGRTMIN+5), so the stack is taken
+//                          slightly after the overflow and has no kernel
+//                          frames (default: false)
+//     frametrie[=BOOL]   - store call traces as paths of a frame trie sharing
+//                          common callers (default: false)
+//     tracememory=SIZE   - memory limit for call trace storage; new traces
+//                          are recorded as storage overflow once it is reached
+//                          (default: 0, i.e. unbounded)
+//     traceretain=N      - keep call traces recorded in the last N chunks,
+//                          with their ids, instead of dropping all call traces
+//                          after each chunk (default: 0)
+//     defersymbols[=BOOL] - record native frames as raw addresses and resolve
+//                          their symbols when writing the recording
+//                          (default: false)
+//     unwindcache[=BOOL] - reuse the frame pointer chain walked for the
+//                          previous sample of a thread from the first frame
+//                          found unchanged (default: false)
+//     schedstat[=BOOL]   - attach the on-CPU and run queue wait time of the
+//                          thread since its previous wall clock sample, read
+//                          from /proc schedstat. Not supported by the jvmti
+//                          wall clock sampler (default: false)
+//     cpuload[=BOOL]     - record the CPU load of the process and the machine,
+//                          and the CPU usage and throttling of the cgroup, from
+//                          a profiler thread waking up every second
+//                          (default: false)
+//     overhead=PCT       - keep the CPU time spent sampling below PCT percent
+//                          of the available CPUs by lowering the CPU and wall
+//                          clock sampling rates (default: 0, i.e. fixed rates)
+//     ring=DURATION      - keep only the chunks of the last DURATION seconds
+//                          in memory instead of writing the recording to the
+//                          file; dumps write the kept chunks (default: 0)
+//     ringsize=SIZE      - memory limit for the chunks kept by the ring
+//                          (default: 32m)
+//     aggregate[=BOOL]   - record CPU and wall clock samples as counts by
+//                          stack trace, state and context for each chunk
+//                          instead of one event per sample. Not supported
+//                          with hwcounters or schedstat (default: false)
+//     pprof              - write the CPU and wall clock samples to the file
+//                          as a pprof profile instead of a JFR recording. Not
+//                          supported with hwcounters or schedstat
+//     wallsampler=MODE   - wall clock sampler: asgct (signals sent from a
+//                          timer thread), jvmti (stacks taken through JVMTI)
+//                          or timer (a timer for each thread, Linux only:
+//                          one signal per thread and interval, restricted to
+//                          the threads of the filter if one is set)
+//                          (default: asgct)
 //
 
 Error Arguments::parse(const char *args) {
@@ -317,12 +372,72 @@ Error Arguments::parse(const char *args) {
           _lightweight = false;
         }
       }
+
+      CASE("hwcounters")
+      _hw_counters = value == NULL || value[0] == 't' || value[0] == 'y';
+
+      CASE("perfmmap")
+      _perf_mmap = value == NULL || value[0] == 't' || value[0] == 'y';
+
+      CASE("percpu")
+      _perf_cpu = value == NULL || value[0] == 't' || value[0] == 'y';
+
+      CASE("frametrie")
+      _frame_trie = value == NULL || value[0] == 't' || value[0] == 'y';
+
+      CASE("tracememory")
+      if (value == NULL || (_trace_memory = parseUnits(value, BYTES)) < 0) {
+        msg = "tracememory must be >= 0";
+      }
+
+      CASE("traceretain")
+      if (value == NULL || (_trace_retain = atoi(value)) < 0) {
+        msg = "traceretain must be >= 0";
+      }
+
+      CASE("defersymbols")
+      _defer_symbols = value == NULL || value[0] == 't' || value[0] == 'y';
+
+      CASE("unwindcache")
+      _unwind_cache = value == NULL || value[0] == 't' || value[0] == 'y';
+
+      CASE("schedstat")
+      _schedstat = value == NULL || value[0] == 't' || value[0] == 'y';
+
+      CASE("cpuload")
+      _cpu_load = value == NULL || value[0] == 't' || value[0] == 'y';
+
+      CASE("overhead")
+      if (value == NULL || (_overhead = strtod(value, NULL)) < 0 ||
+          _overhead > 100) {
+        msg = "overhead must be between 0 and 100";
+      }
+
+      CASE("ring")
+      if (value == NULL || (_ring_duration = parseUnits(value, SECONDS)) < 0) {
+        msg = "ring must be >= 0";
+      }
+
+      CASE("ringsize")
+      if (value == NULL || (_ring_size = parseUnits(value, BYTES)) <= 0) {
+        msg = "ringsize must be > 0";
+      }
+
+      CASE("aggregate")
+      _aggregate = value == NULL || value[0] == 't' || value[0] == 'y';
+
+      CASE("pprof")
+      _output = OUTPUT_PPROF;
+
             CASE("wallsampler")
                 if (value != NULL) {
                     switch (value[0]) {
                         case 'j':
                             _wallclock_sampler = JVMTI;
                             break;
+                        case 't':
+                            _wallclock_sampler = TIMER;
+                            break;
                         case 'a':
                         default:
                             _wallclock_sampler = ASGCT;
@@ -340,6 +455,17 @@ Error Arguments::parse(const char *args) {
     return Error(msg);
   }
 
+  if (_output == OUTPUT_PPROF && _ring_duration > 0) {
+    return Error("pprof output can not be combined with ring");
+  }
+
+  // Aggregated samples keep only a count and a weight for each key, the
+  // values attached to each sample would be dropped
+  if ((_aggregate || _output == OUTPUT_PPROF) && (_hw_counters || _schedstat)) {
+    return Error("hwcounters and schedstat can not be combined with aggregate "
+                 "or pprof");
+  }
+
   if (_event == NULL && _cpu < 0 && _wall < 0 && _memory < 0) {
     _event = EVENT_CPU;
   }
@@ -27,6 +27,7 @@ const long DEFAULT_WALL_INTERVAL = 50 * 1000 * 1000; // 50 ms
 const long DEFAULT_ALLOC_INTERVAL = 524287;          // 512 KiB
 const int DEFAULT_WALL_THREADS_PER_TICK = 16;
 const int DEFAULT_JSTACKDEPTH = 2048;
+const long DEFAULT_RING_SIZE = 32 * 1024 * 1024;     // 32 MiB
 
 const char *const EVENT_NOOP = "noop";
 const char *const EVENT_CPU = "cpu";
@@ -70,7 +71,7 @@ enum CStack {
   CSTACK_VMX       // same as CSTACK_VM but with intermediate native frames
 };
 
-enum Output { OUTPUT_NONE, OUTPUT_COLLAPSED, OUTPUT_JFR };
+enum Output { OUTPUT_NONE, OUTPUT_COLLAPSED, OUTPUT_JFR, OUTPUT_PPROF };
 
 enum JfrOption {
   NO_SYSTEM_INFO = 0x1,
@@ -84,7 +85,8 @@ enum JfrOption {
 
 enum WallclockSampler {
     ASGCT,
-    JVMTI
+    JVMTI,
+    TIMER
 };
 
 struct Multiplier {
@@ -147,6 +149,21 @@ public:
   int _jfr_options;
   std::vector<std::string> _context_attributes;
   bool _lightweight;
+  bool _hw_counters;
+  bool _perf_mmap;
+  bool _perf_cpu;
+  bool _frame_trie;
+  long _trace_memory;
+  int _trace_retain;
+  bool _defer_symbols;
+  bool _unwind_cache;
+  bool _schedstat;
+  bool _cpu_load;
+  double _overhead;
+  long _ring_duration;
+  long _ring_size;
+  bool _aggregate;
+  Output _output;
 
   Arguments(bool persistent = false)
       : _buf(NULL),
@@ -177,7 +194,22 @@ public:
         _jfr_options(0),
         _context_attributes({}),
         _wallclock_sampler(ASGCT),
-        _lightweight(false) {}
+        _lightweight(false),
+        _hw_counters(false),
+        _perf_mmap(false),
+        _perf_cpu(false),
+        _frame_trie(false),
+        _trace_memory(0),
+        _trace_retain(0),
+        _defer_symbols(false),
+        _unwind_cache(false),
+        _schedstat(false),
+        _cpu_load(false),
+        _overhead(0),
+        _ring_duration(0),
+        _ring_size(DEFAULT_RING_SIZE),
+        _aggregate(false),
+        _output(OUTPUT_JFR) {}
 
   ~Arguments();
 
@@ -3,7 +3,6 @@
 
 #include <cassert>
 #include <string.h>
-#include <new>
 #include <unistd.h>
 
 #include <arpa/inet.h>
@@ -15,10 +14,8 @@ const int BUFFER_LIMIT = BUFFER_SIZE - 128;
 // we use this space, which is larger than the longest string we will store,
 // as a temporary defence against overflow. If we ever write into this space
 // we may produce a corrupt recording, which is sad, but we can't overwrite
-// offsets in the adjacent buffer, which has been a frequent cause of hard to
-// diagnose crashes. Ultimately, the entire FlightRecorder implementation needs
-// to be reworked for the sake of safety, but this small change derisks the
-// legacy implementation at a runtime cost of 16 * 8KiB = 128KiB
+// the adjacent buffer, which has been a frequent cause of hard to diagnose
+// crashes.
 const int RECORDING_BUFFER_OVERFLOW = 8192;
 const int RECORDING_BUFFER_SIZE = 65536;
 const int RECORDING_BUFFER_LIMIT = RECORDING_BUFFER_SIZE - 4096;
@@ -26,20 +23,22 @@ const int MAX_STRING_LENGTH = 8191;
 
 typedef ssize_t (*FlushCallback)(char *data, int len);
 
+// Encodes JFR data into the memory provided by the subclass. The limit is
+// not virtual, so that the checks done for each field stay cheap.
 class Buffer {
 private:
+  char *_data;
+  int _limit;
   int _offset;
-  static const int _limit = BUFFER_SIZE - sizeof(int);
+
+  Buffer(const Buffer &) = delete;
+  Buffer &operator=(const Buffer &) = delete;
+
 protected:
-  // this array is 'extended' by the RecordingBuffer
-  // this will confuse sanitizers and most of the sane people but it seems to
-  // work
-  char _data[_limit];
+  Buffer(char *data, int limit) : _data(data), _limit(limit), _offset(0) {}
 
 public:
-  Buffer() : _offset(0) { memset(_data, 0, _limit); }
-
-  virtual int limit() const { return _limit; }
+  int limit() const { return _limit; }
 
   bool flushIfNeeded(FlushCallback callback, int limit = BUFFER_LIMIT) {
     if (_offset > limit) {
@@ -65,115 +64,105 @@ public:
 
   void reset() { _offset = 0; }
 
-  #ifdef __aarch64__
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan on aarch64
-  __attribute__((no_sanitize("bounds")))
-  #endif
+  // Checks once that size bytes fit and returns where to write them. The
+  // bytes actually written are accounted for by commit().
+  char *reserve(int size) {
+    assert(_offset + size < limit());
+    return _data + _offset;
+  }
+
+  void commit(const char *end) { _offset = (int)(end - _data); }
+
+  // The raw encoders behind the put methods, which return the position after
+  // the encoded value
+  static char *encodeVar32(char *p, u32 v) {
+    while (v > 0x7f) {
+      *p++ = (char)v | 0x80;
+      v >>= 7;
+    }
+    *p++ = (char)v;
+    return p;
+  }
+
+  static char *encodeVar64(char *p, u64 v) {
+    int iter = 0;
+    while (v > 0x1fffff) {
+      *p++ = (char)v | 0x80;
+      v >>= 7;
+      *p++ = (char)v | 0x80;
+      v >>= 7;
+      *p++ = (char)v | 0x80;
+      v >>= 7;
+      if (++iter == 3)
+        return p;
+    }
+    while (v > 0x7f) {
+      *p++ = (char)v | 0x80;
+      v >>= 7;
+    }
+    *p++ = (char)v;
+    return p;
+  }
+
+  static char *encode32(char *p, int v) {
+    v = htonl(v);
+    memcpy(p, &v, 4);
+    return p + 4;
+  }
+
+  static char *encodeFloat(char *p, float v) {
+    int i;
+    memcpy(&i, &v, 4);
+    return encode32(p, i);
+  }
+
   void put(const char *v, u32 len) {
     assert(static_cast<int>(_offset + len) < limit());
     memcpy(_data + _offset, v, len);
     _offset += (int)len;
   }
 
-  #ifdef __aarch64__
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan on aarch64
-  __attribute__((no_sanitize("bounds")))
-  #endif
   void put8(char v) {
     assert(_offset < limit());
     _data[_offset++] = v;
   }
 
-  #ifdef __aarch64__
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan on aarch64
-  __attribute__((no_sanitize("bounds")))
-  #endif
   void put16(short v) {
     assert(_offset + 2 < limit());
-    *(short *)(_data + _offset) = htons(v);
+    v = htons(v);
+    memcpy(_data + _offset, &v, 2);
     _offset += 2;
   }
 
-  //    java-profiler/ddprof-lib/src/main/cpp/buffers.h:92:34: runtime error:
-  //    store to misaligned address 0x7f3c446ec81e for type 'int', which
-  //    requires 4 byte alignment 0x7f3c446ec81e: note: pointer points here
-  __attribute__((no_sanitize("undefined"))) 
-  #ifdef __aarch64__
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan on aarch64
-  __attribute__((no_sanitize("bounds")))
-  #endif
   void put32(int v) {
     assert(_offset + 4 < limit());
-    *(int *)(_data + _offset) = htonl(v);
+    encode32(_data + _offset, v);
     _offset += 4;
   }
 
-  // alignment issue to be looked at
-  //    runtime error: store to misaligned address 0x766bb5a1e814 for type
-  //    'u64', which requires 8 byte alignment
-  //         0x766bb5a1e814: note: pointer points here
-  __attribute__((no_sanitize("undefined")))
-  #ifdef __aarch64__
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan on aarch64
-  __attribute__((no_sanitize("bounds")))
-  #endif
   void put64(u64 v) {
     assert(_offset + 8 < limit());
-    *(u64 *)(_data + _offset) = OS::hton64(v);
+    v = OS::hton64(v);
+    memcpy(_data + _offset, &v, 8);
     _offset += 8;
   }
 
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan
-  __attribute__((no_sanitize("bounds")))
   void putFloat(float v) {
-    union {
-      float f;
-      int i;
-    } u;
-
-    u.f = v;
-    put32(u.i);
+    assert(_offset + 4 < limit());
+    encodeFloat(_data + _offset, v);
+    _offset += 4;
   }
 
-  #ifdef __aarch64__
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan on aarch64
-  __attribute__((no_sanitize("bounds")))
-  #endif
   void putVar32(u32 v) {
     assert(_offset + 5 < limit());
-    while (v > 0x7f) {
-      _data[_offset++] = (char)v | 0x80;
-      v >>= 7;
-    }
-    _data[_offset++] = (char)v;
+    commit(encodeVar32(_data + _offset, v));
   }
 
-  #ifdef __aarch64__
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan on aarch64
-  __attribute__((no_sanitize("bounds")))
-  #endif
   void putVar64(u64 v) {
     assert(_offset + 9 < limit());
-    int iter = 0;
-    while (v > 0x1fffff) {
-      _data[_offset++] = (char)v | 0x80;
-      v >>= 7;
-      _data[_offset++] = (char)v | 0x80;
-      v >>= 7;
-      _data[_offset++] = (char)v | 0x80;
-      v >>= 7;
-      if (++iter == 3)
-        return;
-    }
-    while (v > 0x7f) {
-      _data[_offset++] = (char)v | 0x80;
-      v >>= 7;
-    }
-    _data[_offset++] = (char)v;
+    commit(encodeVar64(_data + _offset, v));
   }
 
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan
-  __attribute__((no_sanitize("bounds")))
   void putUtf8(const char *v) {
     if (v == NULL) {
       put8(0);
@@ -183,10 +172,6 @@ public:
     }
   }
 
-  #ifdef __aarch64__
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan on aarch64
-  __attribute__((no_sanitize("bounds")))
-  #endif
   void putUtf8(const char *v, u32 len) {
     len = len < MAX_STRING_LENGTH ? len : MAX_STRING_LENGTH;
     put8(3);
@@ -194,16 +179,8 @@ public:
     put(v, len);
   }
 
-  #ifdef __aarch64__
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan on aarch64
-  __attribute__((no_sanitize("bounds")))
-  #endif
   void put8(int offset, char v) { _data[offset] = v; }
 
-  #ifdef __aarch64__
-  // the trickery of RecordingBuffer extending Buffer::_data array may trip off asan on aarch64
-  __attribute__((no_sanitize("bounds")))
-  #endif
   void putVar32(int offset, u32 v) {
     _data[offset] = v | 0x80;
     _data[offset + 1] = (v >> 7) | 0x80;
@@ -213,24 +190,28 @@ public:
   }
 };
 
+class SmallBuffer : public Buffer {
+private:
+  char _buf[BUFFER_SIZE];
+
+public:
+  SmallBuffer() : Buffer(_buf, BUFFER_SIZE) { memset(_buf, 0, sizeof(_buf)); }
+};
+
 class RecordingBuffer : public Buffer {
 private:
-  static const int _limit = RECORDING_BUFFER_SIZE - sizeof(Buffer);
   // we reserve 8KiB to overflow in to in case event serialisers in
   // the flight recorder are buggy. If we ever use the overflow,
   // which is sized to accommodate the largest possible string, we
   // will truncate and may produce a corrupt recording, but we will
   // not write into arbitrary memory.
-  char _buf[_limit + RECORDING_BUFFER_OVERFLOW];
+  char _buf[RECORDING_BUFFER_SIZE + RECORDING_BUFFER_OVERFLOW];
 
 public:
-  RecordingBuffer() : Buffer() {
-    new (_data + sizeof(_data)) char[sizeof(_buf)];
-    memset(_buf, 0, _limit); 
+  RecordingBuffer() : Buffer(_buf, RECORDING_BUFFER_SIZE) {
+    memset(_buf, 0, RECORDING_BUFFER_SIZE);
   }
 
-  int limit() const override { return _limit; }
-
   bool flushIfNeeded(FlushCallback callback,
                      int limit = RECORDING_BUFFER_LIMIT) {
     return Buffer::flushIfNeeded(callback, limit);
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bursts.h"
+#include "context.h"
+
+const int Bursts::CAPACITY;
+const int Bursts::MAX_FACTOR;
+
+Bursts::Burst Bursts::_bursts[Bursts::CAPACITY];
+volatile int Bursts::_active = 0;
+
+void Bursts::release(Burst &burst, int tid) {
+  if (__sync_bool_compare_and_swap(&burst.tid, tid, 0)) {
+    __atomic_sub_fetch(&_active, 1, __ATOMIC_RELEASE);
+  }
+}
+
+int Bursts::check(Burst &burst, int tid, u64 now) {
+  if (__atomic_load_n(&burst.tid, __ATOMIC_ACQUIRE) != tid) {
+    return 0;
+  }
+  u64 span_id = burst.span_id;
+  u64 deadline = burst.deadline;
+  int factor = burst.factor;
+  // the slot may have been released and taken again while reading it
+  if (__atomic_load_n(&burst.tid, __ATOMIC_ACQUIRE) != tid) {
+    return 0;
+  }
+  if (now >= deadline ||
+      (span_id != 0 && Contexts::get(tid).spanId != span_id)) {
+    release(burst, tid);
+    return 1;
+  }
+  return factor;
+}
+
+bool Bursts::start(int tid, u64 span_id, u64 deadline, int factor) {
+  for (int i = 0; i < CAPACITY; i++) {
+    if (__atomic_load_n(&_bursts[i].tid, __ATOMIC_ACQUIRE) == tid) {
+      release(_bursts[i], tid);
+    }
+  }
+  for (int i = 0; i < CAPACITY; i++) {
+    Burst &burst = _bursts[i];
+    if (__sync_bool_compare_and_swap(&burst.tid, 0, -1)) {
+      burst.span_id = span_id;
+      burst.deadline = deadline;
+      burst.factor = factor;
+      // counted before it is published, so that whoever finds the burst
+      // also finds the table active
+      __atomic_add_fetch(&_active, 1, __ATOMIC_RELEASE);
+      __atomic_store_n(&burst.tid, tid, __ATOMIC_RELEASE);
+      return true;
+    }
+  }
+  return false;
+}
+
+int Bursts::factor(int tid, u64 now) {
+  if (!active()) {
+    return 1;
+  }
+  for (int i = 0; i < CAPACITY; i++) {
+    int factor = check(_bursts[i], tid, now);
+    if (factor != 0) {
+      return factor;
+    }
+  }
+  return 1;
+}
+
+void Bursts::collect(std::vector<int> &tids, u64 now) {
+  if (!active()) {
+    return;
+  }
+  for (int i = 0; i < CAPACITY; i++) {
+    int tid = __atomic_load_n(&_bursts[i].tid, __ATOMIC_ACQUIRE);
+    if (tid > 0 && check(_bursts[i], tid, now) > 1) {
+      tids.push_back(tid);
+    }
+  }
+}
+
+void Bursts::reset() {
+  for (int i = 0; i < CAPACITY; i++) {
+    _bursts[i].tid = 0;
+  }
+  __atomic_store_n(&_active, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BURSTS_H
+#define _BURSTS_H
+
+#include "arch_dd.h"
+#include <vector>
+
+// Threads sampled at a higher rate for a limited time, e.g. while they serve
+// a request the tracer found interesting. A burst ends at its deadline or, if
+// it is bound to a span, as soon as the thread leaves that span. The engines
+// pick the bursts up on their own: there is no callback when one ends.
+//
+// All the methods are async-signal-safe except collect().
+class Bursts {
+public:
+  static const int CAPACITY = 64;
+  static const int MAX_FACTOR = 100;
+
+private:
+  struct Burst {
+    volatile int tid; // 0 for a free slot, -1 while the slot is being filled
+    u64 span_id;      // 0 if the burst is not bound to a span
+    u64 deadline;     // OS::nanotime()
+    int factor;
+  };
+
+  static Burst _bursts[CAPACITY];
+  static volatile int _active;
+
+  // 0 if the slot is not taken by the thread, 1 if its burst has ended
+  static int check(Burst &burst, int tid, u64 now);
+  static void release(Burst &burst, int tid);
+
+public:
+  // Samples the thread `factor` times as often until the deadline. Replaces
+  // a burst the thread is already in. Returns false if all slots are taken.
+  static bool start(int tid, u64 span_id, u64 deadline, int factor);
+
+  static bool active() {
+    return __atomic_load_n(&_active, __ATOMIC_ACQUIRE) > 0;
+  }
+
+  // The rate factor of the thread, 1 if it is not in a burst
+  static int factor(int tid, u64 now);
+
+  // Appends the threads in a burst to the list
+  static void collect(std::vector<int> &tids, u64 now);
+
+  // this *MUST* be called only when the profiler is stopped
+  static void reset();
+};
+
+#endif // _BURSTS_H
@@ -6,6 +6,7 @@
 #include "callTraceStorage.h"
 #include "counters.h"
 #include "os.h"
+#include <algorithm>
 #include <string.h>
 
 #define COMMA ,
@@ -19,27 +20,41 @@ private:
   LongHashTable *_prev;
   void *_padding0;
   u32 _capacity;
-  u32 _padding1[15];
+  // id of the trace in slot 0
+  u32 _id_base;
+  u32 _padding1[14];
   volatile u32 _size;
   u32 _padding2[15];
+  // Slots whose samples went from 0 to 1 since the last collection are listed
+  // in one of two arrays, so that the collector can walk one while samples go
+  // to the other. The upper half selects the array, the lower half counts the
+  // slots listed in it.
+  volatile u64 _touched;
+  u32 _padding3[14];
 
+public:
   static size_t getSize(u32 capacity) {
-    size_t size = sizeof(LongHashTable) +
-                  (sizeof(u64) + sizeof(CallTraceSample)) * capacity;
+    size_t size =
+        sizeof(LongHashTable) +
+        (sizeof(u64) + sizeof(CallTraceSample) + 2 * sizeof(u32)) * capacity;
     return (size + OS::page_mask) & ~OS::page_mask;
   }
 
-public:
-  LongHashTable() : _prev(NULL), _padding0(NULL), _capacity(0), _size(0) {
+  LongHashTable()
+      : _prev(NULL), _padding0(NULL), _capacity(0), _id_base(0), _size(0),
+        _touched(0) {
     memset(_padding1, 0, sizeof(_padding1));
     memset(_padding2, 0, sizeof(_padding2));
+    memset(_padding3, 0, sizeof(_padding3));
   }
 
-  static LongHashTable *allocate(LongHashTable *prev, u32 capacity) {
+  static LongHashTable *allocate(LongHashTable *prev, u32 capacity,
+                                 u32 id_base) {
     LongHashTable *table = (LongHashTable *)OS::safeAlloc(getSize(capacity));
     if (table != NULL) {
       table->_prev = prev;
       table->_capacity = capacity;
+      table->_id_base = id_base;
       // The reset is not useful with the anon mmap setting the memory is
       // zeroed. However this silences a false positive and should not have a
       // performance impact.
@@ -56,8 +71,18 @@ public:
 
   LongHashTable *prev() { return _prev; }
 
+  void setPrev(LongHashTable *prev) { _prev = prev; }
+
   u32 capacity() { return _capacity; }
 
+  // Each table has its own range of ids, so that a trace keeps its id for as
+  // long as it stays in its slot
+  u32 id(u32 slot) { return _id_base + slot; }
+
+  void setIdBase(u32 id_base) { _id_base = id_base; }
+
+  size_t bytes() { return getSize(_capacity); }
+
   u32 size() { return _size; }
 
   u32 incSize() { return __sync_add_and_fetch(&_size, 1); }
@@ -66,17 +91,66 @@ public:
 
   CallTraceSample *values() { return (CallTraceSample *)(keys() + _capacity); }
 
+  // Entries hold the slot + 1, 0 until written
+  u32 *touched(u64 state) {
+    return (u32 *)(values() + _capacity) + ((state >> 32) & 1) * _capacity;
+  }
+
+  // Each slot is appended at most once between two collections, as only the
+  // first sample after a collection touches it
+  void touch(u32 slot) {
+    u64 state = __sync_fetch_and_add(&_touched, 1);
+    u32 index = (u32)state;
+    if (index < _capacity) {
+      __atomic_store_n(&touched(state)[index], slot + 1, __ATOMIC_RELEASE);
+    }
+  }
+
+  // Moves the samples to the other array and returns the slots touched in
+  // this one, which it empties
+  template <typename F> void collectTouched(F &&collect) {
+    u64 state = __atomic_load_n(&_touched, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&_touched, &state,
+                                        ((state >> 32) + 1) << 32, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    }
+    u32 *list = touched(state);
+    u32 count = (u32)state < _capacity ? (u32)state : _capacity;
+    for (u32 i = 0; i < count; i++) {
+      u32 entry;
+      // the sample which got this index may not have written it yet
+      while ((entry = __atomic_load_n(&list[i], __ATOMIC_ACQUIRE)) == 0) {
+        spinPause();
+      }
+      list[i] = 0;
+      collect(entry - 1);
+    }
+  }
+
   void clear() {
-    memset(keys(), 0, (sizeof(u64) + sizeof(CallTraceSample)) * _capacity);
+    memset(keys(), 0,
+           (sizeof(u64) + sizeof(CallTraceSample) + 2 * sizeof(u32)) *
+               _capacity);
     _size = 0;
+    _touched = 0;
   }
 };
 
-CallTrace CallTraceStorage::_overflow_trace = {false, 1, {BCI_ERROR, LP64_ONLY(0 COMMA) (jmethodID)"storage_overflow"}};
+CallTrace CallTraceStorage::_overflow_trace = {false, 1, NULL, {BCI_ERROR, LP64_ONLY(0 COMMA) (jmethodID)"storage_overflow"}};
+CallTrace CallTraceStorage::_evicted_trace = {false, 0, NULL, {}};
 
-CallTraceStorage::CallTraceStorage() : _allocator(CALL_TRACE_CHUNK), _lock(0) {
-  _current_table = LongHashTable::allocate(NULL, INITIAL_CAPACITY);
+CallTraceStorage::CallTraceStorage()
+    : _arena0(CALL_TRACE_CHUNK), _arena1(CALL_TRACE_CHUNK), _lock(0) {
+  _allocator = &_arena0;
+  _current_table = LongHashTable::allocate(NULL, INITIAL_CAPACITY, 1);
+  _next_id = 1 + INITIAL_CAPACITY;
   _overflow = 0;
+  _frame_trie = false;
+  _trie_roots = NULL;
+  _memory_limit = 0;
+  _retained_chunks = 0;
+  _chunk = 0;
+  _bytes = _current_table->bytes();
 }
 
 CallTraceStorage::~CallTraceStorage() {
@@ -91,34 +165,175 @@ void CallTraceStorage::clear() {
     _current_table = _current_table->destroy();
   }
   _current_table->clear();
-  _allocator.clear();
+  _current_table->setIdBase(1);
+  _next_id = 1 + _current_table->capacity();
+  _allocator->clear();
   _overflow = 0;
+  _trie_roots = NULL;
+  _bytes = _current_table->bytes();
   Counters::set(CALLTRACE_STORAGE_BYTES, 0);
   Counters::set(CALLTRACE_STORAGE_TRACES, 0);
+  Counters::set(CALLTRACE_STORAGE_NODES, 0);
   _lock.unlock();
 }
 
-void CallTraceStorage::collectTraces(std::map<u32, CallTrace *> &map) {
+void CallTraceStorage::finishChunk() {
+  if (_retained_chunks == 0) {
+    clear();
+    return;
+  }
+  _lock.lock();
+  compact();
+  _lock.unlock();
+}
+
+// Copies the traces recorded in the last _retained_chunks chunks to the other
+// arena. They stay in their slot, and therefore keep their id, while the
+// others are evicted: their slot is kept so that they get the same id if
+// sampled again. Tables left with evicted traces only are dropped.
+void CallTraceStorage::compact() {
+  LinearAllocator *retired = _allocator;
+  _allocator = retired == &_arena0 ? &_arena1 : &_arena0;
+  _trie_roots = NULL;
+  _bytes = 0;
   for (LongHashTable *table = _current_table; table != NULL;
        table = table->prev()) {
+    _bytes += table->bytes();
+  }
+  Counters::set(CALLTRACE_STORAGE_BYTES, 0);
+  Counters::set(CALLTRACE_STORAGE_TRACES, 0);
+  Counters::set(CALLTRACE_STORAGE_NODES, 0);
+
+  std::vector<ASGCT_CallFrame> trie_frames;
+  u32 current_retained = 0;
+  LongHashTable *newer = NULL;
+  for (LongHashTable *table = _current_table; table != NULL;) {
     u64 *keys = table->keys();
     CallTraceSample *values = table->values();
     u32 capacity = table->capacity();
-
+    u32 retained = 0;
     for (u32 slot = 0; slot < capacity; slot++) {
+      if (keys[slot] == 0) {
+        continue;
+      }
+      CallTraceSample &s = values[slot];
+      CallTrace *trace = s.trace;
+      CallTrace *copy = NULL;
+      if (trace != NULL && trace != &_evicted_trace &&
+          trace != &_overflow_trace && _chunk - s.chunk <= _retained_chunks) {
+        ASGCT_CallFrame *frames = trace->frames;
+        if (trace->leaf != NULL) {
+          trie_frames.clear();
+          for (FrameNode *node = trace->leaf; node != NULL;
+               node = node->parent) {
+            trie_frames.push_back(node->frame);
+          }
+          frames = trie_frames.data();
+        }
+        copy = storeCallTrace(trace->num_frames, frames, trace->truncated);
+      }
+      if (copy != NULL) {
+        s.trace = copy;
+        retained++;
+      } else {
+        s.trace = &_evicted_trace;
+      }
+    }
+
+    LongHashTable *prev = table->prev();
+    if (table == _current_table) {
+      current_retained = retained;
+      newer = table;
+    } else if (retained == 0) {
+      // The evicted traces get a new id if sampled again
+      _bytes -= table->bytes();
+      newer->setPrev(prev);
+      table->destroy();
+    } else {
+      newer = table;
+    }
+    table = prev;
+  }
+  retired->clear();
+  _overflow = 0;
+
+  // Evicted slots are never reused by other traces. Once they take a
+  // significant part of the current table, new traces go to a fresh one,
+  // while the retained ones stay where they are.
+  LongHashTable *table = _current_table;
+  if (table->size() - current_retained > table->capacity() / 4) {
+    LongHashTable *fresh = allocateTable(table, INITIAL_CAPACITY);
+    if (fresh != NULL) {
+      _current_table = fresh;
+    }
+  }
+}
+
+void CallTraceStorage::collectTraces(CallTraceList &traces) {
+  for (LongHashTable *table = _current_table; table != NULL;
+       table = table->prev()) {
+    u64 *keys = table->keys();
+    CallTraceSample *values = table->values();
+    table->collectTouched([&](u32 slot) {
       if (keys[slot] != 0 && loadAcquire(values[slot].samples) != 0) {
         // Reset samples to avoid duplication of call traces between JFR chunks
         values[slot].samples = 0;
         CallTrace *trace = values[slot].acquireTrace();
-        if (trace != NULL) {
-          map[capacity - (INITIAL_CAPACITY - 1) + slot] = trace;
+        if (trace != NULL && trace != &_evicted_trace) {
+          traces.push_back(std::make_pair(table->id(slot), trace));
         }
       }
-    }
+    });
   }
   if (_overflow > 0) {
-    map[OVERFLOW_TRACE_ID] = &_overflow_trace;
+    traces.push_back(std::make_pair(OVERFLOW_TRACE_ID, &_overflow_trace));
+  }
+  std::sort(traces.begin(), traces.end());
+  _chunk++;
+}
+
+// Accounts for the given number of bytes unless the memory limit is reached
+bool CallTraceStorage::reserveBytes(size_t size) {
+  u64 bytes = __atomic_load_n(&_bytes, __ATOMIC_RELAXED);
+  do {
+    if (_memory_limit > 0 && bytes + size > _memory_limit) {
+      return false;
+    }
+  } while (!__atomic_compare_exchange_n(&_bytes, &bytes, bytes + size, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return true;
+}
+
+void *CallTraceStorage::allocate(size_t size) {
+  if (!reserveBytes(size)) {
+    return NULL;
+  }
+  void *buf = _allocator->alloc(size);
+  if (buf == NULL) {
+    __atomic_sub_fetch(&_bytes, size, __ATOMIC_RELAXED);
+    return NULL;
   }
+  Counters::increment(CALLTRACE_STORAGE_BYTES, size);
+  return buf;
+}
+
+// Allocates a table with a range of ids of its own
+LongHashTable *CallTraceStorage::allocateTable(LongHashTable *prev,
+                                               u32 capacity) {
+  size_t size = LongHashTable::getSize(capacity);
+  // Ids are taken only once the memory is accounted for, a table refused by
+  // the limit does not use up a range
+  if (!reserveBytes(size)) {
+    return NULL;
+  }
+  u32 id_base = __atomic_fetch_add(&_next_id, capacity, __ATOMIC_RELAXED);
+  LongHashTable *table = id_base < OVERFLOW_TRACE_ID - capacity
+                             ? LongHashTable::allocate(prev, capacity, id_base)
+                             : NULL;
+  if (table == NULL) {
+    __atomic_sub_fetch(&_bytes, size, __ATOMIC_RELAXED);
+  }
+  return table;
 }
 
 // Adaptation of MurmurHash64A by Austin Appleby
@@ -154,42 +369,119 @@ u64 CallTraceStorage::calcHash(int num_frames, ASGCT_CallFrame *frames,
   return h;
 }
 
+// Lock-free lookup of a child node: new children are pushed to the head of the
+// sibling list with CAS, nodes are never removed until the storage is cleared
+FrameNode *CallTraceStorage::findOrInsertChild(FrameNode **children,
+                                               FrameNode *parent,
+                                               const ASGCT_CallFrame &frame) {
+  FrameNode *head = __atomic_load_n(children, __ATOMIC_ACQUIRE);
+  FrameNode *scanned = NULL;
+  FrameNode *node = NULL;
+  while (true) {
+    // only the siblings pushed since the last scan need to be checked
+    for (FrameNode *n = head; n != scanned; n = n->sibling) {
+      if (n->frame.method_id == frame.method_id && n->frame.bci == frame.bci) {
+        // a node allocated by a lost race stays unused until the next clear
+        return n;
+      }
+    }
+    if (node == NULL) {
+      node = (FrameNode *)allocate(sizeof(FrameNode));
+      if (node == NULL) {
+        return NULL;
+      }
+      node->parent = parent;
+      node->children = NULL;
+      node->frame = frame;
+      Counters::increment(CALLTRACE_STORAGE_NODES);
+    }
+    node->sibling = head;
+    scanned = head;
+    if (__atomic_compare_exchange_n(children, &head, node, false,
+                                    __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+      return node;
+    }
+  }
+}
+
 CallTrace *CallTraceStorage::storeCallTrace(int num_frames,
                                             ASGCT_CallFrame *frames,
                                             bool truncated) {
   const size_t header_size = sizeof(CallTrace) - sizeof(ASGCT_CallFrame);
+  if (_frame_trie) {
+    // Frames are inserted from the outermost one so that traces sharing
+    // the same callers share the same path
+    FrameNode *leaf = NULL;
+    FrameNode **children = &_trie_roots;
+    for (int i = num_frames - 1; i >= 0; i--) {
+      leaf = findOrInsertChild(children, leaf, frames[i]);
+      if (leaf == NULL) {
+        return NULL;
+      }
+      children = &leaf->children;
+    }
+    CallTrace *buf = (CallTrace *)allocate(header_size);
+    if (buf != NULL) {
+      buf->num_frames = num_frames;
+      buf->leaf = leaf;
+      buf->truncated = truncated;
+      Counters::increment(CALLTRACE_STORAGE_TRACES);
+    }
+    return buf;
+  }
+
   const size_t total_size = header_size + num_frames * sizeof(ASGCT_CallFrame);
-  CallTrace *buf = (CallTrace *)_allocator.alloc(total_size);
+  CallTrace *buf = (CallTrace *)allocate(total_size);
   if (buf != NULL) {
     buf->num_frames = num_frames;
+    buf->leaf = NULL;
     // Do not use memcpy inside signal handler
     for (int i = 0; i < num_frames; i++) {
       buf->frames[i] = frames[i];
     }
     buf->truncated = truncated;
-    Counters::increment(CALLTRACE_STORAGE_BYTES, total_size);
     Counters::increment(CALLTRACE_STORAGE_TRACES);
   }
   return buf;
 }
 
-CallTrace *CallTraceStorage::findCallTrace(LongHashTable *table, u64 hash) {
-  u64 *keys = table->keys();
-  u32 capacity = table->capacity();
-  u32 slot = hash & (capacity - 1);
-  u32 step = 0;
+// Looks the hash up in the given table and the ones before it
+LongHashTable *CallTraceStorage::findSlot(LongHashTable *table, u64 hash,
+                                          u32 *found_slot) {
+  for (; table != NULL; table = table->prev()) {
+    u64 *keys = table->keys();
+    u32 capacity = table->capacity();
+    u32 slot = hash & (capacity - 1);
+    u32 step = 0;
 
-  while (keys[slot] != hash) {
-    if (keys[slot] == 0) {
-      return NULL;
+    while (keys[slot] != hash) {
+      if (keys[slot] == 0 || ++step >= capacity) {
+        slot = capacity;
+        break;
+      }
+      slot = (slot + step) & (capacity - 1);
     }
-    if (++step >= capacity) {
-      return NULL;
+    if (slot < capacity) {
+      *found_slot = slot;
+      return table;
     }
-    slot = (slot + step) & (capacity - 1);
   }
+  return NULL;
+}
 
-  return table->values()[slot].trace;
+// Stores an evicted trace again under the id it had before
+void CallTraceStorage::restoreCallTrace(CallTraceSample &s, int num_frames,
+                                        ASGCT_CallFrame *frames,
+                                        bool truncated) {
+  CallTrace *trace = storeCallTrace(num_frames, frames, truncated);
+  if (trace == NULL) {
+    trace = &_overflow_trace;
+  }
+  // A concurrent restore may win, leaving this copy unused until the next
+  // compaction
+  CallTrace *evicted = &_evicted_trace;
+  __atomic_compare_exchange_n(&s.trace, &evicted, trace, false,
+                              __ATOMIC_RELEASE, __ATOMIC_RELAXED);
 }
 
 u32 CallTraceStorage::put(int num_frames, ASGCT_CallFrame *frames,
@@ -217,32 +509,30 @@ u32 CallTraceStorage::put(int num_frames, ASGCT_CallFrame *frames,
       break;
     }
     if (key_value == 0) {
+      // Traces stay in the table they were first stored in, with their id
+      LongHashTable *prev_table = findSlot(table->prev(), hash, &slot);
+      if (prev_table != NULL) {
+        table = prev_table;
+        break;
+      }
       if (!__sync_bool_compare_and_swap(&keys[slot], 0, hash)) {
         continue; // another thread claimed it, go to next slot
       }
       // Increment the table size, and if the load factor exceeds 0.75, reserve
       // a new table
       if (table->incSize() == capacity * 3 / 4) {
-        LongHashTable *new_table = LongHashTable::allocate(table, capacity * 2);
+        LongHashTable *new_table = allocateTable(table, capacity * 2);
         if (new_table != NULL) {
           __sync_bool_compare_and_swap(&_current_table, table, new_table);
         }
       }
 
-      // Migrate from a previous table to save space
-      CallTrace *trace =
-          table->prev() == NULL ? NULL : findCallTrace(table->prev(), hash);
+      CallTrace *trace = storeCallTrace(num_frames, frames, truncated);
       if (trace == NULL) {
-        trace = storeCallTrace(num_frames, frames, truncated);
+        // the memory limit is reached
+        trace = &_overflow_trace;
       }
       table->values()[slot].setTrace(trace);
-
-      // clear the slot in the prev table such it is not written out to constant
-      // pool multiple times
-      LongHashTable *prev_table = table->prev();
-      if (prev_table != NULL) {
-        prev_table->keys()[slot] = 0;
-      }
       break;
     }
 
@@ -257,9 +547,15 @@ u32 CallTraceStorage::put(int num_frames, ASGCT_CallFrame *frames,
   }
 
   CallTraceSample &s = table->values()[slot];
-  atomicInc(s.samples);
+  if (s.acquireTrace() == &_evicted_trace) {
+    restoreCallTrace(s, num_frames, frames, truncated);
+  }
+  if (atomicInc(s.samples) == 0) {
+    table->touch(slot);
+  }
   atomicInc(s.counter, weight);
+  s.chunk = _chunk;
 
   _lock.unlockShared();
-  return capacity - (INITIAL_CAPACITY - 1) + slot;
+  return table->id(slot);
 }
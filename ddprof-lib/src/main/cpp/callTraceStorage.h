@@ -21,14 +21,26 @@
 #include "linearAllocator.h"
 #include "spinLock.h"
 #include "vmEntry.h"
-#include <map>
+#include <utility>
 #include <vector>
 
 class LongHashTable;
 
+// A node of the frame trie: the path from a node up to the top-level node
+// spells out a stack trace from the innermost to the outermost frame
+struct FrameNode {
+  FrameNode *parent;
+  FrameNode *children;
+  FrameNode *sibling;
+  ASGCT_CallFrame frame;
+};
+
 struct CallTrace {
   bool truncated;
   int num_frames;
+  // innermost frame of a trace stored in the frame trie; frames[] is not
+  // populated for such traces
+  FrameNode *leaf;
   ASGCT_CallFrame frames[1];
 };
 
@@ -36,6 +48,8 @@ struct CallTraceSample {
   CallTrace *trace;
   u64 samples;
   u64 counter;
+  // the last chunk this trace was recorded in
+  u64 chunk;
 
   CallTrace *acquireTrace() {
     return __atomic_load_n(&trace, __ATOMIC_ACQUIRE);
@@ -57,27 +71,63 @@ struct CallTraceSample {
   }
 };
 
+// Trace ids with their traces, in id order
+typedef std::vector<std::pair<u32, CallTrace *> > CallTraceList;
+
 class CallTraceStorage {
 private:
   static CallTrace _overflow_trace;
-
-  LinearAllocator _allocator;
+  // placeholder for an evicted trace which keeps its id and is stored again
+  // when sampled
+  static CallTrace _evicted_trace;
+
+  // retained traces are compacted from the active arena into the other one
+  LinearAllocator _arena0;
+  LinearAllocator _arena1;
+  LinearAllocator *_allocator;
   LongHashTable *_current_table;
   u64 _overflow;
+  bool _frame_trie;
+  FrameNode *_trie_roots;
+  u64 _memory_limit;
+  u32 _retained_chunks;
+  u64 _chunk;
+  volatile u64 _bytes;
+  // the first id of the next table
+  volatile u32 _next_id;
 
   SpinLock _lock;
 
   u64 calcHash(int num_frames, ASGCT_CallFrame *frames, bool truncated);
+  bool reserveBytes(size_t size);
+  void *allocate(size_t size);
   CallTrace *storeCallTrace(int num_frames, ASGCT_CallFrame *frames,
                             bool truncated);
-  CallTrace *findCallTrace(LongHashTable *table, u64 hash);
+  LongHashTable *allocateTable(LongHashTable *prev, u32 capacity);
+  LongHashTable *findSlot(LongHashTable *table, u64 hash, u32 *found_slot);
+  void restoreCallTrace(CallTraceSample &s, int num_frames,
+                        ASGCT_CallFrame *frames, bool truncated);
+  void compact();
+  FrameNode *findOrInsertChild(FrameNode **children, FrameNode *parent,
+                               const ASGCT_CallFrame &frame);
 
 public:
   CallTraceStorage();
   ~CallTraceStorage();
 
   void clear();
-  void collectTraces(std::map<u32, CallTrace *> &map);
+  // Deep stacks sharing long prefixes take far less memory when stored as
+  // paths of a frame trie. Must only be switched while the storage is empty.
+  void setFrameTrie(bool enabled) { _frame_trie = enabled; }
+  // Bounds the memory taken by traces and hash tables; once reached, new
+  // traces are recorded as the storage overflow trace. 0 means unbounded.
+  void setMemoryLimit(u64 bytes) { _memory_limit = bytes; }
+  // Keep traces recorded in the last given number of chunks, with their ids,
+  // when a chunk is finished instead of dropping all traces.
+  void setRetainedChunks(u32 chunks) { _retained_chunks = chunks; }
+  // To be called once the traces of a chunk have been written
+  void finishChunk();
+  void collectTraces(CallTraceList &traces);
 
   u32 put(int num_frames, ASGCT_CallFrame *frames, bool truncated, u64 weight);
 };
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cgroupMonitor.h"
+#include "os.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char CGROUP_ROOT[] = "/sys/fs/cgroup";
+
+// Opens the cgroup v2 directory of this process. Without a cgroup namespace
+// the path in /proc/self/cgroup is relative to the host hierarchy, which a
+// container usually sees mounted as its own root.
+static int openOwnCgroupDir() {
+  FILE *f = fopen("/proc/self/cgroup", "r");
+  if (f == NULL) {
+    return -1;
+  }
+
+  int fd = -1;
+  char line[PATH_MAX];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (strncmp(line, "0::", 3) == 0) {
+      line[strcspn(line, "\n")] = 0;
+      char path[PATH_MAX + 16];
+      snprintf(path, sizeof(path), "%s%s", CGROUP_ROOT, line + 3);
+      fd = ::open(path, O_RDONLY | O_DIRECTORY);
+      if (fd == -1) {
+        fd = ::open(CGROUP_ROOT, O_RDONLY | O_DIRECTORY);
+      }
+      break;
+    }
+  }
+  fclose(f);
+  return fd;
+}
+
+bool CgroupMonitor::open() {
+  int dir = openOwnCgroupDir();
+  if (dir == -1) {
+    return false;
+  }
+  _cpu_stat_fd = openat(dir, "cpu.stat", O_RDONLY);
+  // cpu.max does not exist in the root cgroup, pressure needs CONFIG_PSI
+  _cpu_max_fd = openat(dir, "cpu.max", O_RDONLY);
+  _cpu_pressure_fd = openat(dir, "cpu.pressure", O_RDONLY);
+  ::close(dir);
+  if (_cpu_stat_fd == -1) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void CgroupMonitor::close() {
+  int *fds[] = {&_cpu_stat_fd, &_cpu_max_fd, &_cpu_pressure_fd};
+  for (int i = 0; i < 3; i++) {
+    if (*fds[i] != -1) {
+      ::close(*fds[i]);
+      *fds[i] = -1;
+    }
+  }
+}
+
+int CgroupMonitor::readFile(int fd, char *buf, int size) {
+  if (fd == -1) {
+    return -1;
+  }
+  ssize_t r = pread(fd, buf, size - 1, 0);
+  if (r <= 0) {
+    return -1;
+  }
+  buf[r] = 0;
+  return r;
+}
+
+bool CgroupMonitor::read(CgroupCpuStat *stat) {
+  memset(stat, 0, sizeof(CgroupCpuStat));
+  stat->time = OS::nanotime();
+
+  char buf[1024];
+  if (readFile(_cpu_stat_fd, buf, sizeof(buf)) < 0 ||
+      !parseCpuStat(buf, stat)) {
+    return false;
+  }
+  if (readFile(_cpu_max_fd, buf, sizeof(buf)) >= 0) {
+    parseCpuMax(buf, &stat->limit);
+  }
+  if (readFile(_cpu_pressure_fd, buf, sizeof(buf)) >= 0) {
+    parsePressure(buf, &stat->pressure_some, &stat->pressure_full);
+  }
+  return true;
+}
+
+// cpu.stat is a list of "key value" lines
+bool CgroupMonitor::parseCpuStat(const char *text, CgroupCpuStat *stat) {
+  bool has_usage = false;
+  while (*text != 0) {
+    const char *space = strchr(text, ' ');
+    if (space == NULL) {
+      break;
+    }
+    size_t key_len = space - text;
+    u64 value = strtoull(space + 1, NULL, 10);
+    if (key_len == 10 && strncmp(text, "usage_usec", key_len) == 0) {
+      stat->usage = value;
+      has_usage = true;
+    } else if (key_len == 10 && strncmp(text, "nr_periods", key_len) == 0) {
+      stat->periods = value;
+    } else if (key_len == 12 && strncmp(text, "nr_throttled", key_len) == 0) {
+      stat->throttled_periods = value;
+    } else if (key_len == 14 &&
+               strncmp(text, "throttled_usec", key_len) == 0) {
+      stat->throttled = value;
+    }
+    const char *eol = strchr(space, '\n');
+    if (eol == NULL) {
+      break;
+    }
+    text = eol + 1;
+  }
+  return has_usage;
+}
+
+// cpu.max is "$MAX $PERIOD" where $MAX may be "max"
+bool CgroupMonitor::parseCpuMax(const char *text, float *limit) {
+  if (strncmp(text, "max", 3) == 0) {
+    *limit = 0;
+    return true;
+  }
+  char *end;
+  u64 quota = strtoull(text, &end, 10);
+  u64 period = strtoull(end, NULL, 10);
+  if (end == text || period == 0) {
+    return false;
+  }
+  *limit = (float)quota / period;
+  return true;
+}
+
+// cpu.pressure is "some avg10=.. avg60=.. avg300=.. total=$USEC" followed by
+// the same for "full" on kernels which report it for the CPU
+bool CgroupMonitor::parsePressure(const char *text, u64 *some, u64 *full) {
+  bool found = false;
+  while (*text != 0) {
+    const char *total = strstr(text, "total=");
+    const char *eol = strchr(text, '\n');
+    if (total != NULL && (eol == NULL || total < eol)) {
+      u64 value = strtoull(total + 6, NULL, 10);
+      if (strncmp(text, "some", 4) == 0) {
+        *some = value;
+        found = true;
+      } else if (strncmp(text, "full", 4) == 0) {
+        *full = value;
+      }
+    }
+    if (eol == NULL) {
+      break;
+    }
+    text = eol + 1;
+  }
+  return found;
+}
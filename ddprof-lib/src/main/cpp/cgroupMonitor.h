@@ -0,0 +1,63 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CGROUPMONITOR_H
+#define _CGROUPMONITOR_H
+
+#include "arch_dd.h"
+
+// Cumulative CPU accounting of a cgroup v2, in microseconds
+struct CgroupCpuStat {
+  u64 time;  // OS::nanotime() when read
+  u64 usage;
+  u64 periods;
+  u64 throttled_periods;
+  u64 throttled;
+  // stall time of some / all of the runnable tasks of the cgroup
+  u64 pressure_some;
+  u64 pressure_full;
+  // CPUs allowed by the quota, 0 if unlimited
+  float limit;
+};
+
+// Reads the CPU controller files of the cgroup v2 the process belongs to.
+// The files are opened once, each cycle only rereads them from the start.
+class CgroupMonitor {
+private:
+  int _cpu_stat_fd;
+  int _cpu_max_fd;
+  int _cpu_pressure_fd;
+
+  static int readFile(int fd, char *buf, int size);
+
+public:
+  CgroupMonitor() : _cpu_stat_fd(-1), _cpu_max_fd(-1), _cpu_pressure_fd(-1) {}
+  ~CgroupMonitor() { close(); }
+
+  // Returns false if the process is not in a cgroup v2 with a CPU controller
+  bool open();
+  void close();
+
+  bool enabled() const { return _cpu_stat_fd != -1; }
+
+  bool read(CgroupCpuStat *stat);
+
+  static bool parseCpuStat(const char *text, CgroupCpuStat *stat);
+  static bool parseCpuMax(const char *text, float *limit);
+  static bool parsePressure(const char *text, u64 *some, u64 *full);
+};
+
+#endif // _CGROUPMONITOR_H
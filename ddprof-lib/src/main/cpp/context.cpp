@@ -20,22 +20,29 @@
 #include <cstring>
 
 int Contexts::_max_pages = Contexts::getMaxPages();
-Context **Contexts::_pages = new Context *[_max_pages]();
+ContextSlot **Contexts::_pages = new ContextSlot *[_max_pages]();
 
 static Context DD_EMPTY_CONTEXT = {};
 
-Context &Contexts::get(int tid) {
+Context Contexts::get(int tid) {
   int pageIndex = tid >> DD_CONTEXT_PAGE_SHIFT;
   // extreme edge case: pageIndex >= _max_pages if pid_max was increased during
   // the process's runtime
   if (pageIndex < _max_pages) {
-    Context *page = _pages[pageIndex];
+    ContextSlot *page = _pages[pageIndex];
     if (page != NULL) {
-      Context &context = page[tid & DD_CONTEXT_PAGE_MASK];
-      if ((context.spanId ^ context.rootSpanId) == context.checksum) {
-        return context;
+      ContextSlot &slot = page[tid & DD_CONTEXT_PAGE_MASK];
+      // The published copy is only rewritten after the next publication, so
+      // an unchanged sequence means the copy was not touched while reading
+      for (int attempt = 0; attempt < 3; attempt++) {
+        u64 sequence = __atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE);
+        Context context = slot.copies[sequence & 1];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) == sequence) {
+          return context;
+        }
       }
-      Counters::increment(CounterId::CONTEXT_CHECKSUM_REJECT_GETS);
+      Counters::increment(CounterId::CONTEXT_TORN_GETS);
     } else {
       Counters::increment(CounterId::CONTEXT_NULL_PAGE_GETS);
     }
@@ -55,8 +62,9 @@ void Contexts::initialize(int pageIndex) {
     return;
   }
   if (__atomic_load_n(&_pages[pageIndex], __ATOMIC_ACQUIRE) == NULL) {
-    u32 capacity = DD_CONTEXT_PAGE_SIZE * sizeof(Context);
-    Context *page = (Context *)aligned_alloc(sizeof(Context), capacity);
+    u32 capacity = DD_CONTEXT_PAGE_SIZE * sizeof(ContextSlot);
+    ContextSlot *page =
+        (ContextSlot *)aligned_alloc(sizeof(ContextSlot), capacity);
     // need to zero the storage because there is no aligned_calloc
     memset(page, 0, capacity);
     if (!__sync_bool_compare_and_swap(&_pages[pageIndex], NULL, page)) {
@@ -70,8 +78,8 @@ void Contexts::initialize(int pageIndex) {
 
 void Contexts::reset() {
   for (int i = 0; i < _max_pages; i++) {
-    Context *page =
-        (Context *)__atomic_exchange_n(&_pages[i], NULL, __ATOMIC_SEQ_CST);
+    ContextSlot *page =
+        (ContextSlot *)__atomic_exchange_n(&_pages[i], NULL, __ATOMIC_SEQ_CST);
     free(page);
   }
 }
@@ -79,7 +87,7 @@ void Contexts::reset() {
 ContextPage Contexts::getPage(int tid) {
   int pageIndex = tid >> DD_CONTEXT_PAGE_SHIFT;
   initialize(pageIndex);
-  return {.capacity = DD_CONTEXT_PAGE_SIZE * sizeof(Context),
+  return {.capacity = DD_CONTEXT_PAGE_SIZE * sizeof(ContextSlot),
           .storage = _pages[pageIndex]};
 }
 
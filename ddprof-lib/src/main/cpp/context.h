@@ -31,10 +31,23 @@ class Context {
 public:
   u64 spanId;
   u64 rootSpanId;
-  u64 checksum;
   Tag tags[DD_TAGS_CAPACITY];
 
-  Tag get_tag(int i) { return tags[i]; }
+  Tag get_tag(int i) const { return tags[i]; }
+};
+
+// Per-thread context storage shared with JavaProfiler.java, which must be
+// kept in sync with this layout. The owning thread is the only writer: it
+// fills copies[(sequence + 1) & 1] and then publishes it by incrementing
+// sequence with a release store. The published copy is never written, so a
+// signal handler interrupting the writer on the same thread always reads a
+// consistent context; other threads retry if the sequence moved while they
+// were copying.
+class ContextSlot {
+public:
+  u64 sequence;
+  Context copies[2];
+  u64 padding;
 };
 
 // must be kept in sync with PAGE_SIZE in JavaProfiler.java
@@ -44,19 +57,19 @@ const int DD_CONTEXT_PAGE_SHIFT = __builtin_popcount(DD_CONTEXT_PAGE_MASK);
 
 typedef struct {
   const int capacity;
-  const Context *storage;
+  const ContextSlot *storage;
 } ContextPage;
 
 class Contexts {
 
 private:
   static int _max_pages;
-  static Context **_pages;
+  static ContextSlot **_pages;
   static void initialize(int pageIndex);
 
 public:
   // get must not allocate
-  static Context &get(int tid);
+  static Context get(int tid);
   static Context &empty();
   // not to be called except to share with Java callers as a DirectByteBuffer
   static ContextPage getPage(int tid);
@@ -16,10 +16,9 @@
 #include "counters.h"
 #include <stdlib.h>
 
-long long *Counters::init() {
-  u32 alignment = sizeof(long long) * ALIGNMENT;
-  long long *counters =
-      (long long *)aligned_alloc(alignment, DD_NUM_COUNTERS * alignment);
-  memset(counters, 0, DD_NUM_COUNTERS * alignment);
+volatile long long *Counters::init() {
+  size_t shards_size = SHARDS * SHARD_SIZE * sizeof(long long);
+  long long *counters = (long long *)aligned_alloc(128, shards_size);
+  memset(counters, 0, shards_size);
   return counters;
 }
@@ -18,6 +18,8 @@
 
 #include "arch_dd.h"
 #include <cstring>
+#include <pthread.h>
+#include <stdint.h>
 #include <vector>
 
 #define DD_COUNTER_TABLE(X)                                                    \
@@ -41,10 +43,11 @@
   X(CONTEXT_STORAGE_PAGES, "context_storage_pages")                            \
   X(CONTEXT_BOUNDS_MISS_INITS, "context_bounds_miss_inits")                    \
   X(CONTEXT_BOUNDS_MISS_GETS, "context_bounds_miss_gets")                      \
-  X(CONTEXT_CHECKSUM_REJECT_GETS, "context_checksum_reject_gets")              \
+  X(CONTEXT_TORN_GETS, "context_torn_gets")                                    \
   X(CONTEXT_NULL_PAGE_GETS, "context_null_page_gets")                          \
   X(CALLTRACE_STORAGE_BYTES, "calltrace_storage_bytes")                        \
   X(CALLTRACE_STORAGE_TRACES, "calltrace_storage_traces")                      \
+  X(CALLTRACE_STORAGE_NODES, "calltrace_storage_nodes")                        \
   X(LINEAR_ALLOCATOR_BYTES, "linear_allocator_bytes")                          \
   X(LINEAR_ALLOCATOR_CHUNKS, "linear_allocator_chunks")                        \
   X(THREAD_IDS_COUNT, "thread_ids_count")                                      \
@@ -61,7 +64,17 @@
   X(AGCT_BLOCKED_IN_VM, "agct_blocked_in_vm")                                  \
   X(SKIPPED_WALLCLOCK_UNWINDS, "skipped_wallclock_unwinds")                    \
   X(UNWINDING_TIME_ASYNC, "unwinding_ticks_async")                             \
-  X(UNWINDING_TIME_JVMTI, "unwinding_ticks_jvmti")
+  X(UNWINDING_TIME_JVMTI, "unwinding_ticks_jvmti")                             \
+  X(UNWINDING_TIME_VM, "unwinding_ticks_vm")                                   \
+  X(SYMBOL_CACHE_HITS, "symbol_cache_hits")                                    \
+  X(SYMBOL_CACHE_MISSES, "symbol_cache_misses")                                \
+  X(SYMBOL_CACHE_MISS_TICKS, "symbol_cache_miss_ticks")                        \
+  X(SYMBOL_CACHE_SAVED_TICKS, "symbol_cache_saved_ticks")                      \
+  X(UNWIND_SPLICE_HITS, "unwind_splice_hits")                                  \
+  X(UNWIND_SPLICE_MISSES, "unwind_splice_misses")                              \
+  X(UNWIND_SPLICED_FRAMES, "unwind_spliced_frames")                            \
+  X(AGGREGATE_DROPPED_SAMPLES, "aggregate_dropped_samples")                    \
+  X(PERCPU_FORWARD_FAILURES, "percpu_forward_failures")
 #define X_ENUM(a, b) a,
 typedef enum CounterId : int {
   DD_COUNTER_TABLE(X_ENUM) DD_NUM_COUNTERS
@@ -71,15 +84,35 @@ typedef enum CounterId : int {
 class Counters {
 private:
   static const u32 ALIGNMENT = 16;
-  volatile long long *_counters;
-  static long long *init();
-  Counters() : _counters() {
+  // Increments go to one of SHARDS copies of the counters, picked by thread,
+  // so that threads running on different cores do not keep stealing the same
+  // cache line from each other. Reads sum up the shards.
+  static const u32 SHARD_BITS = 6;
+  static const u32 SHARDS = 1 << SHARD_BITS;
+  // counters per shard, padded to keep the shards on separate cache lines
+  static const u32 SHARD_SIZE =
+      ((DD_NUM_COUNTERS * sizeof(long long) + 127) & ~127) / sizeof(long long);
+  volatile long long *_shards;
+  static volatile long long *init();
+  Counters() : _shards() {
 #ifdef COUNTERS
-    _counters = Counters::init();
+    _shards = Counters::init();
 #endif // COUNTERS
   }
 
+  static inline volatile long long &slot(u32 shard, int index) {
+    return Counters::instance()._shards[shard * SHARD_SIZE + index];
+  }
+
 public:
+  // The shard of the calling thread, also picked by the other per-thread
+  // striped statistics
+  static inline u32 shard() {
+    // pthread_self() is signal safe and does not need a system call
+    u64 self = (u64)(uintptr_t)pthread_self();
+    return (u32)((self * 0x9e3779b97f4a7c15ULL) >> (64 - SHARD_BITS));
+  }
+
   static Counters &instance() {
     static Counters instance;
     return instance;
@@ -94,18 +127,28 @@ public:
     return address(DD_NUM_COUNTERS * sizeof(long long));
   }
 
-  static long long *getCounters() {
+  // Sums up the shards into the given buffer of size() bytes, ALIGNMENT
+  // counters apart. Returns false if the counters are not compiled in.
+  static bool getCounters(long long *counters) {
 #ifdef COUNTERS
-    return const_cast<long long *>(Counters::instance()._counters);
+    memset(counters, 0, size());
+    for (int i = 0; i < DD_NUM_COUNTERS; i++) {
+      counters[address(i)] = getCounter(static_cast<CounterId>(i));
+    }
+    return true;
 #else
-    return nullptr;
+    return false;
 #endif // COUNTERS
   }
 
   static long long getCounter(CounterId counter, int offset = 0) {
 #ifdef COUNTERS
-    return Counters::instance()
-        ._counters[address(static_cast<int>(counter) + offset)];
+    int index = static_cast<int>(counter) + offset;
+    long long value = 0;
+    for (u32 i = 0; i < SHARDS; i++) {
+      value += slot(i, index);
+    }
+    return value;
 #else
     return 0;
 #endif // COUNTERS
@@ -113,18 +156,18 @@ public:
 
   static void set(CounterId counter, long long value, int offset = 0) {
 #ifdef COUNTERS
-    storeRelease(Counters::instance()
-                     ._counters[address(static_cast<int>(counter) + offset)],
-                 value);
+    int index = static_cast<int>(counter) + offset;
+    for (u32 i = 1; i < SHARDS; i++) {
+      storeRelease(slot(i, index), 0);
+    }
+    storeRelease(slot(0, index), value);
 #endif // COUNTERS
   }
 
   static void increment(CounterId counter, long long delta = 1,
                         int offset = 0) {
 #ifdef COUNTERS
-    atomicInc(Counters::instance()
-                  ._counters[address(static_cast<int>(counter) + offset)],
-              delta);
+    atomicInc(slot(shard(), static_cast<int>(counter) + offset), delta);
 #endif // COUNTERS
   }
 
@@ -147,7 +190,8 @@ public:
 
   static void reset() {
 #ifdef COUNTERS
-    memset((void *)Counters::instance()._counters, 0, size());
+    memset((void *)Counters::instance()._shards, 0,
+           SHARDS * SHARD_SIZE * sizeof(long long));
 #endif // COUNTERS
   }
 };
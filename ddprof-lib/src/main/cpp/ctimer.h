@@ -24,10 +24,28 @@
 #include "arch_dd.h"
 #include <signal.h>
 
+// Intercepts thread start and end in the JVM to call
+// Profiler::registerThread() and Profiler::unregisterThread(). Shared by the
+// engines which arm a timer for each thread.
+class ThreadHook {
+private:
+  static std::atomic<int> _users;
+
+public:
+  static bool supported();
+  static bool install();
+  static void uninstall();
+};
+
+// Creates a POSIX timer on the given clock, delivering the signal to the
+// thread with the given tid. Returns the kernel timer id, or -1.
+int createThreadTimer(clockid_t clock, int tid, int signo);
+
 class CTimer : public Engine {
 private:
   static std::atomic<bool> _enabled;
   static long _interval;
+  static long _configured_interval;
   static CStack _cstack;
   static int _signal;
 
@@ -47,6 +65,8 @@ public:
 
   long interval() const { return _interval; }
 
+  long setRateScale(double scale);
+
   Error check(Arguments &args);
   Error start(Arguments &args);
   void stop();
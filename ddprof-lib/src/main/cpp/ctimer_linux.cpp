@@ -17,6 +17,7 @@
 #ifdef __linux__
 
 #include "ctimer.h"
+#include "bursts.h"
 #include "debugSupport.h"
 #include "libraries.h"
 #include "profiler.h"
@@ -78,7 +79,59 @@ static void **lookupThreadEntry() {
   return lib != NULL ? lib->findImport(im_pthread_setspecific) : NULL;
 }
 
+std::atomic<int> ThreadHook::_users(0);
+
+bool ThreadHook::supported() {
+  return _pthread_entry != NULL ||
+         (_pthread_entry = lookupThreadEntry()) != NULL;
+}
+
+bool ThreadHook::install() {
+  if (!supported()) {
+    return false;
+  }
+  if (_users++ == 0) {
+    __atomic_store_n(_pthread_entry, (void *)pthread_setspecific_hook,
+                     __ATOMIC_RELEASE);
+  }
+  return true;
+}
+
+void ThreadHook::uninstall() {
+  int users = _users.load();
+  while (users > 0 && !_users.compare_exchange_weak(users, users - 1)) {
+  }
+  if (users == 1) {
+    __atomic_store_n(_pthread_entry, (void *)pthread_setspecific,
+                     __ATOMIC_RELEASE);
+  }
+}
+
+int createThreadTimer(clockid_t clock, int tid, int signo) {
+  struct sigevent sev;
+  sev.sigev_value.sival_ptr = NULL;
+  sev.sigev_signo = signo;
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  ((int *)&sev.sigev_notify)[1] = tid;
+
+  // Use raw syscalls, since libc wrapper allows only predefined clocks
+  int timer;
+  if (syscall(__NR_timer_create, clock, &sev, &timer) < 0) {
+    return -1;
+  }
+  return timer;
+}
+
+static void setTimerInterval(int timer, long interval) {
+  struct itimerspec ts;
+  ts.it_interval.tv_sec = (time_t)(interval / 1000000000);
+  ts.it_interval.tv_nsec = interval % 1000000000;
+  ts.it_value = ts.it_interval;
+  syscall(__NR_timer_settime, timer, 0, &ts, NULL);
+}
+
 long CTimer::_interval;
+long CTimer::_configured_interval;
 int CTimer::_max_timers = 0;
 int *CTimer::_timers = NULL;
 CStack CTimer::_cstack;
@@ -92,16 +145,8 @@ int CTimer::registerThread(int tid) {
     return -1;
   }
 
-  struct sigevent sev;
-  sev.sigev_value.sival_ptr = NULL;
-  sev.sigev_signo = _signal;
-  sev.sigev_notify = SIGEV_THREAD_ID;
-  ((int *)&sev.sigev_notify)[1] = tid;
-
-  // Use raw syscalls, since libc wrapper allows only predefined clocks
-  clockid_t clock = thread_cpu_clock(tid);
-  int timer;
-  if (syscall(__NR_timer_create, clock, &sev, &timer) < 0) {
+  int timer = createThreadTimer(thread_cpu_clock(tid), tid, _signal);
+  if (timer < 0) {
     return -1;
   }
 
@@ -112,11 +157,7 @@ int CTimer::registerThread(int tid) {
     return -1;
   }
 
-  struct itimerspec ts;
-  ts.it_interval.tv_sec = (time_t)(_interval / 1000000000);
-  ts.it_interval.tv_nsec = _interval % 1000000000;
-  ts.it_value = ts.it_interval;
-  syscall(__NR_timer_settime, timer, 0, &ts, NULL);
+  setTimerInterval(timer, _interval);
   return 0;
 }
 
@@ -134,8 +175,7 @@ void CTimer::unregisterThread(int tid) {
 }
 
 Error CTimer::check(Arguments &args) {
-  if (_pthread_entry == NULL &&
-      (_pthread_entry = lookupThreadEntry()) == NULL) {
+  if (!ThreadHook::supported()) {
     return Error("Could not set pthread hook");
   }
 
@@ -152,11 +192,7 @@ Error CTimer::start(Arguments &args) {
   if (args._interval < 0) {
     return Error("interval must be positive");
   }
-  if (_pthread_entry == NULL &&
-      (_pthread_entry = lookupThreadEntry()) == NULL) {
-    return Error("Could not set pthread hook");
-  }
-  _interval = args.cpuSamplerInterval();
+  _interval = _configured_interval = args.cpuSamplerInterval();
   _cstack = args._cstack;
   _signal = SIGPROF;
 
@@ -170,8 +206,9 @@ Error CTimer::start(Arguments &args) {
   OS::installSignalHandler(_signal, signalHandler);
 
   // Enable pthread hook before traversing currently running threads
-  __atomic_store_n(_pthread_entry, (void *)pthread_setspecific_hook,
-                   __ATOMIC_RELEASE);
+  if (!ThreadHook::install()) {
+    return Error("Could not set pthread hook");
+  }
 
   // Register all existing threads
   Error result = Error::OK;
@@ -188,13 +225,29 @@ Error CTimer::start(Arguments &args) {
 }
 
 void CTimer::stop() {
-  __atomic_store_n(_pthread_entry, (void *)pthread_setspecific,
-                   __ATOMIC_RELEASE);
+  ThreadHook::uninstall();
   for (int i = 0; i < _max_timers; i++) {
     unregisterThread(i);
   }
 }
 
+// Re-arms the timers of all registered threads, keeping the threads in a
+// burst faster. A thread registering concurrently may start with the previous
+// interval until the next change.
+long CTimer::setRateScale(double scale) {
+  long interval = (long)(_configured_interval * scale);
+  _interval = interval;
+
+  u64 now = OS::nanotime();
+  for (int tid = 0; tid < _max_timers; tid++) {
+    int timer = __atomic_load_n(&_timers[tid], __ATOMIC_ACQUIRE);
+    if (timer != 0) {
+      setTimerInterval(timer - 1, interval / Bursts::factor(tid, now));
+    }
+  }
+  return interval;
+}
+
 void CTimer::signalHandler(int signo, siginfo_t *siginfo, void *ucontext) {
   // Save the current errno value
   int saved_errno = errno;
@@ -213,6 +266,22 @@ void CTimer::signalHandler(int signo, siginfo_t *siginfo, void *ucontext) {
   }
   Shims::instance().setSighandlerTid(tid);
 
+  long interval = _interval;
+  // A thread notices it entered or left a burst on its next sample, and
+  // re-arms its own timer
+  if (current != NULL && tid < _max_timers &&
+      (Bursts::active() || current->cpuBurstFactor() > 1)) {
+    int factor = Bursts::factor(tid, OS::nanotime());
+    if (factor != current->cpuBurstFactor()) {
+      int timer = __atomic_load_n(&_timers[tid], __ATOMIC_ACQUIRE);
+      if (timer != 0) {
+        setTimerInterval(timer - 1, interval / factor);
+      }
+      current->setCpuBurstFactor(factor);
+    }
+    interval /= factor;
+  }
+
   ExecutionEvent event;
   VMThread *vm_thread = VMThread::current();
   if (vm_thread) {
@@ -220,7 +289,8 @@ void CTimer::signalHandler(int signo, siginfo_t *siginfo, void *ucontext) {
                                 ? convertJvmExecutionState(vm_thread->state())
                                 : ExecutionMode::JVM;
   }
-  Profiler::instance()->recordSample(ucontext, _interval, tid, BCI_CPU, 0,
+  event._sampling_interval = interval;
+  Profiler::instance()->recordSample(ucontext, interval, tid, BCI_CPU, 0,
                                      &event);
   Shims::instance().setSighandlerTid(-1);
   // we need to avoid spoiling the value of errno (tsan report)
@@ -45,12 +45,20 @@ protected:
 
 public:
   virtual const char *name() { return "None"; }
+  // What the sampling interval and the weights of the samples count
+  virtual const char *units() { return "ns"; }
 
   virtual Error check(Arguments &args);
   virtual Error start(Arguments &args);
   virtual void stop();
   virtual long interval() const { return 0L; }
 
+  // Lowers the sampling rate of a running engine to 1/scale of the configured
+  // one, a scale of 1 restores it. Returns the new value of the throttled
+  // setting, usually the interval, or -1 if the engine cannot change its rate
+  // while running.
+  virtual long setRateScale(double scale) { return -1; }
+
   virtual int registerThread(int tid) { return -1; }
   virtual void unregisterThread(int tid) {}
 
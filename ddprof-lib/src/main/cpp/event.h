@@ -18,6 +18,7 @@
 #define _EVENT_H
 
 #include "context.h"
+#include "hwCounters.h"
 #include "os.h"
 #include "threadState.h"
 #include <cstring>
@@ -40,10 +41,20 @@ public:
   ExecutionMode _execution_mode;
   u64 _weight;
   u32 _call_trace_id;
+  // deltas since the previous sample of the same thread; 0 if not collected
+  u64 _hw_counters[HW_COUNTER_COUNT];
+  // nanoseconds spent on a CPU and waiting on a run queue since the previous
+  // wall clock sample of the same thread; 0 if not collected
+  u64 _on_cpu_time;
+  u64 _run_queue_time;
+  // the time or events between two samples of this thread, in the units of
+  // the engine which took it; 0 if not known
+  u64 _sampling_interval;
 
   ExecutionEvent()
       : Event(), _thread_state(OSThreadState::RUNNABLE), _execution_mode(ExecutionMode::UNKNOWN),
-        _weight(1), _call_trace_id(0) {}
+        _weight(1), _call_trace_id(0), _hw_counters(), _on_cpu_time(0), _run_queue_time(0),
+        _sampling_interval(0) {}
 };
 
 class AllocEvent : public Event {
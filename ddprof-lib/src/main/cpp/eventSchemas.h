@@ -0,0 +1,42 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _EVENTSCHEMAS_H
+#define _EVENTSCHEMAS_H
+
+#include "eventWriter.h"
+#include "hwCounters.h"
+
+// The schemas of the events recorded for each sample
+typedef EventSchema<Var64Field, Var64Field, Var64Field, Var64Field, U8Field,
+                    U8Field, Var64Field, Var64Field,
+                    ArrayField<Var64Field, HW_COUNTER_COUNT>, ContextField>
+    ExecutionSampleSchema;
+typedef EventSchema<Var64Field, Var64Field, Var64Field, Var64Field, U8Field,
+                    U8Field, Var64Field, Var64Field, Var64Field, Var64Field,
+                    ContextField>
+    MethodSampleSchema;
+typedef EventSchema<Var64Field, Var64Field, Var64Field, Var64Field, Var64Field,
+                    Var64Field, FloatField, ContextField>
+    AllocationSchema;
+typedef EventSchema<Var64Field, Var64Field, Var64Field, Var64Field, Var64Field,
+                    Var64Field, U8Field, Var64Field, ContextField>
+    MonitorBlockedSchema;
+typedef EventSchema<Var64Field, Var64Field, Var64Field, Var64Field, Var64Field,
+                    Var64Field, Var64Field, Var64Field, Var64Field>
+    ThreadParkSchema;
+
+#endif // _EVENTSCHEMAS_H
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _EVENTWRITER_H
+#define _EVENTWRITER_H
+
+#include "arch_dd.h"
+#include "buffers.h"
+#include "context.h"
+
+// The encodings of the fields of an event, by their maximum size in bytes.
+// encode() writes a value at p and returns the position after it.
+struct U8Field {
+  enum { MAX_SIZE = 1 };
+
+  static char *encode(char *p, char v) {
+    *p = v;
+    return p + 1;
+  }
+};
+
+struct FloatField {
+  enum { MAX_SIZE = 4 };
+
+  static char *encode(char *p, float v) { return Buffer::encodeFloat(p, v); }
+};
+
+struct Var32Field {
+  enum { MAX_SIZE = 5 };
+
+  static char *encode(char *p, u32 v) { return Buffer::encodeVar32(p, v); }
+};
+
+// Buffer::encodeVar64 stops at 9 bytes
+struct Var64Field {
+  enum { MAX_SIZE = 9 };
+
+  static char *encode(char *p, u64 v) { return Buffer::encodeVar64(p, v); }
+};
+
+template <typename Field, int N> struct ArrayField {
+  enum { MAX_SIZE = N * Field::MAX_SIZE };
+
+  template <typename T> static char *encode(char *p, const T *values) {
+    for (int i = 0; i < N; i++) {
+      p = Field::encode(p, values[i]);
+    }
+    return p;
+  }
+};
+
+// The span ids and as many tags as the context can hold
+struct ContextField {
+  enum {
+    MAX_SIZE = 2 * Var64Field::MAX_SIZE + DD_TAGS_CAPACITY * Var32Field::MAX_SIZE
+  };
+
+  static char *encode(char *p, const Context &context, u32 num_attributes) {
+    assert(num_attributes <= DD_TAGS_CAPACITY);
+    p = Var64Field::encode(p, context.spanId);
+    p = Var64Field::encode(p, context.rootSpanId);
+    for (u32 i = 0; i < num_attributes; i++) {
+      p = Var32Field::encode(p, context.get_tag(i).value);
+    }
+    return p;
+  }
+};
+
+template <typename... Fields> struct FieldsSize;
+
+template <> struct FieldsSize<> {
+  enum { MAX_SIZE = 0 };
+};
+
+template <typename Field, typename... Fields>
+struct FieldsSize<Field, Fields...> {
+  enum { MAX_SIZE = Field::MAX_SIZE + FieldsSize<Fields...>::MAX_SIZE };
+};
+
+// The fields of an event type, after its size prefix. The prefix is a varint
+// padded to two bytes when the event may not fit in 127 bytes. MAX_SIZE is
+// the most bytes an event of this type takes, the size prefix included.
+template <typename... Fields> struct EventSchema {
+  enum {
+    PREFIX_SIZE = FieldsSize<Fields...>::MAX_SIZE + 1 < 0x80 ? 1 : 2,
+    MAX_SIZE = FieldsSize<Fields...>::MAX_SIZE + PREFIX_SIZE
+  };
+  static_assert(MAX_SIZE < 0x4000, "event too large for its size prefix");
+};
+
+// The fields of an event left to write. Each put() encodes the next field of
+// the schema and returns the writer of the ones after it, and only the writer
+// of a complete event can commit it: writes that do not follow the schema do
+// not compile.
+template <typename Schema, typename... Fields> class EventFields;
+
+template <typename Schema> class EventFields<Schema> {
+private:
+  Buffer *_buf;
+  char *_start;
+  char *_pos;
+
+public:
+  EventFields(Buffer *buf, char *start, char *pos)
+      : _buf(buf), _start(start), _pos(pos) {}
+
+  // Writes the size prefix and moves the buffer past the event
+  void commit() {
+    int size = (int)(_pos - _start);
+    assert(size <= Schema::MAX_SIZE);
+    if (Schema::PREFIX_SIZE == 1) {
+      _start[0] = (char)size;
+    } else {
+      _start[0] = (char)(size | 0x80);
+      _start[1] = (char)(size >> 7);
+    }
+    _buf->commit(_pos);
+  }
+};
+
+template <typename Schema, typename Field, typename... Fields>
+class EventFields<Schema, Field, Fields...> {
+private:
+  Buffer *_buf;
+  char *_start;
+  char *_pos;
+
+public:
+  EventFields(Buffer *buf, char *start, char *pos)
+      : _buf(buf), _start(start), _pos(pos) {}
+
+  template <typename... Args>
+  EventFields<Schema, Fields...> put(const Args &... args) {
+    return EventFields<Schema, Fields...>(_buf, _start,
+                                          Field::encode(_pos, args...));
+  }
+};
+
+template <typename Schema> class EventWriter;
+
+// Writes an event into room reserved once in the buffer for the largest
+// event of its schema. The fields are encoded through a raw pointer, without
+// checking the limit of the buffer for each of them.
+template <typename... Fields>
+class EventWriter<EventSchema<Fields...> >
+    : public EventFields<EventSchema<Fields...>, Fields...> {
+private:
+  typedef EventSchema<Fields...> Schema;
+
+  static EventFields<Schema, Fields...> begin(Buffer *buf) {
+    char *start = buf->reserve(Schema::MAX_SIZE);
+    return EventFields<Schema, Fields...>(buf, start,
+                                          start + Schema::PREFIX_SIZE);
+  }
+
+public:
+  explicit EventWriter(Buffer *buf)
+      : EventFields<Schema, Fields...>(begin(buf)) {}
+};
+
+#endif // _EVENTWRITER_H
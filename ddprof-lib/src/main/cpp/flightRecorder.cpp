@@ -9,12 +9,15 @@
 #include "context.h"
 #include "counters.h"
 #include "dictionary.h"
+#include "eventSchemas.h"
 #include "flightRecorder.h"
 #include "incbin.h"
 #include "jfrMetadata.h"
 #include "jniHelper.h"
 #include "jvm.h"
+#include "latencyHistogram.h"
 #include "os.h"
+#include "pprof.h"
 #include "profiler.h"
 #include "rustDemangler.h"
 #include "spinLock.h"
@@ -24,6 +27,7 @@
 #include "threadState.h"
 #include "tsc.h"
 #include "vmStructs_dd.h"
+#include <algorithm>
 #include <arpa/inet.h>
 #include <cxxabi.h>
 #include <errno.h>
@@ -43,6 +47,20 @@ static SpinLock _rec_lock(1);
 static const char *const SETTING_RING[] = {NULL, "kernel", "user", "any"};
 static const char *const SETTING_CSTACK[] = {NULL, "no", "fp", "dwarf", "lbr"};
 
+// indexed by OSThreadState
+static const int THREAD_STATE_COUNT = 10;
+static const char *const THREAD_STATE_NAMES[THREAD_STATE_COUNT] = {
+    "UNKNOWN", "NEW",        "RUNNABLE", "CONTENDED",  "PARKED",
+    "WAITING", "BREAKPOINT", "SLEEPING", "TERMINATED", "SYSCALL"};
+
+// A ring recording is cut into this many chunks over the period it covers
+static const int RING_CHUNKS = 8;
+
+// Distinct aggregation keys kept per chunk; samples with a key beyond that
+// are recorded on their own, or by trace and state in a pprof profile
+static const u32 AGGREGATE_CAPACITY = 16384;
+static const u32 AGGREGATE_OVERFLOW_CAPACITY = 4096;
+
 static void deallocateLineNumberTable(void *ptr) {}
 
 SharedLineNumberTable::~SharedLineNumberTable() {
@@ -292,6 +310,43 @@ MethodInfo *Lookup::resolveMethod(ASGCT_CallFrame &frame) {
   return mi;
 }
 
+const char *Lookup::resolveNativePC(const void *pc) {
+  std::unordered_map<const void *, const char *>::const_iterator it =
+      _native_pcs.find(pc);
+  if (it != _native_pcs.end()) {
+    return it->second;
+  }
+  const char *name = Profiler::instance()->findNativeMethod(pc);
+  _native_pcs[pc] = name;
+  return name;
+}
+
+// Resolves the native frames recorded as raw PCs. As in
+// Profiler::convertNativeTrace, native frames are cut at the first C++
+// interpreter frame while the Java frames which follow are kept.
+int Lookup::resolveNativeFrames(const ASGCT_CallFrame *frames, int num_frames,
+                                std::vector<ASGCT_CallFrame> &resolved) {
+  resolved.clear();
+  bool interpreter_reached = false;
+  for (int i = 0; i < num_frames; i++) {
+    ASGCT_CallFrame frame = frames[i];
+    if (frame.bci == BCI_NATIVE_PC) {
+      if (interpreter_reached) {
+        continue;
+      }
+      const char *name = resolveNativePC((const void *)frame.method_id);
+      if (name != NULL && NativeFunc::isMarked(name)) {
+        interpreter_reached = true;
+        continue;
+      }
+      frame.bci = BCI_NATIVE_FRAME;
+      frame.method_id = (jmethodID)name;
+    }
+    resolved.push_back(frame);
+  }
+  return resolved.size();
+}
+
 u32 Lookup::getPackage(const char *class_name) {
   const char *package = strrchr(class_name, '/');
   if (package == NULL) {
@@ -312,10 +367,34 @@ u32 Lookup::getPackage(const char *class_name) {
 
 u32 Lookup::getSymbol(const char *name) { return _symbols.lookup(name); }
 
+// The frames of the trace, rebuilt from the frame trie and with the native PCs
+// resolved to symbols if needed
+static int traceFrames(CallTrace *trace, Lookup *lookup,
+                       std::vector<ASGCT_CallFrame> &trie_frames,
+                       std::vector<ASGCT_CallFrame> &resolved_frames,
+                       ASGCT_CallFrame **frames) {
+  *frames = trace->frames;
+  if (trace->leaf != NULL) {
+    trie_frames.clear();
+    for (FrameNode *node = trace->leaf; node != NULL; node = node->parent) {
+      trie_frames.push_back(node->frame);
+    }
+    *frames = trie_frames.data();
+  }
+  int num_frames = trace->num_frames;
+  if (num_frames > 0 && (*frames)[0].bci == BCI_NATIVE_PC) {
+    num_frames =
+        lookup->resolveNativeFrames(*frames, num_frames, resolved_frames);
+    *frames = resolved_frames.data();
+  }
+  return num_frames;
+}
+
 char *Recording::_agent_properties = NULL;
 char *Recording::_jvm_args = NULL;
 char *Recording::_jvm_flags = NULL;
 char *Recording::_java_command = NULL;
+std::string Recording::_metadata_body;
 
 Recording::Recording(int fd, Arguments &args)
     : _fd(fd), _thread_set(), _method_map() {
@@ -332,36 +411,38 @@ Recording::Recording(int fd, Arguments &args)
   _tid = OS::threadId();
   VM::jvmti()->GetAvailableProcessors(&_available_processors);
 
+  _ring_duration = (u64)args._ring_duration * 1000000;
+  _ring_size = args._ring_size;
+  _aggregator = args._aggregate || isPprof()
+                    ? new SampleAggregator(AGGREGATE_CAPACITY)
+                    : NULL;
+  _overflow_aggregator =
+      isPprof() ? new SampleAggregator(AGGREGATE_OVERFLOW_CAPACITY) : NULL;
+
   writeHeader(_buf);
   writeMetadata(_buf);
-  writeSettings(_buf, args);
-  if (!args.hasOption(NO_SYSTEM_INFO)) {
-    writeOsCpuInfo(_buf);
-    writeJvmInfo(_buf);
-  }
-  if (!args.hasOption(NO_SYSTEM_PROPS)) {
-    writeSystemProperties(_buf);
-  }
-  if (!args.hasOption(NO_NATIVE_LIBS)) {
-    _recorded_lib_count = 0;
-    writeNativeLibraries(_buf);
-  } else {
-    _recorded_lib_count = -1;
-  }
+  writeInfoEvents(_buf);
   flush(_buf);
 
-  _cpu_monitor_enabled = !args.hasOption(NO_CPU_LOAD);
+  _cpu_monitor_enabled = args._cpu_load && !args.hasOption(NO_CPU_LOAD);
   if (_cpu_monitor_enabled) {
     _last_times.proc.real =
         OS::getProcessCpuTime(&_last_times.proc.user, &_last_times.proc.system);
     _last_times.total.real =
         OS::getTotalCpuTime(&_last_times.total.user, &_last_times.total.system);
+    if (_cgroup_monitor.open() && !_cgroup_monitor.read(&_last_cgroup_stat)) {
+      _cgroup_monitor.close();
+    }
   }
 }
 
 Recording::~Recording() {
-  finishChunk(true);
+  if (!isPprof()) {
+    finishChunk(true);
+  }
   close(_fd);
+  delete _aggregator;
+  delete _overflow_aggregator;
 }
 
 void Recording::copyTo(int target_fd) {
@@ -371,6 +452,7 @@ void Recording::copyTo(int target_fd) {
 off_t Recording::finishChunk() { return finishChunk(false); }
 
 off_t Recording::finishChunk(bool end_recording) {
+  u64 finish_start = TSC::ticks();
   jvmtiEnv *jvmti = VM::jvmti();
   JNIEnv *env = VM::jni();
 
@@ -424,11 +506,18 @@ off_t Recording::finishChunk(bool end_recording) {
   // information for now.
   writeCounters(_buf);
 
+  // the latencies of the finishChunk stage are the ones of the previous chunks
+  writeLatencies(_buf);
+
   // Keep a simple stats for where we failed to unwind
   // For the sakes of simplicity we are not keeping the count of failed unwinds which would also be
   // just 'eventually consistent' because we do not want to block the unwinding while writing out the stats.
   writeUnwindFailures(_buf);
 
+  if (_aggregator != NULL && !isPprof()) {
+    writeSampleAggregates(_buf);
+  }
+
   for (int i = 0; i < CONCURRENCY_LEVEL; i++) {
     flush(&_buf[i]);
   }
@@ -465,7 +554,9 @@ off_t Recording::finishChunk(bool end_recording) {
   result = pwrite(_fd, _buf->data(), 56, _chunk_start + 8);
   (void)result;
 
-  OS::freePageCache(_fd, _chunk_start);
+  if (!isRing()) {
+    OS::freePageCache(_fd, _chunk_start);
+  }
 
   _buf->reset();
 
@@ -477,17 +568,24 @@ off_t Recording::finishChunk(bool end_recording) {
     // deallocate the class array
     jvmti->Deallocate((unsigned char *)classes);
   }
+  Latencies::record(LATENCY_FINISH_CHUNK, TSC::ticks() - finish_start);
   return chunk_end;
 }
 
 void Recording::switchChunk(int fd) {
   _chunk_start = finishChunk(fd > -1);
-  _start_time = _stop_time;
-  _start_ticks = _stop_ticks;
-  _bytes_written = 0;
   if (fd > -1) {
     // move the chunk to external file and reset the continuous recording file
     OS::copyFile(_fd, fd, 0, _chunk_start);
+  }
+  startChunk(fd > -1);
+}
+
+void Recording::startChunk(bool reset_file) {
+  _start_time = _stop_time;
+  _start_ticks = _stop_ticks;
+  _bytes_written = 0;
+  if (reset_file) {
     OS::truncateFile(_fd);
     // need to reset the file offset here
     _chunk_start = 0;
@@ -499,25 +597,224 @@ void Recording::switchChunk(int fd) {
 
   writeHeader(_buf);
   writeMetadata(_buf);
-  if (fd > -1) {
+  if (reset_file || isRing()) {
     // if the recording file is to be restarted write out all the info events
-    // again
-    writeSettings(_buf, _args);
-    if (!_args.hasOption(NO_SYSTEM_INFO)) {
-      writeOsCpuInfo(_buf);
-      writeJvmInfo(_buf);
+    // again; the first chunks of a ring do not stay around
+    writeInfoEvents(_buf);
+  }
+  flush(_buf);
+}
+
+void Recording::writeInfoEvents(Buffer *buf) {
+  writeSettings(buf, _args);
+  if (!_args.hasOption(NO_SYSTEM_INFO)) {
+    writeOsCpuInfo(buf);
+    writeJvmInfo(buf);
+  }
+  if (!_args.hasOption(NO_SYSTEM_PROPS)) {
+    writeSystemProperties(buf);
+  }
+  if (!_args.hasOption(NO_NATIVE_LIBS)) {
+    _recorded_lib_count = 0;
+    writeNativeLibraries(buf);
+  } else {
+    _recorded_lib_count = -1;
+  }
+}
+
+bool Recording::ringRotationDue() {
+  return isRing() &&
+         (OS::micros() - _start_time >= _ring_duration / RING_CHUNKS ||
+          _bytes_written >= _ring_size / RING_CHUNKS);
+}
+
+// Cuts the current chunk and drops the chunks which ended before the period
+// covered by the ring or which do not fit in its size. The newest chunk is
+// kept regardless, so that it can be dumped.
+void Recording::rotateRing() {
+  off_t start = _chunk_start;
+  switchChunk(-1);
+  RingChunk chunk = {start, _chunk_start, _start_time};
+  _ring_chunks.push_back(chunk);
+
+  off_t end = lseek(_fd, 0, SEEK_CUR);
+  size_t drop = 0;
+  while (drop + 1 < _ring_chunks.size() &&
+         (_ring_chunks[drop].end_time + _ring_duration < _start_time ||
+          end - _ring_chunks[drop].start > _ring_size)) {
+    drop++;
+  }
+  if (drop > 0) {
+    off_t from = _ring_chunks[0].start;
+    OS::punchHole(_fd, from, _ring_chunks[drop].start - from);
+    _ring_chunks.erase(_ring_chunks.begin(), _ring_chunks.begin() + drop);
+  }
+}
+
+void Recording::dumpRing(int fd) {
+  rotateRing();
+  off_t start = _ring_chunks.front().start;
+  OS::copyFile(_fd, fd, start, _ring_chunks.back().end - start);
+}
+
+// Writes the CPU and wall clock samples aggregated since the last chunk as a
+// pprof profile. The method ids of the recording are used as function ids and
+// each distinct method and line gets a location.
+void Recording::writeProfile(int fd) {
+  CallTraceList traces;
+  Profiler::instance()->collectCallTraces(traces);
+  std::vector<ASGCT_CallFrame> trie_frames;
+  std::vector<ASGCT_CallFrame> resolved_frames;
+  // the location ids by method and line, and the location ids of each trace,
+  // which are shared by its samples
+  std::unordered_map<u64, u64> locations;
+  std::unordered_map<u32, std::pair<size_t, int> > trace_locations;
+  std::vector<u64> location_ids;
+
+  Lookup lookup(this, &_method_map, Profiler::instance()->classMap());
+  PprofWriter writer(fd);
+  // the weights of perf events other than the clocks count occurrences
+  Engine *cpu_engine = Profiler::instance()->cpuEngine();
+  bool cpu_time = strcmp(cpu_engine->units(), "ns") == 0;
+  const char *cpu_type = cpu_time ? "cpu-time" : "cpu-events";
+  const char *cpu_unit = cpu_time ? "nanoseconds" : "count";
+  writer.sampleType("cpu-samples", "count");
+  writer.sampleType(cpu_type, cpu_unit);
+  writer.sampleType("wall-samples", "count");
+  writer.sampleType("wall-time", "nanoseconds");
+  writer.periodType(cpu_type, cpu_unit);
+  writer.period(cpu_engine->interval());
+  writer.timeNanos(_start_time * 1000);
+  writer.durationNanos((OS::micros() - _start_time) * 1000);
+
+  u64 state_key = writer.string("thread state");
+  u64 span_key = writer.string("span id");
+  u64 root_span_key = writer.string("local root span id");
+  u64 state_names[THREAD_STATE_COUNT];
+  for (int i = 0; i < THREAD_STATE_COUNT; i++) {
+    state_names[i] = writer.string(THREAD_STATE_NAMES[i]);
+  }
+
+  auto write_sample = [&](const SampleAggregator::Entry &entry) {
+    const SampleKey &key = entry.key;
+    std::unordered_map<u32, std::pair<size_t, int> >::iterator trace_location =
+        trace_locations.find(key.call_trace_id);
+    if (trace_location == trace_locations.end()) {
+      size_t start = location_ids.size();
+      // the traces are sorted by id
+      CallTraceList::const_iterator trace = std::lower_bound(
+          traces.begin(), traces.end(),
+          std::make_pair(key.call_trace_id, (CallTrace *)NULL));
+      if (trace != traces.end() && trace->first == key.call_trace_id) {
+        ASGCT_CallFrame *frames;
+        int num_frames = traceFrames(trace->second, &lookup, trie_frames,
+                                     resolved_frames, &frames);
+        for (int i = 0; i < num_frames; i++) {
+          MethodInfo *mi = lookup.resolveMethod(frames[i]);
+          u32 line = 0;
+          if (mi->_type < FRAME_NATIVE) {
+            jint bci = frames[i].bci;
+            line = mi->getLineNumber((bci & 0x10000) ? 0 : (bci & 0xffff));
+          }
+          u64 location_key = (u64)mi->_key << 32 | line;
+          std::unordered_map<u64, u64>::const_iterator location =
+              locations.find(location_key);
+          u64 id;
+          if (location != locations.end()) {
+            id = location->second;
+          } else {
+            id = locations.size() + 1;
+            locations[location_key] = id;
+            writer.location(id, mi->_key, line);
+          }
+          location_ids.push_back(id);
+        }
+      }
+      trace_location =
+          trace_locations
+              .insert(std::make_pair(
+                  key.call_trace_id,
+                  std::make_pair(start, (int)(location_ids.size() - start))))
+              .first;
     }
-    if (!_args.hasOption(NO_SYSTEM_PROPS)) {
-      writeSystemProperties(_buf);
+
+    // time for the clocks, occurrences for the other perf events
+    u64 time = entry.weight * key.sampling_interval;
+    u64 values[4] = {0, 0, 0, 0};
+    values[key.wall ? 2 : 0] = entry.samples;
+    values[key.wall ? 3 : 1] = time;
+    PprofLabel labels[3];
+    int num_labels = 0;
+    if (key.thread_state < THREAD_STATE_COUNT) {
+      labels[num_labels++] = {state_key, state_names[key.thread_state], 0};
     }
-    if (!_args.hasOption(NO_NATIVE_LIBS)) {
-      _recorded_lib_count = 0;
-      writeNativeLibraries(_buf);
-    } else {
-      _recorded_lib_count = -1;
+    if (key.context.spanId != 0) {
+      labels[num_labels++] = {span_key, 0, key.context.spanId};
+      labels[num_labels++] = {root_span_key, 0, key.context.rootSpanId};
+    }
+    writer.sample(location_ids.data() + trace_location->second.first,
+                  trace_location->second.second, values, 4, labels, num_labels);
+  };
+  _aggregator->drain(write_sample);
+  _overflow_aggregator->drain(write_sample);
+
+  std::map<u32, const char *> classes;
+  std::map<u32, const char *> symbols;
+  // no need to lock _classes as this code will never run concurrently with
+  // resetting that dictionary
+  lookup._classes->collect(classes);
+  lookup._symbols.collect(symbols);
+  std::string name;
+  for (MethodMap::iterator it = _method_map.begin(); it != _method_map.end();
+       ++it) {
+    MethodInfo &mi = it->second;
+    if (mi._mark) {
+      mi._mark = false;
+      // Java methods are named after their class, with dots as in the sources
+      std::map<u32, const char *>::const_iterator cls = classes.find(mi._class);
+      name = cls != classes.end() ? cls->second : "";
+      if (!name.empty()) {
+        std::replace(name.begin(), name.end(), '/', '.');
+        name += '.';
+      }
+      std::map<u32, const char *>::const_iterator symbol =
+          symbols.find(mi._name);
+      if (symbol != symbols.end()) {
+        name += symbol->second;
+      }
+      writer.function(mi._key, writer.string(name.data(), name.size()));
     }
   }
-  flush(_buf);
+  writer.finish();
+}
+
+void Recording::dumpProfile(int fd) {
+  writeProfile(fd);
+  discardChunk();
+}
+
+// The other events of the working file of a pprof recording are not part of
+// the profile. They are dropped rather than finished as a chunk, which would
+// collect the call traces a second time and build a constant pool only to
+// throw it away.
+void Recording::discardChunk() {
+  for (int i = 0; i < CONCURRENCY_LEVEL; i++) {
+    _buf[i].reset();
+  }
+  _cpu_monitor_buf.reset();
+
+  // the statistics written with each chunk start over as well
+  u64 buckets[LatencyHistogram::BUCKETS];
+  u64 sum, max;
+  for (int i = 0; i < DD_NUM_LATENCIES; i++) {
+    Latencies::get(static_cast<LatencyId>(i)).drain(buckets, &sum, &max);
+  }
+  UnwindFailures failures;
+  UnwindStats::collectAndReset(failures);
+
+  _stop_time = OS::micros();
+  _stop_ticks = TSC::ticks();
+  startChunk(true);
 }
 
 void Recording::cpuMonitorCycle() {
@@ -551,6 +848,14 @@ void Recording::cpuMonitorCycle() {
   }
 
   recordCpuLoad(&_cpu_monitor_buf, proc_user, proc_system, machine_total);
+
+  // inside a container /proc/stat describes the host, the cgroup tells how
+  // much of its quota the process used and how long it was throttled
+  CgroupCpuStat cgroup_stat;
+  if (_cgroup_monitor.enabled() && _cgroup_monitor.read(&cgroup_stat)) {
+    recordCgroupCpu(&_cpu_monitor_buf, &cgroup_stat, &_last_cgroup_stat);
+    _last_cgroup_stat = cgroup_stat;
+  }
   flushIfNeeded(&_cpu_monitor_buf, BUFFER_LIMIT);
 
   _last_times = times;
@@ -638,9 +943,32 @@ void Recording::flushIfNeeded(Buffer *buf, int limit) {
 }
 
 void Recording::writeMetadata(Buffer *buf) {
+  const std::string &body = metadataBody();
   int metadata_start = buf->skip(5); // size will be patched later
   buf->putVar64(T_METADATA);
   buf->putVar64(_start_ticks);
+  buf->putVar32(metadata_start, buf->offset() - metadata_start + body.size());
+
+  if (buf->offset() + body.size() < (size_t)buf->limit()) {
+    buf->put(body.data(), body.size());
+  } else {
+    flush(buf);
+    ssize_t result = write(_fd, body.data(), body.size());
+    if (result > 0) {
+      atomicInc(_bytes_written, result);
+    }
+  }
+  flushIfNeeded(buf);
+}
+
+// The metadata does not change once JfrMetadata is initialized, before the
+// first recording, so it is encoded for the first chunk only. Recordings are
+// not created or switched concurrently.
+const std::string &Recording::metadataBody() {
+  if (!_metadata_body.empty()) {
+    return _metadata_body;
+  }
+  RecordingBuffer *buf = new RecordingBuffer();
   buf->put8(0);
   buf->put8(1);
 
@@ -649,14 +977,17 @@ void Recording::writeMetadata(Buffer *buf) {
   for (int i = 0; i < strings.size(); i++) {
     const char *string = strings[i].c_str();
     int length = strlen(string);
-    flushIfNeeded(buf, RECORDING_BUFFER_LIMIT - length);
+    if (buf->offset() >= RECORDING_BUFFER_LIMIT - length) {
+      _metadata_body.append(buf->data(), buf->offset());
+      buf->reset();
+    }
     buf->putUtf8(string, length);
   }
 
-  writeElement(buf, JfrMetadata::root());
-
-  buf->putVar32(metadata_start, buf->offset() - metadata_start);
-  flushIfNeeded(buf);
+  writeElement(buf, JfrMetadata::root(), _metadata_body);
+  _metadata_body.append(buf->data(), buf->offset());
+  delete buf;
+  return _metadata_body;
 }
 
 void Recording::writeHeader(Buffer *buf) {
@@ -676,22 +1007,28 @@ void Recording::writeHeader(Buffer *buf) {
   flushIfNeeded(buf);
 }
 
-void Recording::writeElement(Buffer *buf, const Element *e) {
+void Recording::writeElement(Buffer *buf, const Element *e,
+                             std::string &out) {
   buf->putVar64(e->_name);
 
   buf->putVar64(e->_attributes.size());
   for (int i = 0; i < e->_attributes.size(); i++) {
-    flushIfNeeded(buf);
+    if (buf->offset() >= RECORDING_BUFFER_LIMIT) {
+      out.append(buf->data(), buf->offset());
+      buf->reset();
+    }
     buf->putVar64(e->_attributes[i]._key);
     buf->putVar64(e->_attributes[i]._value);
   }
 
   buf->putVar64(e->_children.size());
   for (int i = 0; i < e->_children.size(); i++) {
-    flushIfNeeded(buf);
-    writeElement(buf, e->_children[i]);
+    if (buf->offset() >= RECORDING_BUFFER_LIMIT) {
+      out.append(buf->data(), buf->offset());
+      buf->reset();
+    }
+    writeElement(buf, e->_children[i], out);
   }
-  flushIfNeeded(buf);
 }
 
 void Recording::writeRecordingInfo(Buffer *buf) {
@@ -755,6 +1092,7 @@ void Recording::writeSettings(Buffer *buf, Arguments &args) {
                      Profiler::instance()->wallEngine()->name());
   writeStringSetting(buf, T_ACTIVE_RECORDING, "cstack",
                      Profiler::instance()->cstack());
+  writeBoolSetting(buf, T_ACTIVE_RECORDING, "aggregate", args._aggregate);
   flushIfNeeded(buf);
 }
 
@@ -797,11 +1135,12 @@ void Recording::writeListSetting(Buffer *buf, int category, const char *key,
 }
 
 void Recording::writeDatadogSetting(Buffer *buf, int length, const char *name,
-                                    const char *value, const char *unit) {
+                                    const char *value, const char *unit,
+                                    u64 ticks) {
   flushIfNeeded(buf, RECORDING_BUFFER_LIMIT - length);
   int start = buf->skip(MAX_VAR32_LENGTH);
   buf->putVar64(T_DATADOG_SETTING);
-  buf->putVar64(_start_ticks);
+  buf->putVar64(ticks != 0 ? ticks : _start_ticks);
   buf->put8(0); // no duration, but required for compatibility with equivalent
                 // Java event
   buf->putVar32(_tid);
@@ -1016,27 +1355,11 @@ void Recording::writeFrameTypes(Buffer *buf) {
 
 void Recording::writeThreadStates(Buffer *buf) {
   buf->putVar64(T_THREAD_STATE);
-  buf->put8(10);
-  buf->put8(static_cast<int>(OSThreadState::UNKNOWN));
-  buf->putUtf8("UNKNOWN");
-  buf->put8(static_cast<int>(OSThreadState::NEW));
-  buf->putUtf8("NEW");
-  buf->put8(static_cast<int>(OSThreadState::RUNNABLE));
-  buf->putUtf8("RUNNABLE");
-  buf->put8(static_cast<int>(OSThreadState::MONITOR_WAIT));
-  buf->putUtf8("CONTENDED");
-  buf->put8(static_cast<int>(OSThreadState::CONDVAR_WAIT));
-  buf->putUtf8("PARKED");
-  buf->put8(static_cast<int>(OSThreadState::OBJECT_WAIT));
-  buf->putUtf8("WAITING");
-  buf->put8(static_cast<int>(OSThreadState::BREAKPOINTED));
-  buf->putUtf8("BREAKPOINT");
-  buf->put8(static_cast<int>(OSThreadState::SLEEPING));
-  buf->putUtf8("SLEEPING");
-  buf->put8(static_cast<int>(OSThreadState::TERMINATED));
-  buf->putUtf8("TERMINATED");
-  buf->put8(static_cast<int>(OSThreadState::SYSCALL));
-  buf->putUtf8("SYSCALL");
+  buf->put8(THREAD_STATE_COUNT);
+  for (int i = 0; i < THREAD_STATE_COUNT; i++) {
+    buf->put8(i);
+    buf->putUtf8(THREAD_STATE_NAMES[i]);
+  }
   flushIfNeeded(buf);
 }
 
@@ -1104,29 +1427,33 @@ void Recording::writeThreads(Buffer *buf) {
 }
 
 void Recording::writeStackTraces(Buffer *buf, Lookup *lookup) {
-  std::map<u32, CallTrace *> traces;
+  CallTraceList traces;
   Profiler::instance()->collectCallTraces(traces);
+  std::vector<ASGCT_CallFrame> trie_frames;
+  std::vector<ASGCT_CallFrame> resolved_frames;
 
   buf->putVar64(T_STACK_TRACE);
   buf->putVar64(traces.size());
-  for (std::map<u32, CallTrace *>::const_iterator it = traces.begin();
-       it != traces.end(); ++it) {
+  for (CallTraceList::const_iterator it = traces.begin(); it != traces.end();
+       ++it) {
     CallTrace *trace = it->second;
+    ASGCT_CallFrame *frames;
+    int num_frames =
+        traceFrames(trace, lookup, trie_frames, resolved_frames, &frames);
     buf->putVar64(it->first);
-    if (trace->num_frames > 0) {
-      MethodInfo *mi =
-          lookup->resolveMethod(trace->frames[trace->num_frames - 1]);
+    if (num_frames > 0) {
+      MethodInfo *mi = lookup->resolveMethod(frames[num_frames - 1]);
       if (mi->_type < FRAME_NATIVE) {
         buf->put8(mi->_is_entry ? 0 : 1);
       } else {
         buf->put8(trace->truncated);
       }
     }
-    buf->putVar64(trace->num_frames);
-    for (int i = 0; i < trace->num_frames; i++) {
-      MethodInfo *mi = lookup->resolveMethod(trace->frames[i]);
+    buf->putVar64(num_frames);
+    for (int i = 0; i < num_frames; i++) {
+      MethodInfo *mi = lookup->resolveMethod(frames[i]);
       buf->putVar64(mi->_key);
-      jint bci = trace->frames[i].bci;
+      jint bci = frames[i].bci;
       if (mi->_type < FRAME_NATIVE) {
         FrameTypeId type = FrameType::decode(bci);
         bci = (bci & 0x10000) ? 0 : (bci & 0xffff);
@@ -1240,8 +1567,8 @@ void Recording::writeLogLevels(Buffer *buf) {
 }
 
 void Recording::writeCounters(Buffer *buf) {
-  long long *counters = Counters::getCounters();
-  if (counters) {
+  std::vector<long long> counters(Counters::size() / sizeof(long long));
+  if (Counters::getCounters(counters.data())) {
     std::vector<const char *> names = Counters::describeCounters();
     for (int i = 0; i < names.size(); i++) {
       int start = buf->skip(1);
@@ -1255,6 +1582,31 @@ void Recording::writeCounters(Buffer *buf) {
   }
 }
 
+void Recording::writeLatencies(Buffer *buf) {
+  u64 buckets[LatencyHistogram::BUCKETS];
+  for (int i = 0; i < DD_NUM_LATENCIES; i++) {
+    LatencyId id = static_cast<LatencyId>(i);
+    u64 sum, max;
+    u64 count = Latencies::get(id).drain(buckets, &sum, &max);
+    if (count == 0) {
+      continue;
+    }
+    int start = buf->skip(1);
+    buf->putVar64(T_PROFILER_LATENCY);
+    buf->putVar64(_start_ticks);
+    buf->putUtf8(Latencies::name(id));
+    buf->putVar64(count);
+    buf->putVar64(sum / count);
+    buf->putVar64(LatencyHistogram::percentile(buckets, count, 0.5));
+    buf->putVar64(LatencyHistogram::percentile(buckets, count, 0.9));
+    buf->putVar64(LatencyHistogram::percentile(buckets, count, 0.99));
+    buf->putVar64(LatencyHistogram::percentile(buckets, count, 0.999));
+    buf->putVar64(max);
+    writeEventSizePrefix(buf, start);
+    flushIfNeeded(buf);
+  }
+}
+
 void Recording::writeUnwindFailures(Buffer *buf) {
   static UnwindFailures failures;
   UnwindStats::collectAndReset(failures);
@@ -1271,7 +1623,28 @@ void Recording::writeUnwindFailures(Buffer *buf) {
   });
 }
 
-void Recording::writeContext(Buffer *buf, Context &context) {
+// One event for each key, spanning the whole chunk
+void Recording::writeSampleAggregates(Buffer *buf) {
+  _aggregator->drain([&](const SampleAggregator::Entry &entry) {
+    const SampleKey &key = entry.key;
+    int start = buf->skip(1);
+    buf->putVar64(key.wall ? T_METHOD_SAMPLE_AGGREGATE
+                           : T_EXECUTION_SAMPLE_AGGREGATE);
+    buf->putVar64(_start_ticks);
+    buf->putVar64(_stop_ticks - _start_ticks);
+    buf->putVar64(key.call_trace_id);
+    buf->put8(key.thread_state);
+    buf->put8(key.execution_mode);
+    buf->putVar64(entry.samples);
+    buf->putVar64(entry.weight);
+    buf->putVar64(key.sampling_interval);
+    writeContext(buf, key.context);
+    writeEventSizePrefix(buf, start);
+    flushIfNeeded(buf);
+  });
+}
+
+void Recording::writeContext(Buffer *buf, const Context &context) {
   buf->putVar64(context.spanId);
   buf->putVar64(context.rootSpanId);
   for (size_t i = 0; i < Profiler::instance()->numContextAttributes(); i++) {
@@ -1288,34 +1661,66 @@ void Recording::writeEventSizePrefix(Buffer *buf, int start) {
 
 void Recording::recordExecutionSample(Buffer *buf, int tid, u32 call_trace_id,
                                       ExecutionEvent *event) {
-  int start = buf->skip(1);
-  buf->putVar64(T_EXECUTION_SAMPLE);
-  buf->putVar64(TSC::ticks());
-  buf->putVar64(tid);
-  buf->putVar64(call_trace_id);
-  buf->put8(static_cast<int>(event->_thread_state));
-  buf->put8(static_cast<int>(event->_execution_mode));
-  buf->putVar64(event->_weight);
-  writeContext(buf, Contexts::get(tid));
-  writeEventSizePrefix(buf, start);
+  EventWriter<ExecutionSampleSchema>(buf)
+      .put(T_EXECUTION_SAMPLE)
+      .put(TSC::ticks())
+      .put(tid)
+      .put(call_trace_id)
+      .put(static_cast<int>(event->_thread_state))
+      .put(static_cast<int>(event->_execution_mode))
+      .put(event->_weight)
+      .put(event->_sampling_interval)
+      .put(event->_hw_counters)
+      .put(Contexts::get(tid), Profiler::instance()->numContextAttributes())
+      .commit();
   flushIfNeeded(buf);
 }
 
 void Recording::recordMethodSample(Buffer *buf, int tid, u32 call_trace_id,
                                    ExecutionEvent *event) {
-  int start = buf->skip(1);
-  buf->putVar64(T_METHOD_SAMPLE);
-  buf->putVar64(TSC::ticks());
-  buf->putVar64(tid);
-  buf->putVar64(call_trace_id);
-  buf->put8(static_cast<int>(event->_thread_state));
-  buf->put8(static_cast<int>(event->_execution_mode));
-  buf->putVar64(event->_weight);
-  writeContext(buf, Contexts::get(tid));
-  writeEventSizePrefix(buf, start);
+  EventWriter<MethodSampleSchema>(buf)
+      .put(T_METHOD_SAMPLE)
+      .put(TSC::ticks())
+      .put(tid)
+      .put(call_trace_id)
+      .put(static_cast<int>(event->_thread_state))
+      .put(static_cast<int>(event->_execution_mode))
+      .put(event->_weight)
+      .put(event->_sampling_interval)
+      .put(event->_on_cpu_time)
+      .put(event->_run_queue_time)
+      .put(Contexts::get(tid), Profiler::instance()->numContextAttributes())
+      .commit();
   flushIfNeeded(buf);
 }
 
+bool Recording::aggregateSample(int tid, u32 call_trace_id, bool wall,
+                                ExecutionEvent *event) {
+  if (_aggregator == NULL) {
+    return false;
+  }
+  SampleKey key;
+  key.call_trace_id = call_trace_id;
+  key.wall = wall;
+  key.thread_state = static_cast<u8>(event->_thread_state);
+  key.execution_mode = static_cast<u8>(event->_execution_mode);
+  key.sampling_interval = event->_sampling_interval;
+  key.context = Contexts::get(tid);
+  if (_aggregator->add(key, event->_weight)) {
+    return true;
+  }
+  if (_overflow_aggregator == NULL) {
+    return false;
+  }
+  // The samples of a pprof profile are only kept aggregated: past the
+  // capacity, they lose their context but keep their trace and state
+  memset(&key.context, 0, sizeof(key.context));
+  if (!_overflow_aggregator->add(key, event->_weight)) {
+    Counters::increment(AGGREGATE_DROPPED_SAMPLES);
+  }
+  return true;
+}
+
 void Recording::recordWallClockEpoch(Buffer *buf, WallClockEpochEvent *event) {
   int start = buf->skip(1);
   buf->putVar64(T_WALLCLOCK_SAMPLE_EPOCH);
@@ -1363,16 +1768,16 @@ void Recording::recordQueueTime(Buffer *buf, int tid, QueueTimeEvent *event) {
 
 void Recording::recordAllocation(RecordingBuffer *buf, int tid,
                                  u32 call_trace_id, AllocEvent *event) {
-  int start = buf->skip(1);
-  buf->putVar64(T_ALLOC);
-  buf->putVar64(TSC::ticks());
-  buf->putVar64(tid);
-  buf->putVar64(call_trace_id);
-  buf->putVar64(event->_id);
-  buf->putVar64(event->_size);
-  buf->putFloat(event->_weight);
-  writeContext(buf, Contexts::get(tid));
-  writeEventSizePrefix(buf, start);
+  EventWriter<AllocationSchema>(buf)
+      .put(T_ALLOC)
+      .put(TSC::ticks())
+      .put(tid)
+      .put(call_trace_id)
+      .put(event->_id)
+      .put(event->_size)
+      .put(event->_weight)
+      .put(Contexts::get(tid), Profiler::instance()->numContextAttributes())
+      .commit();
   flushIfNeeded(buf);
 }
 
@@ -1400,33 +1805,33 @@ void Recording::recordHeapLiveObject(Buffer *buf, int tid, u32 call_trace_id,
 
 void Recording::recordMonitorBlocked(Buffer *buf, int tid, u32 call_trace_id,
                                      LockEvent *event) {
-  int start = buf->skip(1);
-  buf->putVar64(T_MONITOR_ENTER);
-  buf->putVar64(event->_start_time);
-  buf->putVar64(event->_end_time - event->_start_time);
-  buf->putVar64(tid);
-  buf->putVar64(call_trace_id);
-  buf->putVar64(event->_id);
-  buf->put8(0);
-  buf->putVar64(event->_address);
-  writeContext(buf, Contexts::get(tid));
-  writeEventSizePrefix(buf, start);
+  EventWriter<MonitorBlockedSchema>(buf)
+      .put(T_MONITOR_ENTER)
+      .put(event->_start_time)
+      .put(event->_end_time - event->_start_time)
+      .put(tid)
+      .put(call_trace_id)
+      .put(event->_id)
+      .put(0)
+      .put(event->_address)
+      .put(Contexts::get(tid), Profiler::instance()->numContextAttributes())
+      .commit();
   flushIfNeeded(buf);
 }
 
 void Recording::recordThreadPark(Buffer *buf, int tid, u32 call_trace_id,
                                  LockEvent *event) {
-  int start = buf->skip(1);
-  buf->putVar64(T_THREAD_PARK);
-  buf->putVar64(event->_start_time);
-  buf->putVar64(event->_end_time - event->_start_time);
-  buf->putVar64(tid);
-  buf->putVar64(call_trace_id);
-  buf->putVar64(event->_id);
-  buf->putVar64(event->_timeout);
-  buf->putVar64(MIN_JLONG);
-  buf->putVar64(event->_address);
-  writeEventSizePrefix(buf, start);
+  EventWriter<ThreadParkSchema>(buf)
+      .put(T_THREAD_PARK)
+      .put(event->_start_time)
+      .put(event->_end_time - event->_start_time)
+      .put(tid)
+      .put(call_trace_id)
+      .put(event->_id)
+      .put(event->_timeout)
+      .put(MIN_JLONG)
+      .put(event->_address)
+      .commit();
   flushIfNeeded(buf);
 }
 
@@ -1442,6 +1847,35 @@ void Recording::recordCpuLoad(Buffer *buf, float proc_user, float proc_system,
   flushIfNeeded(buf);
 }
 
+void Recording::recordCgroupCpu(Buffer *buf, const CgroupCpuStat *stat,
+                                const CgroupCpuStat *last) {
+  u64 duration = stat->time - last->time;
+  float usage = 0;
+  float cpus = stat->limit > 0 ? stat->limit : _available_processors;
+  if (duration > 0 && stat->usage >= last->usage) {
+    usage = ratio((stat->usage - last->usage) * 1000.0f / (duration * cpus));
+  }
+  int start = buf->skip(1);
+  buf->putVar64(T_CGROUP_CPU);
+  buf->putVar64(TSC::ticks());
+  buf->putVar64(duration);
+  buf->putFloat(stat->limit);
+  buf->putFloat(usage);
+  // the counters restart if the process is moved to another cgroup
+  buf->putVar64(stat->periods >= last->periods
+                    ? stat->periods - last->periods : 0);
+  buf->putVar64(stat->throttled_periods >= last->throttled_periods
+                    ? stat->throttled_periods - last->throttled_periods : 0);
+  buf->putVar64(stat->throttled >= last->throttled
+                    ? (stat->throttled - last->throttled) * 1000 : 0);
+  buf->putVar64(stat->pressure_some >= last->pressure_some
+                    ? (stat->pressure_some - last->pressure_some) * 1000 : 0);
+  buf->putVar64(stat->pressure_full >= last->pressure_full
+                    ? (stat->pressure_full - last->pressure_full) * 1000 : 0);
+  writeEventSizePrefix(buf, start);
+  flushIfNeeded(buf);
+}
+
 void Recording::addThread(int tid) { _thread_set.add(tid); }
 
 Error FlightRecorder::start(Arguments &args, bool reset) {
@@ -1463,10 +1897,25 @@ Error FlightRecorder::start(Arguments &args, bool reset) {
 }
 
 Error FlightRecorder::newRecording(bool reset) {
-  int fd =
-      open(_filename.c_str(), O_CREAT | O_RDWR | (reset ? O_TRUNC : 0), 0644);
-  if (fd == -1) {
-    return Error("Could not open Flight Recorder output file");
+  int fd;
+  if (isRing()) {
+    // the output file is only written when the ring is dumped
+    fd = OS::createMemoryFile("ddprof-ring");
+    if (fd == -1) {
+      return Error("In-memory ring recording is not supported");
+    }
+  } else if (isPprof()) {
+    // the JFR events other than the samples are not part of the profile
+    fd = OS::createMemoryFile("ddprof-pprof");
+    if (fd == -1) {
+      return Error("pprof output is not supported");
+    }
+  } else {
+    fd = open(_filename.c_str(), O_CREAT | O_RDWR | (reset ? O_TRUNC : 0),
+              0644);
+    if (fd == -1) {
+      return Error("Could not open Flight Recorder output file");
+    }
   }
 
   _rec = new Recording(fd, _args);
@@ -1477,6 +1926,20 @@ void FlightRecorder::stop() {
   if (_rec != NULL) {
     _rec_lock.lock();
 
+    if (_rec->isRing()) {
+      int fd = open(_filename.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+      if (fd != -1) {
+        _rec->dumpRing(fd);
+        close(fd);
+      }
+    } else if (_rec->isPprof()) {
+      int fd = open(_filename.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+      if (fd != -1) {
+        _rec->writeProfile(fd);
+        close(fd);
+      }
+    }
+
     Recording *tmp = _rec;
     // NULL first, deallocate later
     _rec = NULL;
@@ -1487,8 +1950,28 @@ void FlightRecorder::stop() {
 Error FlightRecorder::dump(const char *filename, const int length) {
   if (_rec != NULL) {
     _rec_lock.lock();
-    if (_filename.length() != length ||
-        strncmp(filename, _filename.c_str(), length) != 0) {
+    if (_rec->isRing()) {
+      // the chunks stay in the ring, later dumps may include them again
+      int copy_fd = open(filename, O_CREAT | O_RDWR | O_TRUNC, 0644);
+      if (copy_fd == -1) {
+        _rec_lock.unlock();
+        return Error("Could not open the ring dump file");
+      }
+      _rec->dumpRing(copy_fd);
+      close(copy_fd);
+      _rec_lock.unlock();
+    } else if (_rec->isPprof()) {
+      // the samples written to the profile are not kept
+      int copy_fd = open(filename, O_CREAT | O_RDWR | O_TRUNC, 0644);
+      if (copy_fd == -1) {
+        _rec_lock.unlock();
+        return Error("Could not open the profile file");
+      }
+      _rec->dumpProfile(copy_fd);
+      close(copy_fd);
+      _rec_lock.unlock();
+    } else if (_filename.length() != length ||
+               strncmp(filename, _filename.c_str(), length) != 0) {
       // if the filename to dump the recording to is specified move the current
       // working file there
       int copy_fd = open(filename, O_CREAT | O_RDWR | O_TRUNC, 0644);
@@ -1519,7 +2002,15 @@ void FlightRecorder::flush() {
     // obtaining the class list will create local refs to all loaded classes,
     // effectively preventing them from being unloaded while flushing
     jvmtiError err = jvmti->GetLoadedClasses(&count, classes);
-    _rec->switchChunk(-1);
+    if (_rec->isRing()) {
+      _rec->rotateRing();
+    } else if (_rec->isPprof()) {
+      // a pprof profile is only written when dumped, the working file only
+      // needs to be kept from growing
+      _rec->discardChunk();
+    } else {
+      _rec->switchChunk(-1);
+    }
     if (!err) {
       // deallocate all loaded classes
       for (int i = 0; i < count; i++) {
@@ -1557,10 +2048,10 @@ void FlightRecorder::recordQueueTime(int lock_index, int tid,
 
 void FlightRecorder::recordDatadogSetting(int lock_index, int length,
                                           const char *name, const char *value,
-                                          const char *unit) {
+                                          const char *unit, u64 ticks) {
   if (_rec != NULL) {
     Buffer *buf = _rec->buffer(lock_index);
-    _rec->writeDatadogSetting(buf, length, name, value, unit);
+    _rec->writeDatadogSetting(buf, length, name, value, unit, ticks);
   }
 }
 
@@ -1577,12 +2068,18 @@ void FlightRecorder::recordEvent(int lock_index, int tid, u32 call_trace_id,
     RecordingBuffer *buf = _rec->buffer(lock_index);
     switch (event_type) {
     case 0:
-      _rec->recordExecutionSample(buf, tid, call_trace_id,
-                                  (ExecutionEvent *)event);
+      if (!_rec->aggregateSample(tid, call_trace_id, false,
+                                 (ExecutionEvent *)event)) {
+        _rec->recordExecutionSample(buf, tid, call_trace_id,
+                                    (ExecutionEvent *)event);
+      }
       break;
     case BCI_WALL:
-      _rec->recordMethodSample(buf, tid, call_trace_id,
-                               (ExecutionEvent *)event);
+      if (!_rec->aggregateSample(tid, call_trace_id, true,
+                                 (ExecutionEvent *)event)) {
+        _rec->recordMethodSample(buf, tid, call_trace_id,
+                                 (ExecutionEvent *)event);
+      }
       break;
     case BCI_ALLOC:
       _rec->recordAllocation(buf, tid, call_trace_id, (AllocEvent *)event);
@@ -1603,6 +2100,33 @@ void FlightRecorder::recordEvent(int lock_index, int tid, u32 call_trace_id,
   }
 }
 
+void FlightRecorder::timerTick() {
+  if (!_rec_lock.tryLockShared()) {
+    // No active recording
+    return;
+  }
+  _rec->cpuMonitorCycle();
+  _rec_lock.unlockShared();
+}
+
+bool FlightRecorder::ringRotationDue() {
+  if (!_rec_lock.tryLockShared()) {
+    // No active recording
+    return false;
+  }
+  bool due = _rec->ringRotationDue();
+  _rec_lock.unlockShared();
+  return due;
+}
+
+void FlightRecorder::rotateRing() {
+  if (_rec != NULL) {
+    _rec_lock.lock();
+    _rec->rotateRing();
+    _rec_lock.unlock();
+  }
+}
+
 void FlightRecorder::recordLog(LogLevel level, const char *message,
                                size_t len) {
   if (!_rec_lock.tryLockShared()) {
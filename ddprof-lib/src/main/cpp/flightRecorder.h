@@ -18,6 +18,8 @@
 #define _FLIGHTRECORDER_H
 
 #include <map>
+#include <unordered_map>
+#include <vector>
 
 #include <limits.h>
 #include <string.h>
@@ -25,6 +27,7 @@
 #include "arch_dd.h"
 #include "arguments.h"
 #include "buffers.h"
+#include "cgroupMonitor.h"
 #include "counters.h"
 #include "dictionary.h"
 #include "event.h"
@@ -33,6 +36,7 @@
 #include "log.h"
 #include "mutex.h"
 #include "objectSampler.h"
+#include "sampleAggregator.h"
 #include "threadFilter.h"
 #include "vmEntry.h"
 
@@ -115,6 +119,13 @@ public:
   MethodMap() {}
 };
 
+// A finished chunk of a ring recording
+struct RingChunk {
+  off_t start;
+  off_t end;
+  u64 end_time;
+};
+
 class Recording {
   friend ObjectSampler;
   friend Profiler;
@@ -125,6 +136,8 @@ private:
   static char *_jvm_args;
   static char *_jvm_flags;
   static char *_java_command;
+  // the strings and the element tree of the metadata event
+  static std::string _metadata_body;
 
   RecordingBuffer _buf[CONCURRENCY_LEVEL];
   int _fd;
@@ -148,8 +161,23 @@ private:
   int _recorded_lib_count;
 
   bool _cpu_monitor_enabled;
-  Buffer _cpu_monitor_buf;
+  SmallBuffer _cpu_monitor_buf;
   CpuTimes _last_times;
+  CgroupMonitor _cgroup_monitor;
+  CgroupCpuStat _last_cgroup_stat;
+
+  // A ring keeps the chunks of the last _ring_duration microseconds in a
+  // memory file, up to _ring_size bytes
+  u64 _ring_duration;
+  off_t _ring_size;
+  std::vector<RingChunk> _ring_chunks;
+
+  // CPU and wall clock samples counted by key until the end of the chunk,
+  // NULL unless the profile is aggregated
+  SampleAggregator *_aggregator;
+  // In a pprof profile, which has no individual samples to fall back to, the
+  // samples not fitting into _aggregator counted by key without their context
+  SampleAggregator *_overflow_aggregator;
 
   static float ratio(float value) {
     return value < 0 ? 0 : value > 1 ? 1 : value;
@@ -163,8 +191,19 @@ public:
   off_t finishChunk();
 
   off_t finishChunk(bool end_recording);
+  void startChunk(bool reset_file);
   void switchChunk(int fd);
 
+  bool isRing() const { return _ring_duration > 0; }
+  bool ringRotationDue();
+  void rotateRing();
+  void dumpRing(int fd);
+
+  bool isPprof() const { return _args._output == OUTPUT_PPROF; }
+  void writeProfile(int fd);
+  void dumpProfile(int fd);
+  void discardChunk();
+
   void cpuMonitorCycle();
   void appendRecording(const char *target_file, size_t size);
 
@@ -178,12 +217,16 @@ public:
 
   void writeMetadata(Buffer *buf);
 
-  void writeElement(Buffer *buf, const Element *e);
+  static const std::string &metadataBody();
+
+  static void writeElement(Buffer *buf, const Element *e, std::string &out);
 
   void writeEventSizePrefix(Buffer *buf, int start);
 
   void writeRecordingInfo(Buffer *buf);
 
+  void writeInfoEvents(Buffer *buf);
+
   void writeSettings(Buffer *buf, Arguments &args);
 
   void writeStringSetting(Buffer *buf, int category, const char *key,
@@ -197,7 +240,8 @@ public:
                         const char *base, int offset);
 
   void writeDatadogSetting(Buffer *buf, int length, const char *name,
-                           const char *value, const char *unit);
+                           const char *value, const char *unit,
+                           u64 ticks = 0);
 
   void writeDatadogProfilerConfig(Buffer *buf, long cpuInterval,
                                   long wallInterval, long allocInterval,
@@ -237,14 +281,20 @@ public:
 
   void writeCounters(Buffer *buf);
 
+  void writeLatencies(Buffer *buf);
+
   void writeUnwindFailures(Buffer *buf);
 
-  void writeContext(Buffer *buf, Context &context);
+  void writeSampleAggregates(Buffer *buf);
+
+  void writeContext(Buffer *buf, const Context &context);
 
   void recordExecutionSample(Buffer *buf, int tid, u32 call_trace_id,
                              ExecutionEvent *event);
   void recordMethodSample(Buffer *buf, int tid, u32 call_trace_id,
                           ExecutionEvent *event);
+  bool aggregateSample(int tid, u32 call_trace_id, bool wall,
+                       ExecutionEvent *event);
   void recordWallClockEpoch(Buffer *buf, WallClockEpochEvent *event);
   void recordTraceRoot(Buffer *buf, int tid, TraceRootEvent *event);
   void recordQueueTime(Buffer *buf, int tid, QueueTimeEvent *event);
@@ -258,6 +308,8 @@ public:
                         LockEvent *event);
   void recordCpuLoad(Buffer *buf, float proc_user, float proc_system,
                      float machine_total);
+  void recordCgroupCpu(Buffer *buf, const CgroupCpuStat *stat,
+                       const CgroupCpuStat *last);
   void addThread(int tid);
 };
 
@@ -268,6 +320,8 @@ public:
   Dictionary *_classes;
   Dictionary _packages;
   Dictionary _symbols;
+  // native PCs resolved while writing this chunk
+  std::unordered_map<const void *, const char *> _native_pcs;
 
 private:
   void fillNativeMethodInfo(MethodInfo *mi, const char *name,
@@ -281,9 +335,12 @@ private:
 public:
   Lookup(Recording *rec, MethodMap *method_map, Dictionary *classes)
       : _rec(rec), _method_map(method_map), _classes(classes), _packages(),
-        _symbols() {}
+        _symbols(), _native_pcs() {}
 
   MethodInfo *resolveMethod(ASGCT_CallFrame &frame);
+  const char *resolveNativePC(const void *pc);
+  int resolveNativeFrames(const ASGCT_CallFrame *frames, int num_frames,
+                          std::vector<ASGCT_CallFrame> &resolved);
   u32 getPackage(const char *class_name);
   u32 getSymbol(const char *name);
 };
@@ -304,6 +361,11 @@ public:
   void stop();
   Error dump(const char *filename, const int length);
   void flush();
+  void timerTick();
+  bool ringRotationDue();
+  void rotateRing();
+  bool isRing() const { return _args._ring_duration > 0; }
+  bool isPprof() const { return _args._output == OUTPUT_PPROF; }
   void wallClockEpoch(int lock_index, WallClockEpochEvent *event);
   void recordTraceRoot(int lock_index, int tid, TraceRootEvent *event);
   void recordQueueTime(int lock_index, int tid, QueueTimeEvent *event);
@@ -316,7 +378,8 @@ public:
   void recordLog(LogLevel level, const char *message, size_t len);
 
   void recordDatadogSetting(int lock_index, int length, const char *name,
-                            const char *value, const char *unit);
+                            const char *value, const char *unit,
+                            u64 ticks = 0);
 
   void recordHeapUsage(int lock_index, long value, bool live);
 };
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HWCOUNTERS_H
+#define _HWCOUNTERS_H
+
+#include "arch_dd.h"
+#include <stddef.h>
+
+// Hardware counters read together with a grouped perf_events sample
+enum HwCounter {
+  HW_CYCLES,
+  HW_INSTRUCTIONS,
+  HW_CACHE_MISSES,
+  HW_BRANCH_MISSES,
+  HW_COUNTER_COUNT
+};
+
+// The values of a perf_events counter group: the leader counts HW_CYCLES,
+// each sibling the counter of its slot
+class CounterGroup {
+public:
+  // Stores the values of a PERF_FORMAT_GROUP read of size bytes,
+  // { u64 nr; u64 values[nr]; } with the leader first. Returns false if the
+  // read does not hold the leader and the given siblings.
+  static bool store(const u64 *read, size_t size, int siblings,
+                    const int *slots, u64 *counters) {
+    if (size != (2 + siblings) * sizeof(u64) || read[0] != (u64)(1 + siblings)) {
+      return false;
+    }
+    counters[HW_CYCLES] = read[1];
+    for (int i = 0; i < siblings; i++) {
+      counters[slots[i]] = read[2 + i];
+    }
+    return true;
+  }
+
+  // Stores how much the cumulative values of the leader and the siblings
+  // grew since the previous sample, whose values last holds, and keeps them
+  // in last for the next one
+  static void storeDeltas(const u64 *values, int siblings, const int *slots,
+                          u64 *last, u64 *counters) {
+    for (int i = 0; i <= siblings; i++) {
+      int slot = i == 0 ? HW_CYCLES : slots[i - 1];
+      counters[slot] = values[i] - last[i];
+      last[i] = values[i];
+    }
+  }
+};
+
+#endif // _HWCOUNTERS_H
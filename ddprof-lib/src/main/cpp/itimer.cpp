@@ -47,6 +47,7 @@ void ITimer::signalHandler(int signo, siginfo_t *siginfo, void *ucontext) {
                                 ? convertJvmExecutionState(vm_thread->state())
                                 : ExecutionMode::JVM;
   }
+  event._sampling_interval = _interval;
   Profiler::instance()->recordSample(ucontext, _interval, tid, BCI_CPU, 0,
                                      &event);
   Shims::instance().setSighandlerTid(-1);
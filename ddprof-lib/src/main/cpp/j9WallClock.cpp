@@ -101,6 +101,7 @@ void J9WallClock::timerLoop() {
         }
         ExecutionEvent event;
         event._thread_state = ts;
+        event._sampling_interval = _interval;
         if (ts == OSThreadState::RUNNABLE) {
           Profiler::instance()->recordExternalSample(
               _interval, tid, si->frame_count, frames, /*truncated=*/false,
@@ -16,6 +16,7 @@
 
 #include <assert.h>
 
+#include "bursts.h"
 #include "context.h"
 #include "counters.h"
 #include "engine.h"
@@ -137,6 +138,15 @@ Java_com_datadoghq_profiler_JavaProfiler_filterThread0(JNIEnv *env,
   } else {
     thread_filter->remove(tid);
   }
+  // the wall clock timers are only armed for the threads of the filter
+  Engine *wall_engine = Profiler::instance()->wallEngine();
+  if (thread_filter->enabled() && wall_engine != NULL) {
+    if (enable) {
+      wall_engine->registerThread(tid);
+    } else {
+      wall_engine->unregisterThread(tid);
+    }
+  }
 }
 
 extern "C" DLLEXPORT jobject JNICALL
@@ -183,6 +193,15 @@ Java_com_datadoghq_profiler_JavaProfiler_recordTrace0(
   return acceptValue;
 }
 
+extern "C" DLLEXPORT jboolean JNICALL
+Java_com_datadoghq_profiler_JavaProfiler_startBurst0(JNIEnv *env,
+                                                     jobject unused, jint tid,
+                                                     jlong spanId,
+                                                     jlong durationNanos,
+                                                     jint factor) {
+  return Bursts::start(tid, spanId, OS::nanotime() + durationNanos, factor);
+}
+
 extern "C" DLLEXPORT jint JNICALL
 Java_com_datadoghq_profiler_JavaProfiler_registerConstant0(JNIEnv *env,
                                                            jobject unused,
@@ -193,6 +212,31 @@ Java_com_datadoghq_profiler_JavaProfiler_registerConstant0(JNIEnv *env,
   return encoding == INT_MAX ? -1 : encoding;
 }
 
+extern "C" DLLEXPORT void JNICALL
+Java_com_datadoghq_profiler_JavaProfiler_registerConstants0(
+    JNIEnv *env, jobject unused, jobjectArray values, jintArray encodings) {
+  jsize count = env->GetArrayLength(values);
+  if (count > (jsize)DD_TAGS_CAPACITY) {
+    count = DD_TAGS_CAPACITY;
+  }
+  jint result[DD_TAGS_CAPACITY];
+  for (jsize i = 0; i < count; i++) {
+    jstring value = (jstring)env->GetObjectArrayElement(values, i);
+    if (value == NULL) {
+      result[i] = 0;
+      continue;
+    }
+    {
+      JniString value_str(env, value);
+      u32 encoding = Profiler::instance()->contextValueMap()->bounded_lookup(
+          value_str.c_str(), value_str.length(), 1 << 16);
+      result[i] = encoding == INT_MAX ? -1 : encoding;
+    }
+    env->DeleteLocalRef(value);
+  }
+  env->SetIntArrayRegion(encodings, 0, count, result);
+}
+
 extern "C" DLLEXPORT void JNICALL
 Java_com_datadoghq_profiler_JavaProfiler_dump0(JNIEnv *env, jobject unused,
                                                jstring path) {
@@ -200,15 +244,28 @@ Java_com_datadoghq_profiler_JavaProfiler_dump0(JNIEnv *env, jobject unused,
   Profiler::instance()->dump(path_str.c_str(), path_str.length());
 }
 
-extern "C" DLLEXPORT jobject JNICALL
+extern "C" DLLEXPORT void JNICALL
+Java_com_datadoghq_profiler_JavaProfiler_dumpRing0(JNIEnv *env, jobject unused,
+                                                   jstring path) {
+  JniString path_str(env, path);
+  Error error =
+      Profiler::instance()->dumpRing(path_str.c_str(), path_str.length());
+
+  if (error) {
+    throwNew(env, "java/lang/IllegalStateException", error.message());
+  }
+}
+
+extern "C" DLLEXPORT jboolean JNICALL
 Java_com_datadoghq_profiler_JavaProfiler_getDebugCounters0(JNIEnv *env,
-                                                           jobject unused) {
-#ifdef COUNTERS
-  return env->NewDirectByteBuffer((void *)Counters::getCounters(),
-                                  (jlong)Counters::size());
-#else
-  return env->NewDirectByteBuffer(nullptr, 0);
-#endif // COUNTERS
+                                                           jobject unused,
+                                                           jobject buffer) {
+  void *counters = env->GetDirectBufferAddress(buffer);
+  if (counters == NULL ||
+      env->GetDirectBufferCapacity(buffer) < (jlong)Counters::size()) {
+    return false;
+  }
+  return Counters::getCounters((long long *)counters);
 }
 
 extern "C" DLLEXPORT jobjectArray JNICALL
@@ -111,6 +111,11 @@ void JfrMetadata::initialize(
                   << field("state", T_THREAD_STATE, "Thread State", F_CPOOL)
                   << field("mode", T_EXECUTION_MODE, "Execution Mode", F_CPOOL)
                   << field("weight", T_LONG, "Sample weight")
+                  << field("samplingInterval", T_LONG, "Sampling Interval")
+                  << field("cycles", T_LONG, "CPU Cycles", F_UNSIGNED)
+                  << field("instructions", T_LONG, "Instructions", F_UNSIGNED)
+                  << field("cacheMisses", T_LONG, "Cache Misses", F_UNSIGNED)
+                  << field("branchMisses", T_LONG, "Branch Misses", F_UNSIGNED)
                   << field("spanId", T_LONG, "Span ID")
                   << field("localRootSpanId", T_LONG, "Local Root Span ID") ||
               contextAttributes)
@@ -124,6 +129,39 @@ void JfrMetadata::initialize(
                   << field("state", T_THREAD_STATE, "Thread State", F_CPOOL)
                   << field("mode", T_EXECUTION_MODE, "Execution Mode", F_CPOOL)
                   << field("weight", T_LONG, "Sample weight")
+                  << field("samplingInterval", T_LONG, "Sampling Interval")
+                  << field("cpuTime", T_LONG, "CPU Time", F_DURATION_NANOS)
+                  << field("runQueueTime", T_LONG, "Run Queue Time", F_DURATION_NANOS)
+                  << field("spanId", T_LONG, "Span ID")
+                  << field("localRootSpanId", T_LONG, "Local Root Span ID") ||
+              contextAttributes)
+
+          << (type("datadog.ExecutionSampleAggregate", T_EXECUTION_SAMPLE_AGGREGATE,
+                   "Aggregated CPU Profiling Samples")
+                  << category("Datadog", "Profiling")
+                  << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
+                  << field("duration", T_LONG, "Duration", F_DURATION_TICKS)
+                  << field("stackTrace", T_STACK_TRACE, "Stack Trace", F_CPOOL)
+                  << field("state", T_THREAD_STATE, "Thread State", F_CPOOL)
+                  << field("mode", T_EXECUTION_MODE, "Execution Mode", F_CPOOL)
+                  << field("samples", T_LONG, "Samples", F_UNSIGNED)
+                  << field("weight", T_LONG, "Sample weight")
+                  << field("samplingInterval", T_LONG, "Sampling Interval")
+                  << field("spanId", T_LONG, "Span ID")
+                  << field("localRootSpanId", T_LONG, "Local Root Span ID") ||
+              contextAttributes)
+
+          << (type("datadog.MethodSampleAggregate", T_METHOD_SAMPLE_AGGREGATE,
+                   "Aggregated Wall Profiling Samples")
+                  << category("Datadog", "Profiling")
+                  << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
+                  << field("duration", T_LONG, "Duration", F_DURATION_TICKS)
+                  << field("stackTrace", T_STACK_TRACE, "Stack Trace", F_CPOOL)
+                  << field("state", T_THREAD_STATE, "Thread State", F_CPOOL)
+                  << field("mode", T_EXECUTION_MODE, "Execution Mode", F_CPOOL)
+                  << field("samples", T_LONG, "Samples", F_UNSIGNED)
+                  << field("weight", T_LONG, "Sample weight")
+                  << field("samplingInterval", T_LONG, "Sampling Interval")
                   << field("spanId", T_LONG, "Span ID")
                   << field("localRootSpanId", T_LONG, "Local Root Span ID") ||
               contextAttributes)
@@ -205,6 +243,22 @@ void JfrMetadata::initialize(
               << field("jvmSystem", T_FLOAT, "JVM System", F_PERCENTAGE)
               << field("machineTotal", T_FLOAT, "Machine Total", F_PERCENTAGE))
 
+          << (type("datadog.CgroupCpu", T_CGROUP_CPU, "Cgroup CPU")
+              << category("Datadog")
+              << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
+              << field("duration", T_LONG, "Duration", F_DURATION_NANOS)
+              << field("limit", T_FLOAT, "CPU Limit")
+              << field("usage", T_FLOAT, "CPU Usage", F_PERCENTAGE)
+              << field("periods", T_LONG, "Enforcement Periods", F_UNSIGNED)
+              << field("throttledPeriods", T_LONG, "Throttled Periods",
+                       F_UNSIGNED)
+              << field("throttledTime", T_LONG, "Throttled Time",
+                       F_DURATION_NANOS)
+              << field("pressureSome", T_LONG, "Some Tasks Stalled",
+                       F_DURATION_NANOS)
+              << field("pressureFull", T_LONG, "All Tasks Stalled",
+                       F_DURATION_NANOS))
+
           << (type("jdk.ActiveRecording", T_ACTIVE_RECORDING,
                    "java-profiler Recording")
               << category("Flight Recorder")
@@ -279,6 +333,19 @@ void JfrMetadata::initialize(
               << field("name", T_COUNTER_NAME, "Name")
               << field("count", T_LONG, "Count"))
 
+          << (type("datadog.ProfilerLatency", T_PROFILER_LATENCY,
+                   "Profiler Latency")
+              << category("Datadog")
+              << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
+              << field("stage", T_STRING, "Stage")
+              << field("count", T_LONG, "Count", F_UNSIGNED)
+              << field("mean", T_LONG, "Mean", F_DURATION_TICKS)
+              << field("p50", T_LONG, "50th Percentile", F_DURATION_TICKS)
+              << field("p90", T_LONG, "90th Percentile", F_DURATION_TICKS)
+              << field("p99", T_LONG, "99th Percentile", F_DURATION_TICKS)
+              << field("p999", T_LONG, "99.9th Percentile", F_DURATION_TICKS)
+              << field("max", T_LONG, "Maximum", F_DURATION_TICKS))
+
           << (type("datadog.UnwindFailure", T_UNWIND_FAILURE, "Unwind Failure")
               << category("Datadog")
               << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
@@ -78,6 +78,10 @@ enum JfrType {
   T_DATADOG_CLASSREF_CACHE = 124,
   T_DATADOG_COUNTER = 125,
   T_UNWIND_FAILURE = 126,
+  T_CGROUP_CPU = 127,
+  T_PROFILER_LATENCY = 128,
+  T_EXECUTION_SAMPLE_AGGREGATE = 129,
+  T_METHOD_SAMPLE_AGGREGATE = 130,
   T_ANNOTATION = 200,
   T_LABEL = 201,
   T_CATEGORY = 202,
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LATENCYHISTOGRAM_H
+#define _LATENCYHISTOGRAM_H
+
+#include "arch_dd.h"
+#include "counters.h"
+#include <string.h>
+
+// Stages of the sampling pipeline whose latency is tracked, in TSC ticks. The
+// stages run for every sample come first, up to LATENCY_JFR_RECORD.
+#define DD_LATENCY_TABLE(X)                                                    \
+  X(LATENCY_UNWIND_CPU, "unwind_cpu")                                          \
+  X(LATENCY_UNWIND_WALL, "unwind_wall")                                        \
+  X(LATENCY_UNWIND_ALLOC, "unwind_alloc")                                      \
+  X(LATENCY_UNWIND_OTHER, "unwind_other")                                      \
+  X(LATENCY_CALLTRACE_PUT, "calltrace_put")                                    \
+  X(LATENCY_JFR_RECORD, "jfr_record")                                          \
+  X(LATENCY_LIVENESS_CLEANUP, "liveness_cleanup")                              \
+  X(LATENCY_FINISH_CHUNK, "finish_chunk")
+#define X_ENUM(a, b) a,
+typedef enum LatencyId : int {
+  DD_LATENCY_TABLE(X_ENUM) DD_NUM_LATENCIES
+} LatencyId;
+#undef X_ENUM
+
+// Log-linear histogram: values below 2^SUB_BUCKET_BITS have a bucket each,
+// every larger power of two is split into 2^SUB_BUCKET_BITS equal buckets, so
+// a percentile is off by at most 1/2^SUB_BUCKET_BITS of its value.
+// Recording is a relaxed atomic increment and is async signal safe.
+//
+// Like Counters, the histogram is striped by thread, so that the samplers
+// running on different cores do not share its cache lines. Snapshots merge
+// the shards.
+class LatencyHistogram {
+public:
+  static const int SUB_BUCKET_BITS = 3;
+  static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const int BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+  static const u32 SHARDS = 8;
+
+private:
+  struct alignas(128) Shard {
+    // drained every chunk, a bucket of a shard does not overflow 32 bits
+    volatile u32 buckets[BUCKETS];
+    // Never reset, so that the time spent in a stage can also be followed
+    // independently of the snapshots
+    volatile u64 sum;
+    volatile u64 max;
+  };
+
+  Shard _shards[SHARDS];
+  u64 _drained_sum;
+
+public:
+  LatencyHistogram() : _drained_sum(0) {
+    memset((void *)_shards, 0, sizeof(_shards));
+  }
+
+  static int bucket(u64 value) {
+    if (value < SUB_BUCKETS) {
+      return (int)value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    int shift = exponent - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS) +
+           (int)((value >> shift) & (SUB_BUCKETS - 1));
+  }
+
+  // The smallest value falling into the bucket
+  static u64 lowerBound(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+      return bucket;
+    }
+    int shift = (bucket >> SUB_BUCKET_BITS) - 1;
+    return (u64)(SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+  }
+
+  void record(u64 value) {
+    Shard &shard = _shards[Counters::shard() & (SHARDS - 1)];
+    __atomic_fetch_add(&shard.buckets[bucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shard.sum, value, __ATOMIC_RELAXED);
+    u64 max = __atomic_load_n(&shard.max, __ATOMIC_RELAXED);
+    while (value > max &&
+           !__atomic_compare_exchange_n(&shard.max, &max, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+  }
+
+  // Moves the recorded values to 'buckets' and starts over. Values recorded
+  // concurrently end up either in this or in the next snapshot.
+  u64 drain(u64 *buckets, u64 *sum, u64 *max) {
+    u64 count = 0;
+    memset(buckets, 0, BUCKETS * sizeof(u64));
+    *max = 0;
+    for (u32 s = 0; s < SHARDS; s++) {
+      Shard &shard = _shards[s];
+      for (int i = 0; i < BUCKETS; i++) {
+        u32 n = __atomic_exchange_n(&shard.buckets[i], 0, __ATOMIC_RELAXED);
+        buckets[i] += n;
+        count += n;
+      }
+      u64 shard_max = __atomic_exchange_n(&shard.max, 0, __ATOMIC_RELAXED);
+      if (shard_max > *max) {
+        *max = shard_max;
+      }
+    }
+    u64 all = total();
+    *sum = all - _drained_sum;
+    _drained_sum = all;
+    return count;
+  }
+
+  // The sum of all values recorded so far
+  u64 total() const {
+    u64 sum = 0;
+    for (u32 s = 0; s < SHARDS; s++) {
+      sum += __atomic_load_n(&_shards[s].sum, __ATOMIC_RELAXED);
+    }
+    return sum;
+  }
+
+  // The value below which the given fraction of a drained snapshot falls
+  static u64 percentile(const u64 *buckets, u64 count, double fraction) {
+    u64 rank = (u64)(count * fraction);
+    u64 seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+      seen += buckets[i];
+      if (seen > rank) {
+        // report the upper end of the bucket, percentiles do not undershoot
+        return i + 1 < BUCKETS ? lowerBound(i + 1) - 1 : (u64)-1;
+      }
+    }
+    return 0;
+  }
+};
+
+class Latencies {
+private:
+  static LatencyHistogram _histograms[DD_NUM_LATENCIES];
+
+public:
+  static void record(LatencyId id, u64 ticks) {
+    _histograms[id].record(ticks);
+  }
+
+  static LatencyHistogram &get(LatencyId id) { return _histograms[id]; }
+
+  // The ticks spent so far in the stages run for every sample, the ones the
+  // sampling rates control. Chunk and liveness work does not follow the rates.
+  static u64 samplingTotal() {
+    u64 total = 0;
+    for (int i = 0; i <= LATENCY_JFR_RECORD; i++) {
+      total += _histograms[i].total();
+    }
+    return total;
+  }
+
+  static const char *name(LatencyId id) {
+#define X_NAME(a, b) b,
+    static const char *const names[] = {DD_LATENCY_TABLE(X_NAME)};
+#undef X_NAME
+    return names[id];
+  }
+};
+
+#endif // _LATENCYHISTOGRAM_H
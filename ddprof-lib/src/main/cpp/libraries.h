@@ -19,6 +19,8 @@ class Libraries {
   CodeCache *findLibraryByName(const char *lib_name);
   CodeCache *findLibraryByAddress(const void *address);
 
+  int count() { return _native_libs.count(); }
+
   static Libraries *instance() {
     static Libraries instance;
     return &instance;
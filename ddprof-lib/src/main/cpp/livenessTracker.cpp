@@ -23,6 +23,7 @@
 #include "context.h"
 #include "incbin.h"
 #include "jniHelper.h"
+#include "latencyHistogram.h"
 #include "livenessTracker.h"
 #include "log.h"
 #include "os.h"
@@ -57,6 +58,7 @@ void LivenessTracker::cleanup_table(bool forced) {
   u32 sz = _table_size;
   if (sz > 0) {
     u64 start = OS::nanotime(), end;
+    u64 start_ticks = TSC::ticks();
     u32 newsz = 0;
     std::set<jclass> kept_classes;
     for (u32 i = 0; i < sz; i++) {
@@ -80,6 +82,7 @@ void LivenessTracker::cleanup_table(bool forced) {
 
     _table_size = newsz;
 
+    Latencies::record(LATENCY_LIVENESS_CLEANUP, TSC::ticks() - start_ticks);
     end = OS::nanotime();
     Log::debug("Liveness tracker cleanup took %.2fms (%.2fus/element)",
                1.0f * (end - start) / 1000 / 1000,
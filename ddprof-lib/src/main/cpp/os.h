@@ -72,6 +72,12 @@ public:
   static int threadId();
   static const char *schedPolicy(int thread_id);
   static bool threadName(int thread_id, char *name_buf, size_t name_len);
+  // Opens the scheduler statistics of a thread, -1 if they are not available.
+  // Async signal safe.
+  static int openSchedStat(int thread_id);
+  // Cumulative on-CPU and run queue wait time of the thread whose statistics
+  // are open as fd, in nanoseconds. Async signal safe.
+  static bool readSchedStat(int fd, u64 *on_cpu_ns, u64 *run_queue_ns);
   static ThreadList *listThreads();
 
   static bool isLinux();
@@ -93,6 +99,10 @@ public:
   static int fileSize(int fd);
   static int truncateFile(int fd);
   static void freePageCache(int fd, off_t start_offset);
+  // An anonymous file backed by memory only, or -1 if not supported
+  static int createMemoryFile(const char *name);
+  // Frees the storage of a range of the file, the offsets stay valid
+  static bool punchHole(int fd, off_t offset, off_t size);
 
   static void mallocArenaMax(int arena_max);
 };
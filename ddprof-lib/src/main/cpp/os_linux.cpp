@@ -21,6 +21,8 @@
 #include <byteswap.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <linux/falloc.h>
+#include <linux/memfd.h>
 #include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -215,6 +217,51 @@ bool OS::threadName(int thread_id, char *name_buf, size_t name_len) {
   return false;
 }
 
+int OS::openSchedStat(int thread_id) {
+  // Called from signal handlers, so the path is formatted without snprintf
+  char path[64] = "/proc/self/task/";
+  char digits[16];
+  int len = 0;
+  do {
+    digits[len++] = '0' + thread_id % 10;
+    thread_id /= 10;
+  } while (thread_id > 0 && len < (int)sizeof(digits));
+  char *p = path + 16;
+  while (len > 0) {
+    *p++ = digits[--len];
+  }
+  strcpy(p, "/schedstat");
+  return open(path, O_RDONLY);
+}
+
+bool OS::readSchedStat(int fd, u64 *on_cpu_ns, u64 *run_queue_ns) {
+  // The file is reread from the start for each sample
+  char buf[96];
+  ssize_t r = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (r <= 0) {
+    return false;
+  }
+  buf[r] = 0;
+
+  // <time on cpu> <time waiting on a run queue> <timeslices>
+  u64 values[2] = {0, 0};
+  const char *s = buf;
+  for (int i = 0; i < 2; i++) {
+    if (*s < '0' || *s > '9') {
+      return false;
+    }
+    while (*s >= '0' && *s <= '9') {
+      values[i] = values[i] * 10 + (*s++ - '0');
+    }
+    while (*s == ' ') {
+      s++;
+    }
+  }
+  *on_cpu_ns = values[0];
+  *run_queue_ns = values[1];
+  return true;
+}
+
 ThreadList *OS::listThreads() { return new LinuxThreadList(); }
 
 bool OS::isLinux() { return true; }
@@ -354,6 +401,19 @@ void OS::freePageCache(int fd, off_t start_offset) {
   posix_fadvise(fd, start_offset & ~page_mask, 0, POSIX_FADV_DONTNEED);
 }
 
+int OS::createMemoryFile(const char *name) {
+#ifdef __NR_memfd_create
+  return syscall(__NR_memfd_create, name, MFD_CLOEXEC);
+#else
+  return -1;
+#endif
+}
+
+bool OS::punchHole(int fd, off_t offset, off_t size) {
+  return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset,
+                   size) == 0;
+}
+
 void OS::mallocArenaMax(int arena_max) {
 #ifndef __musl__
   mallopt(M_ARENA_MAX, arena_max);
@@ -189,6 +189,12 @@ bool OS::threadName(int thread_id, char *name_buf, size_t name_len) {
          name_buf[0] != 0;
 }
 
+int OS::openSchedStat(int thread_id) { return -1; }
+
+bool OS::readSchedStat(int fd, u64 *on_cpu_ns, u64 *run_queue_ns) {
+  return false;
+}
+
 ThreadList *OS::listThreads() { return new MacThreadList(); }
 
 bool OS::isLinux() { return false; }
@@ -342,6 +348,16 @@ void OS::freePageCache(int fd, off_t start_offset) {
   // Not supported on macOS
 }
 
+int OS::createMemoryFile(const char *name) {
+  // Not supported on macOS
+  return -1;
+}
+
+bool OS::punchHole(int fd, off_t offset, off_t size) {
+  // Not supported on macOS
+  return false;
+}
+
 void OS::mallocArenaMax(int arena_max) {
   // Not supported on macOS
 }
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "overheadGovernor.h"
+#include "latencyHistogram.h"
+#include "os.h"
+#include "tsc.h"
+#include <math.h>
+
+const int OverheadGovernor::MAX_SCALE;
+
+// Smaller changes of the scale are not applied, so that the timers of all
+// threads are not re-armed on every tick
+static const double MIN_SCALE_CHANGE = 0.1;
+
+PidController OverheadGovernor::newController() {
+  // The input is the overhead in per mille of the target, once per second.
+  // The signal is accumulated into the scale, which already integrates the
+  // error, so the integral gain is kept small to avoid oscillations.
+  return PidController(1000, 0.5, 0.01, 0.1, 1, 5);
+}
+
+void OverheadGovernor::start(double target_percent, int cpus) {
+  _pid = newController();
+  _target = target_percent / 100;
+  _cpus = cpus > 0 ? cpus : 1;
+  _last_ticks = Latencies::samplingTotal();
+  _last_time = OS::nanotime();
+  _scale = _applied_scale = 1;
+}
+
+bool OverheadGovernor::update(double *scale) {
+  u64 ticks = Latencies::samplingTotal();
+  u64 now = OS::nanotime();
+  double elapsed = (now - _last_time) / 1e9;
+  double spent = (double)(ticks - _last_ticks) / TSC::frequency();
+  _last_ticks = ticks;
+  _last_time = now;
+  if (elapsed <= 0) {
+    return false;
+  }
+  return adjust(spent / (elapsed * _cpus), scale);
+}
+
+bool OverheadGovernor::adjust(double overhead, double *scale) {
+  if (!enabled()) {
+    return false;
+  }
+  u64 input = (u64)(overhead / _target * 1000);
+  _scale -= _pid.compute(input, 1) / 1000;
+  if (_scale <= 1 || _scale >= MAX_SCALE) {
+    // The rates cannot go any further, do not let the integral wind up
+    _scale = _scale <= 1 ? 1 : MAX_SCALE;
+    _pid = newController();
+  }
+
+  bool restored = _scale == 1 && _applied_scale != 1;
+  if (!restored &&
+      fabs(_scale - _applied_scale) < MIN_SCALE_CHANGE * _applied_scale) {
+    return false;
+  }
+  _applied_scale = _scale;
+  *scale = _scale;
+  return true;
+}
+
+bool OverheadGovernor::stop() {
+  bool lowered = _applied_scale != 1;
+  _target = 0;
+  _scale = _applied_scale = 1;
+  return lowered;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _OVERHEADGOVERNOR_H
+#define _OVERHEADGOVERNOR_H
+
+#include "arch_dd.h"
+#include "pidController.h"
+
+// Keeps the CPU time spent sampling, as tracked by the per-sample Latencies,
+// close to a share of the CPUs available to the process. The sampling rates
+// of the CPU and wall clock engines are lowered to 1/scale of the configured
+// ones while the profiler is over budget, and restored when it is not.
+class OverheadGovernor {
+public:
+  static const int MAX_SCALE = 64;
+
+private:
+  PidController _pid;
+  double _target; // share of the available CPU time
+  int _cpus;
+  u64 _last_ticks;
+  u64 _last_time;
+  double _scale;
+  double _applied_scale;
+
+  static PidController newController();
+
+public:
+  OverheadGovernor()
+      : _pid(newController()), _target(0), _cpus(1), _last_ticks(0),
+        _last_time(0), _scale(1), _applied_scale(1) {}
+
+  // A target of 0 percent disables the governor
+  void start(double target_percent, int cpus);
+
+  bool enabled() const { return _target > 0; }
+
+  // Measures the overhead since the previous call. Returns true if the
+  // sampling rates should be changed to 1/scale of the configured ones.
+  bool update(double *scale);
+
+  // Same as update() with an overhead measured as a share of the CPU time
+  bool adjust(double overhead, double *scale);
+
+  // Returns true if the rates were lowered and have to be restored
+  bool stop();
+};
+
+#endif // _OVERHEADGOVERNOR_H
@@ -23,10 +23,15 @@
 #include "engine.h"
 #include <signal.h>
 
+class ExecutionEvent;
+class PerCpuEvent;
 class PerfEvent;
 class PerfEventType;
 class StackContext;
 
+// Maximum number of counters read together with the sampling event
+const int MAX_GROUP_COUNTERS = 3;
+
 class PerfEvents : public Engine {
 private:
   static volatile bool _enabled;
@@ -34,13 +39,39 @@ private:
   static PerfEvent *_events;
   static PerfEventType *_event_type;
   static long _interval;
+  static long _configured_interval;
   static Ring _ring;
   static CStack _cstack;
   static bool _use_mmap_page;
+  static bool _mmap_samples;
+  static bool _hw_counters;
+  static int _group_size;
+  static PerfEventType *_group_types[MAX_GROUP_COUNTERS];
+  static int _group_slots[MAX_GROUP_COUNTERS];
+  static int *_group_fds;
+  static u64 *_group_last;
+  static bool _per_cpu;
+  static int _pid;
+  static int _cpu_count;
+  static PerCpuEvent *_cpu_events;
+
+  static Error openPerCpuEvents();
+  static int forwardSignal();
+  // cppcheck-suppress unusedPrivateFunction
+  static void recordCpuSample(void *ucontext, u64 period);
+  // cppcheck-suppress unusedPrivateFunction
+  static void drainCpuEvent(int fd, void *ucontext);
+
+  static int openGroupCounters(int tid, int leader_fd);
+  static void closeGroupCounters(int tid);
 
   // cppcheck-suppress unusedPrivateFunction
   static u64 readCounter(siginfo_t *siginfo, void *ucontext);
   // cppcheck-suppress unusedPrivateFunction
+  static u64 readCounterGroup(siginfo_t *siginfo, ExecutionEvent *event);
+  // cppcheck-suppress unusedPrivateFunction
+  static bool readMmapSample(int tid, u64 *counter, ExecutionEvent *event);
+  // cppcheck-suppress unusedPrivateFunction
   static void signalHandler(int signo, siginfo_t *siginfo, void *ucontext);
 
 public:
@@ -52,7 +83,10 @@ public:
   virtual void unregisterThread(int tid);
   long interval() const { return _interval; }
 
+  long setRateScale(double scale);
+
   const char *name() { return "PerfEvents"; }
+  const char *units();
 
   static int walkKernel(int tid, const void **callchain, int max_depth,
                         StackContext *java_ctx);
@@ -18,7 +18,9 @@
 
 #include "arch_dd.h"
 #include "context.h"
+#include "counters.h"
 #include "debugSupport.h"
+#include "hwCounters.h"
 #include "libraries.h"
 #include "log.h"
 #include "os.h"
@@ -35,6 +37,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <jvmti.h>
+#include <limits.h>
 #include <linux/perf_event.h>
 #include <pthread.h>
 #include <stdint.h>
@@ -51,6 +54,7 @@
 #ifndef F_SETOWN_EX
 #define F_SETOWN_EX 15
 #define F_OWNER_TID 0
+#define F_OWNER_PID 1
 
 struct f_owner_ex {
   int type;
@@ -522,24 +526,27 @@ class RingBuffer {
 private:
   const char *_start;
   unsigned long _offset;
+  unsigned long _mask;
 
 public:
-  RingBuffer(struct perf_event_mmap_page *page) {
+  RingBuffer(struct perf_event_mmap_page *page,
+             unsigned long mask = OS::page_mask) {
     _start = (const char *)page + OS::page_size;
+    _mask = mask;
   }
 
   struct perf_event_header *seek(u64 offset) {
-    _offset = (unsigned long)offset & OS::page_mask;
+    _offset = (unsigned long)offset & _mask;
     return (struct perf_event_header *)(_start + _offset);
   }
 
   u64 next() {
-    _offset = (_offset + sizeof(u64)) & OS::page_mask;
+    _offset = (_offset + sizeof(u64)) & _mask;
     return *(u64 *)(_start + _offset);
   }
 
   u64 peek(unsigned long words) {
-    unsigned long peek_offset = (_offset + words * sizeof(u64)) & OS::page_mask;
+    unsigned long peek_offset = (_offset + words * sizeof(u64)) & _mask;
     return *(u64 *)(_start + peek_offset);
   }
 };
@@ -552,14 +559,98 @@ private:
   friend class PerfEvents;
 };
 
+// Data pages of a per-CPU ring; must be a power of 2
+const int PERCPU_DATA_PAGES = 8;
+
+class PerCpuEvent : public SpinLock {
+private:
+  int _fd;
+  struct perf_event_mmap_page *_page;
+  // Scratch space for samples of threads other than the signal receiver
+  const void *_callchain[MAX_NATIVE_FRAMES];
+  ASGCT_CallFrame _frames[MAX_NATIVE_FRAMES];
+
+  friend class PerfEvents;
+};
+
 volatile bool PerfEvents::_enabled = false;
 int PerfEvents::_max_events = -1;
 PerfEvent *PerfEvents::_events = NULL;
 PerfEventType *PerfEvents::_event_type = NULL;
 long PerfEvents::_interval;
+long PerfEvents::_configured_interval;
 Ring PerfEvents::_ring;
 CStack PerfEvents::_cstack;
 bool PerfEvents::_use_mmap_page;
+bool PerfEvents::_mmap_samples = false;
+bool PerfEvents::_hw_counters = false;
+int PerfEvents::_group_size = 0;
+PerfEventType *PerfEvents::_group_types[MAX_GROUP_COUNTERS];
+int PerfEvents::_group_slots[MAX_GROUP_COUNTERS];
+int *PerfEvents::_group_fds = NULL;
+u64 *PerfEvents::_group_last = NULL;
+bool PerfEvents::_per_cpu = false;
+int PerfEvents::_pid;
+int PerfEvents::_cpu_count = 0;
+PerCpuEvent *PerfEvents::_cpu_events = NULL;
+
+// Counters attached to the 'cycles' leader in hwcounters mode
+static const struct {
+  const char *name;
+  HwCounter slot;
+} GROUP_COUNTERS[MAX_GROUP_COUNTERS] = {
+    {"instructions", HW_INSTRUCTIONS},
+    {"cache-misses", HW_CACHE_MISSES},
+    {"branch-misses", HW_BRANCH_MISSES},
+};
+
+static const char *perfEventName(Arguments &args) {
+  if (args._hw_counters &&
+      (args._event == NULL || strcmp(args._event, EVENT_CPU) == 0)) {
+    return "cycles";
+  }
+  return args._event == NULL ? EVENT_CPU : args._event;
+}
+
+// Check that a counting-only event of the given type can be opened
+static bool canCount(PerfEventType *event_type, Ring ring) {
+  struct perf_event_attr attr = {0};
+  attr.size = sizeof(attr);
+  attr.type = event_type->type;
+  attr.config = event_type->config;
+  attr.disabled = 1;
+  attr.exclude_kernel = (ring & RING_KERNEL) ? 0 : 1;
+  attr.exclude_user = (ring & RING_USER) ? 0 : 1;
+
+  int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd == -1) {
+    return false;
+  }
+  close(fd);
+  return true;
+}
+
+// Opens the cgroup v2 directory of this process for PERF_FLAG_PID_CGROUP
+static int openOwnCgroup() {
+  FILE *f = fopen("/proc/self/cgroup", "r");
+  if (f == NULL) {
+    return -1;
+  }
+
+  int fd = -1;
+  char line[PATH_MAX];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (strncmp(line, "0::", 3) == 0) {
+      line[strcspn(line, "\n")] = 0;
+      char path[PATH_MAX + 16];
+      snprintf(path, sizeof(path), "/sys/fs/cgroup%s", line + 3);
+      fd = open(path, O_RDONLY);
+      break;
+    }
+  }
+  fclose(f);
+  return fd;
+}
 
 static int __intsort(const void *a, const void *b) {
   return *(const int *)a > *(const int *)b;
@@ -612,6 +703,10 @@ int PerfEvents::registerThread(int tid) {
 
   attr.sample_period = _interval;
   attr.sample_type = PERF_SAMPLE_CALLCHAIN;
+  if (_mmap_samples) {
+    // The sample weight is taken from the ring instead of read(si_fd)
+    attr.sample_type |= PERF_SAMPLE_PERIOD;
+  }
   attr.disabled = 1;
   attr.wakeup_events = 1;
   attr.exclude_callchain_user = 1;
@@ -627,6 +722,12 @@ int PerfEvents::registerThread(int tid) {
     attr.exclude_callchain_user = 1;
   }
 
+  if (_group_size > 0) {
+    // The leader reports all counters of the group with a single read
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.sample_type |= PERF_SAMPLE_READ;
+  }
+
 #ifdef PERF_ATTR_SIZE_VER5
   if (_cstack == CSTACK_LBR) {
     attr.sample_type |= PERF_SAMPLE_BRANCH_STACK | PERF_SAMPLE_REGS_USER;
@@ -654,8 +755,23 @@ int PerfEvents::registerThread(int tid) {
     return 0;
   }
 
+  if (_group_size > 0) {
+    int err = openGroupCounters(tid, fd);
+    if (err != 0) {
+      if (__sync_bool_compare_and_swap(&_events[tid]._fd, fd, 0)) {
+        close(fd);
+      }
+      return err;
+    }
+  }
+
+  if (_group_last != NULL) {
+    memset(&_group_last[tid * (1 + MAX_GROUP_COUNTERS)], 0,
+           (1 + MAX_GROUP_COUNTERS) * sizeof(u64));
+  }
+
   void *page = NULL;
-  if ((_ring & RING_KERNEL)) {
+  if ((_ring & RING_KERNEL) || _mmap_samples) {
     page = _use_mmap_page ? mmap(NULL, 2 * OS::page_size,
                                  PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
                           : NULL;
@@ -678,11 +794,52 @@ int PerfEvents::registerThread(int tid) {
   fcntl(fd, F_SETOWN_EX, &ex);
 
   ioctl(fd, PERF_EVENT_IOC_RESET, 0);
-  ioctl(fd, PERF_EVENT_IOC_REFRESH, 1);
+  if (_mmap_samples) {
+    // Keep the event armed: every overflow raises a signal without REFRESH
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  } else {
+    ioctl(fd, PERF_EVENT_IOC_REFRESH, 1);
+  }
+
+  return 0;
+}
+
+int PerfEvents::openGroupCounters(int tid, int leader_fd) {
+  int *fds = &_group_fds[tid * MAX_GROUP_COUNTERS];
+  for (int i = 0; i < _group_size; i++) {
+    PerfEventType *event_type = _group_types[i];
 
+    struct perf_event_attr attr = {0};
+    attr.size = sizeof(attr);
+    attr.type = event_type->type;
+    attr.config = event_type->config;
+    // Siblings only count; they are enabled and disabled with the leader
+    attr.exclude_kernel = (_ring & RING_KERNEL) ? 0 : 1;
+    attr.exclude_user = (_ring & RING_USER) ? 0 : 1;
+
+    int fd = syscall(__NR_perf_event_open, &attr, tid, -1, leader_fd, 0);
+    if (fd == -1) {
+      int err = errno;
+      Log::warn("perf_event_open of %s for TID %d failed: %s",
+                event_type->name, tid, strerror(err));
+      closeGroupCounters(tid);
+      return err;
+    }
+    __atomic_store_n(&fds[i], fd, __ATOMIC_RELEASE);
+  }
   return 0;
 }
 
+void PerfEvents::closeGroupCounters(int tid) {
+  int *fds = &_group_fds[tid * MAX_GROUP_COUNTERS];
+  for (int i = 0; i < MAX_GROUP_COUNTERS; i++) {
+    int fd = __atomic_exchange_n(&fds[i], 0, __ATOMIC_ACQ_REL);
+    if (fd > 0) {
+      close(fd);
+    }
+  }
+}
+
 void PerfEvents::unregisterThread(int tid) {
   if (tid >= _max_events) {
     return;
@@ -694,6 +851,9 @@ void PerfEvents::unregisterThread(int tid) {
     ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
     close(fd);
   }
+  if (_group_fds != NULL) {
+    closeGroupCounters(tid);
+  }
   if (event->_page != NULL) {
     event->lock();
     munmap(event->_page, 2 * OS::page_size);
@@ -721,7 +881,77 @@ u64 PerfEvents::readCounter(siginfo_t *siginfo, void *ucontext) {
   }
 }
 
+u64 PerfEvents::readCounterGroup(siginfo_t *siginfo, ExecutionEvent *event) {
+  u64 values[2 + MAX_GROUP_COUNTERS];
+  ssize_t r = read(siginfo->si_fd, values, sizeof(values));
+  if (r < 0 || !CounterGroup::store(values, r, _group_size, _group_slots,
+                                    event->_hw_counters)) {
+    return 1;
+  }
+  return values[1];
+}
+
+// Takes the period and the grouped counter values of the pending sample
+// straight from the mmap ring; the record itself is consumed by walkKernel
+// or resetBuffer afterwards
+bool PerfEvents::readMmapSample(int tid, u64 *counter, ExecutionEvent *event) {
+  PerfEvent *perf_event = &_events[tid];
+  if (!perf_event->tryLock()) {
+    return false; // the event is being destroyed
+  }
+
+  bool found = false;
+  struct perf_event_mmap_page *page = perf_event->_page;
+  if (page != NULL) {
+    u64 tail = page->data_tail;
+    u64 head = page->data_head;
+    rmb();
+
+    RingBuffer ring(page);
+
+    while (tail < head) {
+      struct perf_event_header *hdr = ring.seek(tail);
+      if (hdr->type == PERF_RECORD_SAMPLE) {
+        *counter = ring.next();
+        if (_group_size > 0) {
+          // Values are cumulative since the event is never reset
+          u64 values[1 + MAX_GROUP_COUNTERS];
+          u64 nr = ring.next();
+          if (nr == (u64)(1 + _group_size)) {
+            for (u64 i = 0; i < nr; i++) {
+              values[i] = ring.next();
+            }
+            CounterGroup::storeDeltas(
+                values, _group_size, _group_slots,
+                &_group_last[tid * (1 + MAX_GROUP_COUNTERS)],
+                event->_hw_counters);
+          }
+        }
+        found = true;
+        break;
+      }
+      tail += hdr->size;
+    }
+  }
+
+  perf_event->unlock();
+  return found;
+}
+
 void PerfEvents::signalHandler(int signo, siginfo_t *siginfo, void *ucontext) {
+  if (_per_cpu) {
+    if (signo == forwardSignal()) {
+      if (siginfo->si_code != SI_QUEUE || siginfo->si_pid != _pid) {
+        return;
+      }
+      // A sample of this thread forwarded by drainCpuEvent
+      recordCpuSample(ucontext, (u64)(uintptr_t)siginfo->si_value.sival_ptr);
+    } else if (siginfo->si_code > 0) {
+      drainCpuEvent(siginfo->si_fd, ucontext);
+    }
+    return;
+  }
+
   if (siginfo->si_code <= 0) {
     // Looks like an external signal; don't treat as a profiling event
     return;
@@ -735,23 +965,291 @@ void PerfEvents::signalHandler(int signo, siginfo_t *siginfo, void *ucontext) {
   if (_enabled) {
     Shims::instance().setSighandlerTid(tid);
 
-    u64 counter = readCounter(siginfo, ucontext);
     ExecutionEvent event;
+    u64 counter;
+    if (!_mmap_samples) {
+      counter = _group_size > 0 ? readCounterGroup(siginfo, &event)
+                                : readCounter(siginfo, ucontext);
+    } else if (_event_type->counter_arg > 0) {
+      // function arguments are read from the context, no syscall involved
+      counter = readCounter(siginfo, ucontext);
+    } else if (!readMmapSample(tid, &counter, &event)) {
+      counter = _interval;
+    }
     VMThread *vm_thread = VMThread::current();
     if (vm_thread) {
       event._execution_mode = VM::jni() != NULL
                                   ? convertJvmExecutionState(vm_thread->state())
                                   : ExecutionMode::JVM;
     }
+    event._sampling_interval = _interval;
     Profiler::instance()->recordSample(ucontext, counter, tid, BCI_CPU, 0,
                                        &event);
     Shims::instance().setSighandlerTid(-1);
+    if (_mmap_samples) {
+      // walkKernel does not consume the record when kernel stacks are off
+      resetBuffer(tid);
+    }
   } else {
     resetBuffer(tid);
   }
 
-  ioctl(siginfo->si_fd, PERF_EVENT_IOC_RESET, 0);
-  ioctl(siginfo->si_fd, PERF_EVENT_IOC_REFRESH, 1);
+  if (!_mmap_samples) {
+    // Resetting the whole group makes the next read return per-sample deltas
+    ioctl(siginfo->si_fd, PERF_EVENT_IOC_RESET,
+          _group_size > 0 ? PERF_IOC_FLAG_GROUP : 0);
+    ioctl(siginfo->si_fd, PERF_EVENT_IOC_REFRESH, 1);
+  }
+}
+
+// Records a per-CPU sample of the thread handling the signal
+void PerfEvents::recordCpuSample(void *ucontext, u64 period) {
+  ProfiledThread *current = ProfiledThread::current();
+  if (current != NULL) {
+    current->noteCPUSample(Profiler::instance()->recordingEpoch());
+  }
+  if (!_enabled) {
+    return;
+  }
+  int tid = current != NULL ? current->tid() : OS::threadId();
+  Shims::instance().setSighandlerTid(tid);
+
+  ExecutionEvent event;
+  event._sampling_interval = period;
+  VMThread *vm_thread = VMThread::current();
+  if (vm_thread) {
+    event._execution_mode = VM::jni() != NULL
+                                ? convertJvmExecutionState(vm_thread->state())
+                                : ExecutionMode::JVM;
+  }
+  Profiler::instance()->recordSample(ucontext, period, tid, BCI_CPU, 0,
+                                     &event);
+  Shims::instance().setSighandlerTid(-1);
+}
+
+// Realtime signals are queued: a sample forwarded while another one is still
+// pending on the thread is delivered too, rather than merged into it as a
+// second SIGPROF would be
+int PerfEvents::forwardSignal() { return SIGRTMIN + 5; }
+
+// Hands a sample over to the thread it belongs to, which walks its own stack
+// when it handles the signal. Costs a syscall here and a signal delivery on
+// the target thread.
+static bool forwardCpuSample(int signo, int pid, int tid, u64 period) {
+  siginfo_t si;
+  memset(&si, 0, sizeof(si));
+  si.si_signo = signo;
+  si.si_code = SI_QUEUE;
+  si.si_pid = pid;
+  si.si_uid = getuid();
+  si.si_value.sival_ptr = (void *)(uintptr_t)period;
+  return syscall(__NR_rt_tgsigqueueinfo, pid, tid, signo, &si) == 0;
+}
+
+// Per-CPU rings are delivered to an arbitrary thread of the process, which
+// drains the ring. Samples of the receiving thread are recorded as usual.
+// Only a thread can walk its own Java stack, so the samples of other threads
+// are forwarded to them and recorded once they handle the signal, which may
+// be a little after the counter overflowed. If a thread cannot be signalled,
+// e.g. when the queue of pending signals is full, its sample is counted and
+// recorded from the kernel callchain up to the first Java frame.
+void PerfEvents::drainCpuEvent(int fd, void *ucontext) {
+  PerCpuEvent *cpu_event = NULL;
+  for (int i = 0; i < _cpu_count; i++) {
+    if (_cpu_events[i]._fd == fd) {
+      cpu_event = &_cpu_events[i];
+      break;
+    }
+  }
+  if (cpu_event == NULL || !cpu_event->tryLock()) {
+    // Unknown fd or the ring is being drained by another thread
+    return;
+  }
+
+  int current_tid = ProfiledThread::currentTid();
+
+  struct perf_event_mmap_page *page = cpu_event->_page;
+  u64 tail = page->data_tail;
+  u64 head = page->data_head;
+  rmb();
+
+  RingBuffer ring(page, PERCPU_DATA_PAGES * OS::page_size - 1);
+
+  while (tail < head) {
+    struct perf_event_header *hdr = ring.seek(tail);
+    tail += hdr->size;
+    if (hdr->type != PERF_RECORD_SAMPLE || !_enabled) {
+      continue;
+    }
+
+    // PERF_SAMPLE_TID | PERF_SAMPLE_PERIOD | PERF_SAMPLE_CALLCHAIN
+    u64 pid_tid = ring.next();
+    int pid = (int)(u32)pid_tid;
+    int tid = (int)(u32)(pid_tid >> 32);
+    u64 period = ring.next();
+    if (pid != _pid) {
+      // inherited by a forked child process
+      continue;
+    }
+
+    if (tid == current_tid) {
+      recordCpuSample(ucontext, period);
+      continue;
+    }
+    if (forwardCpuSample(forwardSignal(), _pid, tid, period)) {
+      continue;
+    }
+    Counters::increment(PERCPU_FORWARD_FAILURES);
+
+    int depth = 0;
+    for (u64 nr = ring.next(); nr > 0 && depth < MAX_NATIVE_FRAMES; nr--) {
+      u64 ip = ring.next();
+      if (ip < PERF_CONTEXT_MAX) {
+        const void *iptr = (const void *)ip;
+        if (CodeHeap::contains(iptr)) {
+          // Java frames can be walked only by the thread itself
+          break;
+        }
+        cpu_event->_callchain[depth++] = iptr;
+      }
+    }
+
+    ASGCT_CallFrame *frames = cpu_event->_frames;
+    int num_frames =
+        Profiler::instance()->convertNativeTrace(depth, cpu_event->_callchain,
+                                                 frames);
+    if (num_frames == 0) {
+      frames[0].bci = BCI_ERROR;
+      frames[0].method_id = (jmethodID) "no_Java_frame";
+      num_frames = 1;
+    }
+    ExecutionEvent event;
+    event._sampling_interval = period;
+    Profiler::instance()->recordExternalSample(period, tid, num_frames, frames,
+                                               depth == MAX_NATIVE_FRAMES,
+                                               BCI_CPU, &event);
+  }
+
+  page->data_tail = head;
+  cpu_event->unlock();
+}
+
+Error PerfEvents::openPerCpuEvents() {
+  if (_cpu_events != NULL) {
+    // Events stay open across restarts, same as the per-thread ones
+    for (int cpu = 0; cpu < _cpu_count; cpu++) {
+      if (_cpu_events[cpu]._fd > 0) {
+        ioctl(_cpu_events[cpu]._fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+    return Error::OK;
+  }
+
+  _pid = OS::processId();
+  int cpu_count = sysconf(_SC_NPROCESSORS_CONF);
+  if (cpu_count <= 0) {
+    return Error("Could not get the number of CPUs");
+  }
+
+  struct perf_event_attr attr = {0};
+  attr.size = sizeof(attr);
+  attr.type = _event_type->type;
+  if (attr.type == PERF_TYPE_BREAKPOINT) {
+    attr.bp_type = _event_type->config;
+  } else {
+    attr.config = _event_type->config;
+  }
+  attr.config1 = _event_type->config1;
+  attr.config2 = _event_type->config2;
+  attr.sample_period = _interval;
+  attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_PERIOD | PERF_SAMPLE_CALLCHAIN;
+  attr.disabled = 1;
+  attr.wakeup_events = 1;
+  attr.exclude_kernel = (_ring & RING_KERNEL) ? 0 : 1;
+  attr.exclude_user = (_ring & RING_USER) ? 0 : 1;
+
+  // Filter by the cgroup of the process if possible. Otherwise follow the
+  // current thread and everything it spawns from now on; forked children are
+  // filtered out by pid when the ring is drained.
+  int target;
+  unsigned long flags = 0;
+  int cgroup_fd = openOwnCgroup();
+  if (cgroup_fd != -1) {
+    target = cgroup_fd;
+    flags = PERF_FLAG_PID_CGROUP;
+  } else {
+    target = OS::threadId();
+    attr.inherit = 1;
+  }
+
+  PerCpuEvent *events = (PerCpuEvent *)calloc(cpu_count, sizeof(PerCpuEvent));
+  size_t ring_size = (1 + PERCPU_DATA_PAGES) * OS::page_size;
+  int opened = 0;
+  int err = 0;
+  for (int cpu = 0; cpu < cpu_count; cpu++) {
+    int fd = syscall(__NR_perf_event_open, &attr, target, cpu, -1, flags);
+    if (fd == -1 && flags != 0 && cpu == 0) {
+      // No access to cgroup events, retry in inherit mode
+      close(cgroup_fd);
+      cgroup_fd = -1;
+      flags = 0;
+      target = OS::threadId();
+      attr.inherit = 1;
+      fd = syscall(__NR_perf_event_open, &attr, target, cpu, -1, flags);
+    }
+    if (fd == -1) {
+      // Offline CPUs are skipped
+      if (errno != ENODEV && errno != EINVAL) {
+        err = errno;
+      }
+      continue;
+    }
+
+    void *page = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (page == MAP_FAILED) {
+      err = errno;
+      close(fd);
+      continue;
+    }
+
+    events[cpu]._fd = fd;
+    events[cpu]._page = (struct perf_event_mmap_page *)page;
+    opened++;
+  }
+  if (cgroup_fd != -1) {
+    close(cgroup_fd);
+  }
+
+  if (opened == 0) {
+    free(events);
+    if (err == EACCES || err == EPERM) {
+      return Error("No access to per-CPU perf events. Try 'sysctl "
+                   "kernel.perf_event_paranoid=0'");
+    }
+    return Error("Perf events unavailable");
+  }
+  if (flags == 0) {
+    Log::info("Per-CPU perf events follow only threads started from now on");
+  }
+
+  _cpu_count = cpu_count;
+  _cpu_events = events;
+  OS::installSignalHandler(SIGPROF, signalHandler);
+  OS::installSignalHandler(forwardSignal(), signalHandler);
+
+  struct f_owner_ex ex;
+  ex.type = F_OWNER_PID;
+  ex.pid = _pid;
+  for (int cpu = 0; cpu < cpu_count; cpu++) {
+    int fd = events[cpu]._fd;
+    if (fd > 0) {
+      fcntl(fd, F_SETFL, O_ASYNC);
+      fcntl(fd, F_SETSIG, SIGPROF);
+      fcntl(fd, F_SETOWN_EX, &ex);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  return Error::OK;
 }
 
 Error PerfEvents::check(Arguments &args) {
@@ -763,12 +1261,16 @@ Error PerfEvents::check(Arguments &args) {
     return Error("/proc/sys/kernel/perf_event_paranoid doesn't exist");
   }
 
-  PerfEventType *event_type =
-      PerfEventType::forName(args._event == NULL ? EVENT_CPU : args._event);
+  PerfEventType *event_type = PerfEventType::forName(perfEventName(args));
   if (event_type == NULL) {
     return Error("Unsupported event type");
   } else if (event_type->counter_arg > 4) {
     return Error("Only arguments 1-4 can be counted");
+  } else if (args._hw_counters &&
+             strcmp(event_type->name, "cycles") != 0) {
+    return Error("hwcounters can be used only with the cycles event");
+  } else if (args._hw_counters && args._perf_cpu) {
+    return Error("hwcounters are not supported with percpu");
   }
 
   if (_pthread_entry == NULL &&
@@ -829,19 +1331,23 @@ Error PerfEvents::check(Arguments &args) {
 }
 
 Error PerfEvents::start(Arguments &args) {
-  _event_type =
-      PerfEventType::forName(args._event == NULL ? EVENT_CPU : args._event);
-  ;
+  _event_type = PerfEventType::forName(perfEventName(args));
   if (_event_type == NULL) {
     return Error("Unsupported event type");
   } else if (_event_type->counter_arg > 4) {
     return Error("Only arguments 1-4 can be counted");
-  }
-
-  // if an arbitrary perf event type is specified pick the interval from
-  // args._interval directly otherwise ask for the effective CPU sampler
-  // interval
-  int interval = args._event != NULL && args._event != EVENT_CPU
+  } else if (args._hw_counters &&
+             strcmp(_event_type->name, "cycles") != 0) {
+    return Error("hwcounters can be used only with the cycles event");
+  } else if (args._hw_counters && args._perf_cpu) {
+    return Error("hwcounters are not supported with percpu");
+  }
+
+  // if an arbitrary perf event type is specified (or implied by hwcounters)
+  // pick the interval from args._interval directly otherwise ask for the
+  // effective CPU sampler interval
+  int interval = (args._event != NULL && args._event != EVENT_CPU) ||
+                         args._hw_counters
                      ? args._interval
                      : args.cpuSamplerInterval();
   if (interval < 0) {
@@ -853,7 +1359,8 @@ Error PerfEvents::start(Arguments &args) {
     return Error("Could not set pthread hook");
   }
 
-  _interval = interval ? interval : _event_type->default_interval;
+  _interval = _configured_interval =
+      interval ? interval : _event_type->default_interval;
 
   _ring = args._ring;
   if ((_ring & RING_KERNEL) && !Symbols::haveKernelSymbols()) {
@@ -866,17 +1373,66 @@ Error PerfEvents::start(Arguments &args) {
     }
     _ring = RING_USER;
   }
+  // Threads stay registered across restarts, so the sample layout is decided
+  // once, when the engine starts for the first time. A restart asking for
+  // another layout would get samples it cannot decode.
+  if (_max_events == -1 && _cpu_events == NULL) {
+    _mmap_samples = args._perf_mmap;
+    _per_cpu = args._perf_cpu;
+    _hw_counters = args._hw_counters;
+  } else if (args._perf_mmap != _mmap_samples || args._perf_cpu != _per_cpu ||
+             args._hw_counters != _hw_counters) {
+    return Error("hwcounters, perfmmap and percpu can not be changed on "
+                 "restart");
+  }
   _cstack = args._cstack;
-  _use_mmap_page = _cstack != CSTACK_NO &&
-                   (_ring != RING_USER || _cstack == CSTACK_DEFAULT ||
-                    _cstack == CSTACK_LBR);
+  _use_mmap_page = _mmap_samples ||
+                   (_cstack != CSTACK_NO &&
+                    (_ring != RING_USER || _cstack == CSTACK_DEFAULT ||
+                     _cstack == CSTACK_LBR));
+
+  if (_per_cpu) {
+    return openPerCpuEvents();
+  }
+
+  // Counters the PMU cannot provide are left out of the group
+  if (_max_events == -1 && _hw_counters) {
+    for (int i = 0; i < MAX_GROUP_COUNTERS; i++) {
+      PerfEventType *type = PerfEventType::forName(GROUP_COUNTERS[i].name);
+      if (type != NULL && canCount(type, _ring)) {
+        _group_types[_group_size] = type;
+        _group_slots[_group_size] = GROUP_COUNTERS[i].slot;
+        _group_size++;
+      } else {
+        Log::info("Hardware counter %s is not available",
+                  GROUP_COUNTERS[i].name);
+      }
+    }
+  }
 
   int max_events = OS::getMaxThreadId();
   if (max_events != _max_events) {
+    // The table goes away with the old pid_max, the events and their
+    // counters and pages must not
+    for (int tid = 0; tid < _max_events; tid++) {
+      unregisterThread(tid);
+    }
     free(_events);
     _events = (PerfEvent *)calloc(max_events, sizeof(PerfEvent));
+    free(_group_fds);
+    _group_fds = NULL;
+    free(_group_last);
+    _group_last = NULL;
     _max_events = max_events;
   }
+  if (_group_size > 0 && _group_fds == NULL) {
+    _group_fds = (int *)calloc((size_t)max_events * MAX_GROUP_COUNTERS,
+                               sizeof(int));
+    if (_mmap_samples) {
+      _group_last = (u64 *)calloc(
+          (size_t)max_events * (1 + MAX_GROUP_COUNTERS), sizeof(u64));
+    }
+  }
 
   OS::installSignalHandler(SIGPROF, signalHandler);
 
@@ -953,12 +1509,50 @@ void PerfEvents::stop() {
   // the data. Instead, since we know we are continuously profiling and we know
   // the interval doesn't change, simply don't unregister threads on stop, and
   // check whether the thread has been registered already on start.
+  // The per-CPU events would keep sampling every thread of the process
+  // though, they are disabled until the next start.
+  for (int cpu = 0; cpu < _cpu_count; cpu++) {
+    if (_cpu_events[cpu]._fd > 0) {
+      ioctl(_cpu_events[cpu]._fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+}
+
+// Only the clock events count nanoseconds, the others count occurrences
+const char *PerfEvents::units() {
+  if (_event_type == NULL || (_event_type->type == PERF_TYPE_SOFTWARE &&
+                              (_event_type->config == PERF_COUNT_SW_TASK_CLOCK ||
+                               _event_type->config == PERF_COUNT_SW_CPU_CLOCK))) {
+    return "ns";
+  }
+  return "events";
+}
+
+// Changes the sample period of the open events in place. Threads keep their
+// events across restarts, so the profiler restores the scale when stopping.
+long PerfEvents::setRateScale(double scale) {
+  long interval = (long)(_configured_interval * scale);
+  _interval = interval;
+
+  u64 period = interval;
+  for (int tid = 0; tid < _max_events; tid++) {
+    int fd = __atomic_load_n(&_events[tid]._fd, __ATOMIC_ACQUIRE);
+    if (fd > 0) {
+      ioctl(fd, PERF_EVENT_IOC_PERIOD, &period);
+    }
+  }
+  for (int i = 0; i < _cpu_count; i++) {
+    if (_cpu_events[i]._fd > 0) {
+      ioctl(_cpu_events[i]._fd, PERF_EVENT_IOC_PERIOD, &period);
+    }
+  }
+  return interval;
 }
 
 int PerfEvents::walkKernel(int tid, const void **callchain, int max_depth,
                            StackContext *java_ctx) {
-  if (!(_ring & RING_KERNEL)) {
-    // we are not capturing kernel stacktraces
+  if (!(_ring & RING_KERNEL) || _per_cpu) {
+    // we are not capturing kernel stacktraces or there is no per-thread ring
     return 0;
   }
 
@@ -980,6 +1574,16 @@ int PerfEvents::walkKernel(int tid, const void **callchain, int max_depth,
     while (tail < head) {
       struct perf_event_header *hdr = ring.seek(tail);
       if (hdr->type == PERF_RECORD_SAMPLE) {
+        if (_mmap_samples) {
+          // Skip PERF_SAMPLE_PERIOD
+          ring.next();
+        }
+        if (_group_size > 0) {
+          // Skip PERF_SAMPLE_READ values which precede the callchain
+          for (u64 values = ring.next(); values > 0; values--) {
+            ring.next();
+          }
+        }
         u64 nr = ring.next();
         while (nr-- > 0) {
           u64 ip = ring.next();
@@ -1039,6 +1643,11 @@ int PerfEvents::walkKernel(int tid, const void **callchain, int max_depth,
 }
 
 void PerfEvents::resetBuffer(int tid) {
+  if (_per_cpu) {
+    // per-CPU rings are drained by the signal handler
+    return;
+  }
+
   PerfEvent *event = &_events[tid];
   if (!event->tryLock()) {
     return; // the event is being destroyed
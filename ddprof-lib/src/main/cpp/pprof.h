@@ -0,0 +1,283 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _PPROF_H
+#define _PPROF_H
+
+#include "arch_dd.h"
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+
+// Field numbers of the perftools.profiles messages (profile.proto)
+enum PprofField {
+  PROFILE_SAMPLE_TYPE = 1,
+  PROFILE_SAMPLE = 2,
+  PROFILE_LOCATION = 4,
+  PROFILE_FUNCTION = 5,
+  PROFILE_STRING_TABLE = 6,
+  PROFILE_TIME_NANOS = 9,
+  PROFILE_DURATION_NANOS = 10,
+  PROFILE_PERIOD_TYPE = 11,
+  PROFILE_PERIOD = 12,
+
+  VALUE_TYPE_TYPE = 1,
+  VALUE_TYPE_UNIT = 2,
+
+  SAMPLE_LOCATION_ID = 1,
+  SAMPLE_VALUE = 2,
+  SAMPLE_LABEL = 3,
+
+  LABEL_KEY = 1,
+  LABEL_STR = 2,
+  LABEL_NUM = 3,
+
+  LOCATION_ID = 1,
+  LOCATION_LINE = 4,
+
+  LINE_FUNCTION_ID = 1,
+  LINE_LINE = 2,
+
+  FUNCTION_ID = 1,
+  FUNCTION_NAME = 2,
+  FUNCTION_SYSTEM_NAME = 3,
+};
+
+// Protocol buffers wire format. Unlike the JFR varints, the protobuf ones
+// take up to 10 bytes. The buffer grows as needed and keeps its memory when
+// reset, so that encoding the messages of a profile allocates only once.
+class ProtoBuffer {
+private:
+  char *_data;
+  size_t _capacity;
+  size_t _offset;
+
+  void ensure(size_t size) {
+    if (_offset + size > _capacity) {
+      while (_offset + size > _capacity) {
+        _capacity *= 2;
+      }
+      _data = (char *)realloc(_data, _capacity);
+    }
+  }
+
+public:
+  enum WireType { VARINT = 0, LENGTH_DELIMITED = 2 };
+
+  explicit ProtoBuffer(size_t capacity = 4096)
+      : _data((char *)malloc(capacity)), _capacity(capacity), _offset(0) {}
+
+  ~ProtoBuffer() { free(_data); }
+
+  const char *data() const { return _data; }
+
+  size_t offset() const { return _offset; }
+
+  void reset() { _offset = 0; }
+
+  static int varintSize(u64 v) {
+    int size = 1;
+    while (v > 0x7f) {
+      v >>= 7;
+      size++;
+    }
+    return size;
+  }
+
+  void putVarint(u64 v) {
+    ensure(10);
+    while (v > 0x7f) {
+      _data[_offset++] = (char)v | 0x80;
+      v >>= 7;
+    }
+    _data[_offset++] = (char)v;
+  }
+
+  void put(const char *v, size_t len) {
+    ensure(len);
+    memcpy(_data + _offset, v, len);
+    _offset += len;
+  }
+
+  void putTag(int field, int wire_type) {
+    putVarint((u64)field << 3 | wire_type);
+  }
+
+  void putField(int field, u64 v) {
+    putTag(field, VARINT);
+    putVarint(v);
+  }
+
+  void putField(int field, const char *v, size_t len) {
+    putTag(field, LENGTH_DELIMITED);
+    putVarint(len);
+    put(v, len);
+  }
+
+  void putMessage(int field, const ProtoBuffer &message) {
+    putField(field, message._data, message._offset);
+  }
+
+  void putPacked(int field, const u64 *values, int count) {
+    if (count == 0) {
+      return;
+    }
+    size_t len = 0;
+    for (int i = 0; i < count; i++) {
+      len += varintSize(values[i]);
+    }
+    putTag(field, LENGTH_DELIMITED);
+    putVarint(len);
+    for (int i = 0; i < count; i++) {
+      putVarint(values[i]);
+    }
+  }
+};
+
+struct PprofLabel {
+  u64 key;
+  u64 str; // 0 for a numeric label
+  u64 num;
+};
+
+// Streams a perftools.profiles.Profile to a file. Decoders accept the fields
+// of a message in any order, so each string table entry is written when the
+// string is first interned and the locations, functions and samples as they
+// come: only the message being encoded is buffered.
+class PprofWriter {
+private:
+  static const size_t FLUSH_THRESHOLD = 65536;
+
+  int _fd;
+  size_t _size;
+  ProtoBuffer _out;
+  ProtoBuffer _message;
+  ProtoBuffer _field;
+  std::unordered_map<std::string, u64> _strings;
+
+  void flushIfNeeded(size_t limit = FLUSH_THRESHOLD) {
+    if (_out.offset() > limit) {
+      const char *data = _out.data();
+      size_t remaining = _out.offset();
+      while (remaining > 0) {
+        ssize_t written = _fd >= 0 ? write(_fd, data, remaining) : remaining;
+        if (written <= 0) {
+          break;
+        }
+        data += written;
+        remaining -= written;
+      }
+      _size += _out.offset();
+      _out.reset();
+    }
+  }
+
+  void putMessage(int field) {
+    _out.putMessage(field, _message);
+    _message.reset();
+    flushIfNeeded();
+  }
+
+  void valueType(int field, const char *type, const char *unit) {
+    u64 type_index = string(type);
+    u64 unit_index = string(unit);
+    _message.putField(VALUE_TYPE_TYPE, type_index);
+    _message.putField(VALUE_TYPE_UNIT, unit_index);
+    putMessage(field);
+  }
+
+public:
+  // A negative fd only counts the bytes of the profile
+  explicit PprofWriter(int fd) : _fd(fd), _size(0) {
+    // the first string table entry must be the empty string
+    string("");
+  }
+
+  // The index of the string in the string table
+  u64 string(const char *str) { return string(str, strlen(str)); }
+
+  u64 string(const char *str, size_t len) {
+    std::pair<std::unordered_map<std::string, u64>::iterator, bool> it =
+        _strings.insert(std::make_pair(std::string(str, len), _strings.size()));
+    if (it.second) {
+      _out.putField(PROFILE_STRING_TABLE, str, len);
+      flushIfNeeded();
+    }
+    return it.first->second;
+  }
+
+  void sampleType(const char *type, const char *unit) {
+    valueType(PROFILE_SAMPLE_TYPE, type, unit);
+  }
+
+  void periodType(const char *type, const char *unit) {
+    valueType(PROFILE_PERIOD_TYPE, type, unit);
+  }
+
+  void period(u64 period) { _out.putField(PROFILE_PERIOD, period); }
+
+  void timeNanos(u64 time) { _out.putField(PROFILE_TIME_NANOS, time); }
+
+  void durationNanos(u64 duration) {
+    _out.putField(PROFILE_DURATION_NANOS, duration);
+  }
+
+  // The labels must refer to interned strings
+  void sample(const u64 *location_ids, int num_locations, const u64 *values,
+              int num_values, const PprofLabel *labels, int num_labels) {
+    _message.putPacked(SAMPLE_LOCATION_ID, location_ids, num_locations);
+    _message.putPacked(SAMPLE_VALUE, values, num_values);
+    for (int i = 0; i < num_labels; i++) {
+      _field.putField(LABEL_KEY, labels[i].key);
+      if (labels[i].str != 0) {
+        _field.putField(LABEL_STR, labels[i].str);
+      } else {
+        _field.putField(LABEL_NUM, labels[i].num);
+      }
+      _message.putMessage(SAMPLE_LABEL, _field);
+      _field.reset();
+    }
+    putMessage(PROFILE_SAMPLE);
+  }
+
+  void location(u64 id, u64 function_id, u64 line) {
+    _field.putField(LINE_FUNCTION_ID, function_id);
+    if (line != 0) {
+      _field.putField(LINE_LINE, line);
+    }
+    _message.putField(LOCATION_ID, id);
+    _message.putMessage(LOCATION_LINE, _field);
+    _field.reset();
+    putMessage(PROFILE_LOCATION);
+  }
+
+  void function(u64 id, u64 name) {
+    _message.putField(FUNCTION_ID, id);
+    _message.putField(FUNCTION_NAME, name);
+    _message.putField(FUNCTION_SYSTEM_NAME, name);
+    putMessage(PROFILE_FUNCTION);
+  }
+
+  // Writes out what is left in the buffer. Returns the size of the profile.
+  size_t finish() {
+    flushIfNeeded(0);
+    return _size;
+  }
+};
+
+#endif // _PPROF_H
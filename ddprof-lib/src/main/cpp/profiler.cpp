@@ -6,6 +6,7 @@
 
 #include "profiler.h"
 #include "asyncSampleMutex.h"
+#include "bursts.h"
 #include "context.h"
 #include "common.h"
 #include "counters.h"
@@ -15,6 +16,7 @@
 #include "itimer.h"
 #include "j9Ext.h"
 #include "j9WallClock.h"
+#include "latencyHistogram.h"
 #include "objectSampler.h"
 #include "os.h"
 #include "perfEvents.h"
@@ -52,6 +54,9 @@ static Engine noop_engine;
 static PerfEvents perf_events;
 static WallClockASGCT wall_asgct_engine;
 static WallClockJVMTI wall_jvmti_engine;
+#ifdef __linux__
+static WallClockTimer wall_timer_engine;
+#endif
 static J9WallClock j9_engine;
 static ITimer itimer;
 static CTimer ctimer;
@@ -245,11 +250,24 @@ const char *Profiler::getLibraryName(const char *native_symbol) {
 }
 
 const char *Profiler::findNativeMethod(const void *address) {
-  CodeCache *lib = _libs->findLibraryByAddress(address);
-  const char *name = NULL;
+  // The library count serves as the cache generation: libraries are only ever
+  // added, so any dlopen() invalidates all the cached lookups
+  int generation = _libs->count();
+  CodeCache *lib;
+  const char *name;
+  if (_symbol_cache.lookup(address, generation, &lib, &name)) {
+    Counters::increment(SYMBOL_CACHE_HITS);
+    return name;
+  }
+  u64 start = TSC::ticks();
+  lib = _libs->findLibraryByAddress(address);
+  name = NULL;
   if (lib != NULL) {
     lib->binarySearch(address, &name);
   }
+  _symbol_cache.insert(address, generation, lib, name);
+  Counters::increment(SYMBOL_CACHE_MISSES);
+  Counters::increment(SYMBOL_CACHE_MISS_TICKS, TSC::ticks() - start);
   return name;
 }
 
@@ -289,6 +307,12 @@ int Profiler::getNativeTrace(void *ucontext, ASGCT_CallFrame *frames,
     native_frames += ddprof::StackWalker::walkDwarf(ucontext, callchain + native_frames,
                                             MAX_NATIVE_FRAMES - native_frames,
                                             java_ctx, truncated);
+  } else if (_unwind_cache) {
+    ProfiledThread *thread = ProfiledThread::current();
+    native_frames += ddprof::StackWalker::walkFP(ucontext, callchain + native_frames,
+                                         MAX_NATIVE_FRAMES - native_frames,
+                                         java_ctx, truncated,
+                                         thread != NULL ? thread->unwindCache() : NULL);
   } else {
     native_frames += ddprof::StackWalker::walkFP(ucontext, callchain + native_frames,
                                          MAX_NATIVE_FRAMES - native_frames,
@@ -303,6 +327,17 @@ int Profiler::convertNativeTrace(int native_frames, const void **callchain,
   int depth = 0;
   jmethodID prev_method = NULL;
 
+  if (_defer_symbols) {
+    // Symbols are resolved when the trace is written, see
+    // Lookup::resolveNativeFrames
+    for (int i = 0; i < native_frames; i++) {
+      frames[depth].bci = BCI_NATIVE_PC;
+      frames[depth].method_id = (jmethodID)callchain[i];
+      depth++;
+    }
+    return depth;
+  }
+
   for (int i = 0; i < native_frames; i++) {
     const char *current_method_name = findNativeMethod(callchain[i]);
     if (current_method_name != NULL &&
@@ -327,6 +362,22 @@ int Profiler::convertNativeTrace(int native_frames, const void **callchain,
   return depth;
 }
 
+int Profiler::getJavaTraceVM(ASGCT_CallFrame *frames, int max_depth,
+                             bool *truncated) {
+  ddprof::VMThread *vm_thread = ddprof::VMThread::current();
+  if (vm_thread == NULL) {
+    return 0;
+  }
+  // A thread reporting a JVMTI event is in the VM or native state, with its
+  // Java frames starting at the last Java frame anchor
+  JavaFrameAnchor *anchor = vm_thread->anchor();
+  if (anchor == NULL || anchor->lastJavaSP() == 0) {
+    return 0;
+  }
+  return ddprof::StackWalker::walkVM(NULL, frames, max_depth, anchor,
+                                     truncated);
+}
+
 int Profiler::getJavaTraceAsync(void *ucontext, ASGCT_CallFrame *frames,
                                 int max_depth, StackContext *java_ctx,
                                 bool *truncated) {
@@ -587,6 +638,19 @@ void Profiler::fillFrameTypes(ASGCT_CallFrame *frames, int num_frames,
   }
 }
 
+static inline LatencyId unwindLatency(jint event_type) {
+  switch (event_type) {
+  case BCI_CPU:
+    return LATENCY_UNWIND_CPU;
+  case BCI_WALL:
+    return LATENCY_UNWIND_WALL;
+  case BCI_ALLOC:
+    return LATENCY_UNWIND_ALLOC;
+  default:
+    return LATENCY_UNWIND_OTHER;
+  }
+}
+
 u32 Profiler::recordJVMTISample(u64 counter, int tid, jthread thread, jint event_type, Event *event, bool deferred) {
   atomicInc(_total_samples);
 
@@ -606,8 +670,24 @@ u32 Profiler::recordJVMTISample(u64 counter, int tid, jthread thread, jint event
     jvmtiFrameInfo *jvmti_frames = _calltrace_buffer[lock_index]->_jvmti_frames;
 
     int num_frames = 0;
+    bool truncated = false;
+    CounterId unwinding_time = UNWINDING_TIME_JVMTI;
+
+    if (event_type == BCI_ALLOC && VMStructs::hasStackStructs()) {
+      // Allocation samples are taken on the allocating thread, which can walk
+      // its own stack with VMStructs instead of calling GetStackTrace
+      num_frames = getJavaTraceVM(frames, _max_stack_depth, &truncated);
+      if (num_frames > 0 && frames[num_frames - 1].bci != BCI_ERROR) {
+        unwinding_time = UNWINDING_TIME_VM;
+      } else {
+        // an incomplete walk, fall back to JVMTI
+        num_frames = 0;
+        truncated = false;
+      }
+    }
 
-    if (VM::jvmti()->GetStackTrace(thread, 0, _max_stack_depth, jvmti_frames, &num_frames) == JVMTI_ERROR_NONE && num_frames > 0) {
+    if (num_frames == 0 &&
+        VM::jvmti()->GetStackTrace(thread, 0, _max_stack_depth, jvmti_frames, &num_frames) == JVMTI_ERROR_NONE && num_frames > 0) {
       // Convert to AsyncGetCallTrace format.
       // Note: jvmti_frames and frames may overlap.
       for (int i = 0; i < num_frames; i++) {
@@ -620,20 +700,60 @@ u32 Profiler::recordJVMTISample(u64 counter, int tid, jthread thread, jint event
       }
     }
 
-    call_trace_id = _call_trace_storage.put(num_frames, frames, false, counter);
-    u64 duration = TSC::ticks() - startTime;
+    u64 put_start = TSC::ticks();
+    Latencies::record(unwindLatency(event_type), put_start - startTime);
+    call_trace_id = _call_trace_storage.put(num_frames, frames, truncated, counter);
+    u64 end = TSC::ticks();
+    Latencies::record(LATENCY_CALLTRACE_PUT, end - put_start);
+    u64 duration = end - startTime;
     if (duration > 0) {
-      Counters::increment(UNWINDING_TIME_JVMTI, duration); // increment the JVMTI specific counter
+      Counters::increment(unwinding_time, duration);
     }
   }
   if (!deferred) {
+    u64 record_start = TSC::ticks();
     _jfr.recordEvent(lock_index, tid, call_trace_id, event_type, event);
+    Latencies::record(LATENCY_JFR_RECORD, TSC::ticks() - record_start);
   }
 
   _locks[lock_index].unlock();
   return call_trace_id;
 }
 
+u32 Profiler::recordJVMTISample(u64 counter, int tid, const jvmtiFrameInfo *jvmti_frames, int num_frames, jint event_type, Event *event) {
+  atomicInc(_total_samples);
+
+  u32 lock_index = getLockIndex(tid);
+  if (!_locks[lock_index].tryLock() &&
+      !_locks[lock_index = (lock_index + 1) % CONCURRENCY_LEVEL].tryLock() &&
+      !_locks[lock_index = (lock_index + 2) % CONCURRENCY_LEVEL].tryLock()) {
+    // Too many concurrent signals already
+    atomicInc(_failures[-ticks_skipped]);
+
+    return 0;
+  }
+  u32 call_trace_id = 0;
+  if (!_omit_stacktraces) {
+    ASGCT_CallFrame *frames = _calltrace_buffer[lock_index]->_asgct_frames;
+    num_frames = std::min(num_frames, _max_stack_depth);
+    // Convert the already captured stack trace to AsyncGetCallTrace format
+    for (int i = 0; i < num_frames; i++) {
+      frames[i].method_id = jvmti_frames[i].method;
+      frames[i].bci = jvmti_frames[i].location;
+      LP64_ONLY(frames[i].padding = 0;)
+    }
+    u64 put_start = TSC::ticks();
+    call_trace_id = _call_trace_storage.put(num_frames, frames, false, counter);
+    Latencies::record(LATENCY_CALLTRACE_PUT, TSC::ticks() - put_start);
+  }
+  u64 record_start = TSC::ticks();
+  _jfr.recordEvent(lock_index, tid, call_trace_id, event_type, event);
+  Latencies::record(LATENCY_JFR_RECORD, TSC::ticks() - record_start);
+
+  _locks[lock_index].unlock();
+  return call_trace_id;
+}
+
 void Profiler::recordDeferredSample(int tid, u32 call_trace_id, jint event_type, Event *event) {
   atomicInc(_total_samples);
 
@@ -717,18 +837,24 @@ void Profiler::recordSample(void *ucontext, u64 counter, int tid,
       num_frames += makeFrame(frames + num_frames, BCI_ERROR, "no_Java_frame");
     }
 
+    u64 put_start = TSC::ticks();
+    Latencies::record(unwindLatency(event_type), put_start - startTime);
     call_trace_id =
         _call_trace_storage.put(num_frames, frames, truncated, counter);
     ProfiledThread *thread = ProfiledThread::current();
     if (thread != nullptr) {
       thread->recordCallTraceId(call_trace_id);
     }
-    u64 duration = TSC::ticks() - startTime;
+    u64 end = TSC::ticks();
+    Latencies::record(LATENCY_CALLTRACE_PUT, end - put_start);
+    u64 duration = end - startTime;
     if (duration > 0) {
       Counters::increment(UNWINDING_TIME_ASYNC, duration); // increment the async specific counter
     }
   }
+  u64 record_start = TSC::ticks();
   _jfr.recordEvent(lock_index, tid, call_trace_id, event_type, event);
+  Latencies::record(LATENCY_JFR_RECORD, TSC::ticks() - record_start);
 
   _locks[lock_index].unlock();
 }
@@ -798,14 +924,17 @@ void Profiler::writeLog(LogLevel level, const char *message, size_t len) {
 
 void Profiler::writeDatadogProfilerSetting(int tid, int length,
                                            const char *name, const char *value,
-                                           const char *unit) {
+                                           const char *unit, u64 ticks,
+                                           bool wait) {
   u32 lock_index = getLockIndex(tid);
-  if (!_locks[lock_index].tryLock() &&
-      !_locks[lock_index = (lock_index + 1) % CONCURRENCY_LEVEL].tryLock() &&
-      !_locks[lock_index = (lock_index + 2) % CONCURRENCY_LEVEL].tryLock()) {
+  if (wait) {
+    _locks[lock_index].lock();
+  } else if (!_locks[lock_index].tryLock() &&
+             !_locks[lock_index = (lock_index + 1) % CONCURRENCY_LEVEL].tryLock() &&
+             !_locks[lock_index = (lock_index + 2) % CONCURRENCY_LEVEL].tryLock()) {
     return;
   }
-  _jfr.recordDatadogSetting(lock_index, length, name, value, unit);
+  _jfr.recordDatadogSetting(lock_index, length, name, value, unit, ticks);
   _locks[lock_index].unlock();
 }
 
@@ -1012,6 +1141,10 @@ Engine *Profiler::selectCpuEngine(Arguments &args) {
       }
       TEST_LOG("J9[cpu]=asgct");
     }
+    if (args._hw_counters || args._perf_cpu) {
+      // counter groups and per-CPU events are available only with perf_events
+      return &perf_events;
+    }
     return !ctimer.check(args)
                ? (Engine *)&ctimer
                : (!perf_events.check(args) ? (Engine *)&perf_events
@@ -1050,6 +1183,10 @@ Engine *Profiler::selectWallEngine(Arguments &args) {
   switch (args._wallclock_sampler) {
         case JVMTI:
             return (Engine*)&wall_jvmti_engine;
+#ifdef __linux__
+        case TIMER:
+            return (Engine*)&wall_timer_engine;
+#endif
         case ASGCT:
         default:
             return (Engine*)&wall_asgct_engine;
@@ -1135,6 +1272,9 @@ Error Profiler::start(Arguments &args, bool reset) {
     if (!_omit_stacktraces) {
       lockAll();
       _call_trace_storage.clear();
+      _call_trace_storage.setFrameTrie(args._frame_trie);
+      _call_trace_storage.setMemoryLimit(args._trace_memory);
+      _call_trace_storage.setRetainedChunks(args._trace_retain);
       unlockAll();
     }
     Counters::reset();
@@ -1182,6 +1322,9 @@ Error Profiler::start(Arguments &args, bool reset) {
           "VMStructs stack walking is not supported on this JVM/platform");
     }
   }
+  // LBR stacks are deduplicated by function, which needs eager symbolization
+  _defer_symbols = args._defer_symbols && _cstack != CSTACK_LBR;
+  _unwind_cache = args._unwind_cache;
 
   // Kernel symbols are useful only for perf_events without --all-user
   _libs->updateSymbols(_cpu_engine == &perf_events && (args._ring & RING_KERNEL));
@@ -1233,6 +1376,13 @@ Error Profiler::start(Arguments &args, bool reset) {
 
   if (activated) {
     switchThreadEvents(JVMTI_ENABLE);
+    jint cpus = 1;
+    VM::jvmti()->GetAvailableProcessors(&cpus);
+    _governor.start(args._overhead, cpus);
+    // the timer thread only runs for the features needing periodic work
+    if (args._cpu_load || args._overhead > 0 || args._ring_duration > 0) {
+      startTimer();
+    }
 
     _state = RUNNING;
     _start_time = time(NULL);
@@ -1258,6 +1408,11 @@ Error Profiler::stop() {
     return Error("Profiler is not active");
   }
 
+  stopTimer();
+  if (_governor.stop()) {
+    // Threads may keep their timers and events across restarts
+    applyRateScale(1);
+  }
   disableEngines();
 
   if (_event_mask & EM_ALLOC)
@@ -1266,6 +1421,7 @@ Error Profiler::stop() {
     _wall_engine->stop();
   if (_event_mask & EM_CPU)
     _cpu_engine->stop();
+  Bursts::reset();
 
   switchLibraryTrap(false);
   switchThreadEvents(JVMTI_DISABLE);
@@ -1285,6 +1441,84 @@ Error Profiler::stop() {
   return Error::OK;
 }
 
+void *Profiler::timerThreadEntry(void *timer_id) {
+  instance()->timerLoop(timer_id);
+  return NULL;
+}
+
+// Periodic work which is not tied to any engine, until stopTimer() is called
+void Profiler::timerLoop(void *timer_id) {
+  u64 next_tick = OS::micros() + TIMER_TICK_MICROS;
+  while (true) {
+    {
+      MutexLocker ml(_timer_lock);
+      while (_timer_id == timer_id && !_timer_lock.waitUntil(next_tick)) {
+      }
+      if (_timer_id != timer_id) {
+        return;
+      }
+      // Under the lock, so that stopTimer() waits for the engines to be done
+      double scale;
+      if (_governor.update(&scale)) {
+        applyRateScale(scale);
+      }
+    }
+    _jfr.timerTick();
+    if (_jfr.ringRotationDue()) {
+      rotateRing();
+    }
+    next_tick += TIMER_TICK_MICROS;
+  }
+}
+
+void Profiler::startTimer() {
+  static uintptr_t timer_generation = 0;
+  MutexLocker ml(_timer_lock);
+  _timer_id = (void *)++timer_generation;
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, timerThreadEntry, _timer_id) == 0) {
+    pthread_detach(thread);
+  } else {
+    Log::warn("Unable to create the profiler timer thread");
+    _timer_id = NULL;
+  }
+}
+
+void Profiler::stopTimer() {
+  MutexLocker ml(_timer_lock);
+  _timer_id = NULL;
+  _timer_lock.notify();
+}
+
+// Every change is recorded, the weights of the samples depend on the rates.
+// Called from the timer thread or stop(), never from a signal handler, so the
+// settings wait for the locks rather than being dropped.
+void Profiler::applyRateScale(double scale) {
+  int tid = OS::threadId();
+  u64 ticks = TSC::ticks();
+  char value[32];
+  snprintf(value, sizeof(value), "%.2f", scale);
+  writeDatadogProfilerSetting(tid, strlen(value), "overheadScale", value, "",
+                              ticks, true);
+
+  if (_event_mask & EM_CPU) {
+    long interval = _cpu_engine->setRateScale(scale);
+    if (interval >= 0) {
+      snprintf(value, sizeof(value), "%ld", interval);
+      writeDatadogProfilerSetting(tid, strlen(value), "cpuInterval", value,
+                                  _cpu_engine->units(), ticks, true);
+    }
+  }
+  if (_event_mask & EM_WALL) {
+    long threads = _wall_engine->setRateScale(scale);
+    if (threads >= 0) {
+      snprintf(value, sizeof(value), "%ld", threads);
+      writeDatadogProfilerSetting(tid, strlen(value), "wallThreadsPerTick",
+                                  value, "threads", ticks, true);
+    }
+  }
+}
+
 Error Profiler::check(Arguments &args) {
   MutexLocker ml(_state_lock);
   if (_state > IDLE) {
@@ -1342,44 +1576,82 @@ Error Profiler::dump(const char *path, const int length) {
   }
 
   if (_state == RUNNING) {
-    std::set<int> thread_ids;
-    // flush the liveness tracker instance and note all the threads referenced
-    // by the live objects
-    LivenessTracker::instance()->flush(thread_ids);
+    return finishChunk(path, length);
+  }
+
+  return Error::OK;
+}
 
-    updateJavaThreadNames();
-    updateNativeThreadNames();
+Error Profiler::dumpRing(const char *path, const int length) {
+  if (!_jfr.isRing()) {
+    return Error("The recording is not a ring, start it with ring=DURATION");
+  }
+  return dump(path, length);
+}
 
-    Counters::set(CODECACHE_NATIVE_COUNT, _native_libs.count());
-    Counters::set(CODECACHE_NATIVE_SIZE_BYTES, _native_libs.memoryUsage());
-    Counters::set(CODECACHE_RUNTIME_STUBS_SIZE_BYTES,
-                  _native_libs.memoryUsage());
+// Cuts a chunk of a ring recording, without writing to disk
+void Profiler::rotateRing() {
+  MutexLocker ml(_state_lock);
+  if (_state == RUNNING) {
+    finishChunk(NULL, 0);
+  }
+}
 
-    lockAll();
-    Error err = _jfr.dump(path, length);
-    __atomic_add_fetch(&_epoch, 1, __ATOMIC_SEQ_CST);
+// Ends the current chunk, dumping the recording to the given path or, without
+// a path, rotating the ring; the per-chunk state starts over
+Error Profiler::finishChunk(const char *path, const int length) {
+  std::set<int> thread_ids;
+  // flush the liveness tracker instance and note all the threads referenced
+  // by the live objects
+  LivenessTracker::instance()->flush(thread_ids);
 
-    // Reset calltrace storage
-    if (!_omit_stacktraces) {
-      _call_trace_storage.clear();
-    }
-    unlockAll();
-    // Reset classmap
-    _class_map_lock.lock();
-    _class_map.clear();
-    _class_map_lock.unlock();
+  updateJavaThreadNames();
+  updateNativeThreadNames();
 
-    _thread_info.clearAll(thread_ids);
-    _thread_info.reportCounters();
+  Counters::set(CODECACHE_NATIVE_COUNT, _native_libs.count());
+  Counters::set(CODECACHE_NATIVE_SIZE_BYTES, _native_libs.memoryUsage());
+  Counters::set(CODECACHE_RUNTIME_STUBS_SIZE_BYTES,
+                _native_libs.memoryUsage());
+  long long misses = Counters::getCounter(SYMBOL_CACHE_MISSES);
+  if (misses > 0) {
+    // estimated from the average cost of the lookups which missed the cache
+    Counters::set(SYMBOL_CACHE_SAVED_TICKS,
+                  Counters::getCounter(SYMBOL_CACHE_HITS) *
+                      Counters::getCounter(SYMBOL_CACHE_MISS_TICKS) / misses);
+  }
 
-    // reset unwinding counters
-    Counters::set(UNWINDING_TIME_ASYNC, 0);
-    Counters::set(UNWINDING_TIME_JVMTI, 0);
+  lockAll();
+  Error err = Error::OK;
+  if (path != NULL) {
+    err = _jfr.dump(path, length);
+  } else {
+    _jfr.rotateRing();
+  }
+  __atomic_add_fetch(&_epoch, 1, __ATOMIC_SEQ_CST);
 
-    return err;
+  // Reset calltrace storage, possibly retaining the recently recorded traces
+  if (!_omit_stacktraces) {
+    _call_trace_storage.finishChunk();
   }
+  unlockAll();
+  // Reset classmap
+  _class_map_lock.lock();
+  _class_map.clear();
+  _class_map_lock.unlock();
 
-  return Error::OK;
+  _thread_info.clearAll(thread_ids);
+  _thread_info.reportCounters();
+
+  // reset unwinding counters
+  Counters::set(UNWINDING_TIME_ASYNC, 0);
+  Counters::set(UNWINDING_TIME_JVMTI, 0);
+  Counters::set(UNWINDING_TIME_VM, 0);
+  Counters::set(SYMBOL_CACHE_HITS, 0);
+  Counters::set(SYMBOL_CACHE_MISSES, 0);
+  Counters::set(SYMBOL_CACHE_MISS_TICKS, 0);
+  Counters::set(SYMBOL_CACHE_SAVED_TICKS, 0);
+
+  return err;
 }
 
 void Profiler::lockAll() {
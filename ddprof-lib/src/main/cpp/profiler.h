@@ -18,7 +18,9 @@
 #include "log.h"
 #include "mutex.h"
 #include "objectSampler.h"
+#include "overheadGovernor.h"
 #include "spinLock.h"
+#include "symbolCache.h"
 #include "thread.h"
 #include "threadFilter.h"
 #include "threadInfo.h"
@@ -38,6 +40,7 @@ __asm__(".symver exp,exp@GLIBC_2.17");
 
 const int MAX_NATIVE_FRAMES = 128;
 const int RESERVED_FRAMES   = 10;  // for synthetic frames
+const u64 TIMER_TICK_MICROS = 1000000;  // period of Profiler::timerLoop
 
 enum EventMask { EM_CPU = 1 << 0, EM_WALL = 1 << 1, EM_ALLOC = 1 << 2 };
 
@@ -85,6 +88,7 @@ private:
   u32 _epoch;
   WaitableMutex _timer_lock;
   void *_timer_id;
+  OverheadGovernor _governor;
 
   u64 _total_samples;
   u64 _failures[ASGCT_FAILURE_TYPES];
@@ -95,10 +99,13 @@ private:
   int _max_stack_depth;
   int _safe_mode;
   CStack _cstack;
+  bool _defer_symbols;
+  bool _unwind_cache;
 
   volatile jvmtiEventMode _thread_events_state;
 
   Libraries* _libs;
+  SymbolCache _symbol_cache;
   SpinLock _stubs_lock;
   CodeCache _runtime_stubs;
   CodeCacheArray _native_libs;
@@ -126,6 +133,7 @@ private:
   bool isAddressInCode(uintptr_t addr);
   int getNativeTrace(void *ucontext, ASGCT_CallFrame *frames, int event_type,
                      int tid, StackContext *java_ctx, bool *truncated);
+  int getJavaTraceVM(ASGCT_CallFrame *frames, int max_depth, bool *truncated);
   int getJavaTraceAsync(void *ucontext, ASGCT_CallFrame *frames, int max_depth,
                         StackContext *java_ctx, bool *truncated);
   void fillFrameTypes(ASGCT_CallFrame *frames, int num_frames,
@@ -144,6 +152,14 @@ private:
   void lockAll();
   void unlockAll();
 
+  static void *timerThreadEntry(void *timer_id);
+  void timerLoop(void *timer_id);
+  void startTimer();
+  void stopTimer();
+  void applyRateScale(double scale);
+  void rotateRing();
+  Error finishChunk(const char *path, const int length);
+
   static bool crashHandler(int signo, siginfo_t *siginfo, void *ucontext);
 
   static Profiler *const _instance;
@@ -154,11 +170,12 @@ public:
         _notify_class_unloaded_func(NULL), _thread_filter(), _call_trace_storage(), _jfr(),
         _start_time(0), _epoch(0), _timer_id(NULL),
         _max_stack_depth(0), _safe_mode(0), _thread_events_state(JVMTI_DISABLE),
-        _libs(Libraries::instance()), _stubs_lock(), _runtime_stubs("[stubs]"), _native_libs(),
+        _libs(Libraries::instance()), _symbol_cache(), _stubs_lock(), _runtime_stubs("[stubs]"), _native_libs(),
         _call_stub_begin(NULL), _call_stub_end(NULL), _dlopen_entry(NULL),
         _num_context_attributes(0), _class_map(1), _string_label_map(2),
         _context_value_map(3), _cpu_engine(), _alloc_engine(), _event_mask(0),
         _stop_time(), _total_samples(0), _failures(), _cstack(CSTACK_NO),
+        _defer_symbols(false), _unwind_cache(false),
         _omit_stacktraces(false) {
 
     for (int i = 0; i < CONCURRENCY_LEVEL; i++) {
@@ -198,7 +215,7 @@ public:
   ThreadFilter *threadFilter() { return &_thread_filter; }
 
   int lookupClass(const char *key, size_t length);
-  void collectCallTraces(std::map<u32, CallTrace *> &traces) {
+  void collectCallTraces(CallTraceList &traces) {
     if (!_omit_stacktraces) {
       _call_trace_storage.collectTraces(traces);
     }
@@ -218,6 +235,7 @@ public:
   Error stop();
   Error flushJfr();
   Error dump(const char *path, const int length);
+  Error dumpRing(const char *path, const int length);
   void logStats();
     void switchThreadEvents(jvmtiEventMode mode);
   int convertNativeTrace(int native_frames, const void **callchain,
@@ -225,6 +243,7 @@ public:
   void recordSample(void *ucontext, u64 weight, int tid, jint event_type,
                     u32 call_trace_id, Event *event);
   u32 recordJVMTISample(u64 weight, int tid, jthread thread, jint event_type, Event *event, bool deferred);
+  u32 recordJVMTISample(u64 weight, int tid, const jvmtiFrameInfo *jvmti_frames, int num_frames, jint event_type, Event *event);
   void recordDeferredSample(int tid, u32 call_trace_id, jint event_type, Event *event);
   void recordExternalSample(u64 weight, int tid, int num_frames,
                             ASGCT_CallFrame *frames, bool truncated,
@@ -234,8 +253,12 @@ public:
   void recordQueueTime(int tid, QueueTimeEvent *event);
   void writeLog(LogLevel level, const char *message);
   void writeLog(LogLevel level, const char *message, size_t len);
+  // Settings are timestamped with the start of the chunk unless ticks are
+  // given. Outside of signal handlers, 'wait' waits for a busy lock instead of
+  // dropping the setting.
   void writeDatadogProfilerSetting(int tid, int length, const char *name,
-                                   const char *value, const char *unit);
+                                   const char *value, const char *unit,
+                                   u64 ticks = 0, bool wait = false);
   void writeHeapUsage(long value, bool live);
   int eventMask() const { return _event_mask; }
 
@@ -25,7 +25,7 @@
 template <class T>
 class ReservoirSampler {
 private:
-    const int _size;
+    int _size;
     std::mt19937 _generator;
     std::uniform_real_distribution<double> _uniform;
     std::uniform_int_distribution<int> _random_index;
@@ -44,6 +44,16 @@ public:
         _reservoir.reserve(size);
     }
 
+    int size() const {
+        return _size;
+    }
+
+    void resize(const int size) {
+        _size = size;
+        _random_index = std::uniform_int_distribution<int>(0, size - 1);
+        _reservoir.reserve(size);
+    }
+
     std::vector<T>& sample(const std::vector<T> &input) {
         _reservoir.clear();
         for (int i = 0; i < _size && i < input.size(); i++) {
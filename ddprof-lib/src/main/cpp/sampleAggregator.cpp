@@ -0,0 +1,84 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sampleAggregator.h"
+#include <stdlib.h>
+
+const u64 SampleAggregator::BUSY;
+const u32 SampleAggregator::MAX_PROBES;
+
+SampleAggregator::SampleAggregator(u32 capacity)
+    : _capacity(capacity), _size(0) {
+  _entries = (Entry *)calloc(capacity, sizeof(Entry));
+}
+
+SampleAggregator::~SampleAggregator() { free(_entries); }
+
+static_assert(sizeof(SampleKey) % sizeof(u64) == 0,
+              "SampleKey is hashed by 64-bit words");
+
+// MurmurHash64A, as for the call traces
+u64 SampleAggregator::hash(const SampleKey &key) {
+  const u64 M = 0xc6a4a7935bd1e995ULL;
+  const int R = 47;
+
+  u64 h = sizeof(SampleKey) * M;
+  const u64 *data = (const u64 *)&key;
+  const u64 *end = data + sizeof(SampleKey) / sizeof(u64);
+  while (data != end) {
+    u64 k = *data++;
+    k *= M;
+    k ^= k >> R;
+    k *= M;
+    h ^= k;
+    h *= M;
+  }
+  h ^= h >> R;
+  h *= M;
+  h ^= h >> R;
+  // 0 and BUSY mark the slots without a key
+  return h > BUSY ? h : h + 2;
+}
+
+bool SampleAggregator::add(const SampleKey &key, u64 weight) {
+  u64 h = hash(key);
+  u32 mask = _capacity - 1;
+  u32 slot = (u32)h & mask;
+  for (u32 probe = 0; probe < MAX_PROBES; probe++, slot = (slot + 1) & mask) {
+    Entry &entry = _entries[slot];
+    u64 entry_hash = __atomic_load_n(&entry.hash, __ATOMIC_ACQUIRE);
+    if (entry_hash == 0) {
+      if (!__sync_bool_compare_and_swap(&entry.hash, 0, BUSY)) {
+        entry_hash = __atomic_load_n(&entry.hash, __ATOMIC_ACQUIRE);
+      } else {
+        entry.key = key;
+        entry.samples = 0;
+        entry.weight = 0;
+        __atomic_store_n(&entry.hash, h, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&_size, 1, __ATOMIC_RELAXED);
+        entry_hash = h;
+      }
+    }
+    // A key being written by another thread is not waited for: the sample
+    // goes to another slot and the key is reported twice at worst
+    if (entry_hash == h && memcmp(&entry.key, &key, sizeof(SampleKey)) == 0) {
+      __atomic_add_fetch(&entry.samples, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&entry.weight, weight, __ATOMIC_RELAXED);
+      return true;
+    }
+  }
+  return false;
+}
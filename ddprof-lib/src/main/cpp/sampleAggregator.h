@@ -0,0 +1,86 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SAMPLEAGGREGATOR_H
+#define _SAMPLEAGGREGATOR_H
+
+#include "arch_dd.h"
+#include "context.h"
+#include <string.h>
+
+// What CPU and wall clock samples are aggregated by. The padding is zeroed so
+// that keys can be hashed and compared as raw memory.
+struct SampleKey {
+  u32 call_trace_id;
+  u8 wall;
+  u8 thread_state;
+  u8 execution_mode;
+  u8 padding;
+  u64 sampling_interval;
+  Context context;
+
+  SampleKey() { memset(this, 0, sizeof(SampleKey)); }
+};
+
+// Counts samples by key instead of keeping each of them, when only the
+// aggregate profile is needed and not the timeline. Samples are added
+// concurrently from the signal handlers without locking; the table is drained
+// while no samples are added.
+class SampleAggregator {
+public:
+  struct Entry {
+    volatile u64 hash; // 0 for a free slot, BUSY while the key is written
+    SampleKey key;
+    volatile u64 samples;
+    volatile u64 weight;
+  };
+
+private:
+  static const u64 BUSY = 1;
+  static const u32 MAX_PROBES = 64;
+
+  Entry *_entries;
+  u32 _capacity;
+  volatile u32 _size;
+
+  static u64 hash(const SampleKey &key);
+
+public:
+  // The capacity must be a power of 2
+  explicit SampleAggregator(u32 capacity);
+  ~SampleAggregator();
+
+  u32 size() const { return __atomic_load_n(&_size, __ATOMIC_RELAXED); }
+
+  // Returns false if there is no room left for the key, in which case the
+  // sample has to be recorded on its own
+  bool add(const SampleKey &key, u64 weight);
+
+  // Visits the entries and empties the table. Must not run concurrently
+  // with add().
+  template <typename Visitor> void drain(Visitor visitor) {
+    for (u32 i = 0; i < _capacity; i++) {
+      Entry &entry = _entries[i];
+      if (entry.hash > BUSY && entry.samples > 0) {
+        visitor(entry);
+      }
+      entry.hash = 0;
+    }
+    _size = 0;
+  }
+};
+
+#endif // _SAMPLEAGGREGATOR_H
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stackWalker_dd.h"
+#include "counters.h"
+#include "stackFrame.h"
+#include "vmStructs.h"
+
+// Same limits as the frame pointer walk of ::StackWalker
+static const uintptr_t FP_MAX_WALK_SIZE = 0x100000;
+static const uintptr_t FP_MAX_FRAME_SIZE = 0x40000;
+static const uintptr_t FP_DEAD_ZONE = 0x1000;
+
+int ddprof::StackWalker::walkFP(void *ucontext, const void **callchain,
+                                int max_depth, StackContext *java_ctx,
+                                bool *truncated, UnwindCache *cache) {
+#if defined(__x86_64__) || defined(__aarch64__)
+  if (ucontext == NULL || cache == NULL || !cache->acquire()) {
+    return walkFP(ucontext, callchain, max_depth, java_ctx, truncated);
+  }
+  StackFrame frame(ucontext);
+  const void *pc = (const void *)frame.pc();
+  if (CodeHeap::contains(pc)) {
+    // the top frame may need stub specific unwinding, leave it to ::StackWalker
+    cache->release();
+    return walkFP(ucontext, callchain, max_depth, java_ctx, truncated);
+  }
+  uintptr_t fp = frame.fp();
+  uintptr_t sp = frame.sp();
+  uintptr_t bottom = sp + FP_MAX_WALK_SIZE;
+
+  UnwindCheckpoint walked[UnwindCache::MAX_CHECKPOINTS];
+  int walked_count = 0;
+  int depth = 0;
+  while (true) {
+    if (CodeHeap::contains(pc)) {
+      java_ctx->pc = pc;
+      java_ctx->sp = sp;
+      java_ctx->fp = fp;
+      // the return address into Java code is not part of the native chain
+      walked_count--;
+      break;
+    }
+    if (depth == max_depth) {
+      *truncated = true;
+      break;
+    }
+    callchain[depth++] = pc;
+
+    if (fp < sp || fp >= sp + FP_MAX_FRAME_SIZE || fp >= bottom ||
+        (fp & (sizeof(uintptr_t) - 1)) != 0) {
+      break;
+    }
+    uintptr_t saved_fp = ((uintptr_t *)fp)[0];
+    const void *return_pc = returnAddress(((const void **)fp)[1]);
+
+    int from = cache->find(fp, saved_fp, return_pc);
+    if (from >= 0 && cache->verify(from)) {
+      // Everything older than this frame record is as walked before
+      int count = cache->count();
+      int spliced = 0;
+      for (int i = from; i < count && depth < max_depth; i++, spliced++) {
+        callchain[depth++] = cache->checkpoint(i).pc;
+      }
+      if (spliced < count - from) {
+        *truncated = true;
+      } else if (cache->javaPC() != NULL) {
+        java_ctx->pc = cache->javaPC();
+        java_ctx->sp = cache->javaSP();
+        java_ctx->fp = cache->javaFP();
+      }
+      cache->update(walked, walked_count, from, cache->javaPC(),
+                    cache->javaSP(), cache->javaFP());
+      cache->release();
+      Counters::increment(UNWIND_SPLICE_HITS);
+      Counters::increment(UNWIND_SPLICED_FRAMES, spliced);
+      return depth;
+    }
+
+    pc = return_pc;
+    if (pc < (const void *)FP_DEAD_ZONE || pc > (const void *)-FP_DEAD_ZONE) {
+      break;
+    }
+    if (walked_count < UnwindCache::MAX_CHECKPOINTS) {
+      walked[walked_count].fp = fp;
+      walked[walked_count].saved_fp = saved_fp;
+      walked[walked_count].pc = pc;
+    }
+    walked_count++;
+    sp = fp + 2 * sizeof(uintptr_t);
+    fp = saved_fp;
+  }
+
+  // a chain cut short by max_depth can not serve as a suffix later
+  if (walked_count <= UnwindCache::MAX_CHECKPOINTS && !*truncated) {
+    cache->update(walked, walked_count, -1, java_ctx->pc, java_ctx->sp,
+                  java_ctx->fp);
+  } else {
+    cache->clear();
+  }
+  cache->release();
+  Counters::increment(UNWIND_SPLICE_MISSES);
+  return depth;
+#else
+  return walkFP(ucontext, callchain, max_depth, java_ctx, truncated);
+#endif
+}
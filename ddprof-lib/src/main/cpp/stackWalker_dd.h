@@ -18,6 +18,7 @@
 #define _STACKWALKER_DD_H
 
 #include "stackWalker.h"
+#include "unwindCache.h"
 
 
 namespace ddprof {
@@ -31,6 +32,9 @@ namespace ddprof {
         }
         return walked;
       }
+      // Same as walkFP, but stops at the first frame record found unchanged
+      // in the cache and takes the remaining frames from there
+      static int walkFP(void* ucontext, const void** callchain, int max_depth, StackContext* java_ctx, bool* truncated, UnwindCache* cache);
       inline static int walkDwarf(void* ucontext, const void** callchain, int max_depth, StackContext* java_ctx, bool* truncated) {
         int walked = ::StackWalker::walkDwarf(ucontext, callchain, max_depth + 1, java_ctx);
         if (walked > max_depth) {
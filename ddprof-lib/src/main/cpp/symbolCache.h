@@ -0,0 +1,111 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SYMBOLCACHE_H
+#define _SYMBOLCACHE_H
+
+#include "arch_dd.h"
+
+class CodeCache;
+
+// Direct-mapped cache of native PC -> (library, symbol name) lookups, shared by
+// all threads and safe to use from signal handlers. Each entry is guarded by
+// its own sequence number: odd while an insert is in progress, so a reader
+// which observes an odd or changed sequence treats the lookup as a miss.
+// Inserts never wait, an insert racing with another one for the same entry is
+// simply dropped.
+//
+// Entries are stamped with the generation they were resolved in (the number
+// of loaded libraries), so that a library loaded later invalidates all of
+// them, including cached misses for addresses the new library now covers.
+class SymbolCache {
+public:
+  static const u32 CACHE_BITS = 12;
+  static const u32 CACHE_SIZE = 1 << CACHE_BITS;
+
+private:
+  struct Entry {
+    volatile u64 sequence;
+    const void *pc;
+    CodeCache *lib;
+    const char *name;
+    int generation;
+  };
+
+  Entry _entries[CACHE_SIZE];
+
+  static u32 slot(const void *pc) {
+    u64 h = (u64)pc;
+    h ^= h >> 29;
+    h *= 0x9e3779b97f4a7c15ULL;
+    return (u32)(h >> (64 - CACHE_BITS));
+  }
+
+public:
+  SymbolCache() { clear(); }
+
+  void clear() {
+    for (u32 i = 0; i < CACHE_SIZE; i++) {
+      _entries[i].sequence = 0;
+      _entries[i].pc = NULL;
+      _entries[i].lib = NULL;
+      _entries[i].name = NULL;
+      _entries[i].generation = -1;
+    }
+  }
+
+  bool lookup(const void *pc, int generation, CodeCache **lib,
+              const char **name) {
+    Entry &e = _entries[slot(pc)];
+    u64 sequence = __atomic_load_n(&e.sequence, __ATOMIC_ACQUIRE);
+    if (sequence & 1) {
+      return false;
+    }
+    const void *cached_pc = __atomic_load_n(&e.pc, __ATOMIC_RELAXED);
+    CodeCache *cached_lib = __atomic_load_n(&e.lib, __ATOMIC_RELAXED);
+    const char *cached_name = __atomic_load_n(&e.name, __ATOMIC_RELAXED);
+    int cached_generation = __atomic_load_n(&e.generation, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&e.sequence, __ATOMIC_RELAXED) != sequence ||
+        cached_pc != pc || cached_generation != generation) {
+      return false;
+    }
+    *lib = cached_lib;
+    *name = cached_name;
+    return true;
+  }
+
+  void insert(const void *pc, int generation, CodeCache *lib,
+              const char *name) {
+    Entry &e = _entries[slot(pc)];
+    u64 sequence = __atomic_load_n(&e.sequence, __ATOMIC_RELAXED);
+    if ((sequence & 1) ||
+        !__atomic_compare_exchange_n(&e.sequence, &sequence, sequence + 1,
+                                     false, __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED)) {
+      return;
+    }
+    // the odd sequence must be visible before any of the fields change
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&e.pc, pc, __ATOMIC_RELAXED);
+    __atomic_store_n(&e.lib, lib, __ATOMIC_RELAXED);
+    __atomic_store_n(&e.name, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&e.generation, generation, __ATOMIC_RELAXED);
+    __atomic_store_n(&e.sequence, sequence + 2, __ATOMIC_RELEASE);
+  }
+};
+
+#endif // _SYMBOLCACHE_H
@@ -2,6 +2,7 @@
 #include "os.h"
 #include "profiler.h"
 #include <time.h>
+#include <unistd.h>
 
 static SigAction old_handler;
 
@@ -9,6 +10,13 @@ pthread_key_t ProfiledThread::_tls_key;
 int ProfiledThread::_buffer_size = 0;
 std::atomic<int> ProfiledThread::_running_buffer_pos(0);
 std::vector<ProfiledThread *> ProfiledThread::_buffer;
+std::atomic<u32> ProfiledThread::_schedstat_epoch(1);
+
+ProfiledThread::~ProfiledThread() {
+  if (_schedstat_fd >= 0) {
+    close(_schedstat_fd);
+  }
+}
 
 void ProfiledThread::initTLSKey() {
   static pthread_once_t tls_initialized = PTHREAD_ONCE_INIT;
@@ -3,6 +3,7 @@
 
 #include "os.h"
 #include "threadLocalData.h"
+#include "unwindCache.h"
 #include "unwindStats.h"
 #include <atomic>
 #include <cstdint>
@@ -21,10 +22,13 @@ private:
   // This means 3 levels but we allow for some wiggling space, just in case.
   // Even with 5 levels cap we will need any highly recursing signal handlers
   static constexpr u32 CRASH_HANDLER_NESTING_LIMIT = 5;
+  // The schedstat file of the thread is opened on its first wall clock sample
+  static constexpr int SCHEDSTAT_UNOPENED = -2;
   static pthread_key_t _tls_key;
   static int _buffer_size;
   static std::atomic<int> _running_buffer_pos;
   static std::vector<ProfiledThread *> _buffer;
+  static std::atomic<u32> _schedstat_epoch;
 
   static void initTLSKey();
   static void doInitTLSKey();
@@ -44,14 +48,24 @@ private:
   u32 _call_trace_id;
   u32 _recording_epoch;
   UnwindFailures _unwind_failures;
+  UnwindCache _unwind_cache;
+  int _schedstat_fd;
+  u32 _schedstat_baseline_epoch;
+  u64 _sched_on_cpu;
+  u64 _sched_run_queue;
+  int _cpu_burst_factor;
 
   ProfiledThread(int buffer_pos, int tid)
       : ThreadLocalData(), _pc(0), _span_id(0), _crash_depth(0), _buffer_pos(buffer_pos), _tid(tid), _cpu_epoch(0),
-        _wall_epoch(0), _call_trace_id(0), _recording_epoch(0) {};
+        _wall_epoch(0), _call_trace_id(0), _recording_epoch(0), _schedstat_fd(SCHEDSTAT_UNOPENED),
+        _schedstat_baseline_epoch(0), _sched_on_cpu(0), _sched_run_queue(0),
+        _cpu_burst_factor(1) {};
 
   void releaseFromBuffer();
 
 public:
+  ~ProfiledThread();
+
   static ProfiledThread *forTid(int tid) { return new ProfiledThread(-1, tid); }
   static ProfiledThread *inBuffer(int buffer_pos) {
     return new ProfiledThread(buffer_pos, 0);
@@ -119,6 +133,41 @@ public:
     return &_unwind_failures;
   }
 
+  UnwindCache* unwindCache() {
+    return &_unwind_cache;
+  }
+
+  // Makes the next schedStatDelta() of every thread only set its baseline,
+  // so that a new profiling session does not report the time since the last
+  // sample of the previous one
+  static void resetSchedStats() { _schedstat_epoch++; }
+
+  // On-CPU and run queue wait time of this thread since the previous call;
+  // both are 0 on the first call after a reset, which only sets the baseline
+  bool schedStatDelta(u64 *on_cpu_ns, u64 *run_queue_ns) {
+    if (_schedstat_fd == SCHEDSTAT_UNOPENED) {
+      _schedstat_fd = OS::openSchedStat(_tid);
+    }
+    u64 on_cpu, run_queue;
+    if (_schedstat_fd == -1 ||
+        !OS::readSchedStat(_schedstat_fd, &on_cpu, &run_queue)) {
+      return false;
+    }
+    u32 epoch = _schedstat_epoch.load(std::memory_order_relaxed);
+    bool has_baseline = _schedstat_baseline_epoch == epoch;
+    *on_cpu_ns = has_baseline && on_cpu > _sched_on_cpu ? on_cpu - _sched_on_cpu : 0;
+    *run_queue_ns = has_baseline && run_queue > _sched_run_queue ? run_queue - _sched_run_queue : 0;
+    _schedstat_baseline_epoch = epoch;
+    _sched_on_cpu = on_cpu;
+    _sched_run_queue = run_queue;
+    return true;
+  }
+
+  // The rate factor the CPU timer of this thread is armed with
+  int cpuBurstFactor() { return _cpu_burst_factor; }
+
+  void setCpuBurstFactor(int factor) { _cpu_burst_factor = factor; }
+
   static void signalHandler(int signo, siginfo_t *siginfo, void *ucontext);
 };
 
@@ -25,6 +25,16 @@ u64 TSC::_offset = 0;
 u64 TSC::_frequency = 1000000000;
 
 void TSC::initialize() {
+#if defined(__aarch64__)
+  // The JVM counts aarch64 JFR ticks with os::elapsed_counter (1GHz); there
+  // is no JVM counter to align with, so the virtual counter is used as is
+  u64 frequency = cntfrq();
+  if (frequency > 0) {
+    _offset = 0;
+    _frequency = frequency;
+    _enabled = true;
+  }
+#else
   JNIEnv *env = VM::jni();
 
   jfieldID jvm;
@@ -53,5 +63,6 @@ void TSC::initialize() {
   }
 
   env->ExceptionClear();
+#endif
   _initialized = true;
 }
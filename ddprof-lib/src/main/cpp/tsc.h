@@ -39,6 +39,26 @@ static inline u64 rdtsc() {
   return result;
 }
 
+#elif defined(__aarch64__)
+
+#define TSC_SUPPORTED true
+
+// The virtual counter is readable from user space and ticks at the fixed
+// frequency reported by cntfrq_el0. The isb keeps the read from being
+// speculated ahead of the instructions before it.
+static inline u64 rdtsc() {
+  u64 result;
+  asm volatile("isb" ::: "memory");
+  asm volatile("mrs %0, cntvct_el0" : "=r"(result));
+  return result;
+}
+
+static inline u64 cntfrq() {
+  u64 result;
+  asm volatile("mrs %0, cntfrq_el0" : "=r"(result));
+  return result;
+}
+
 #else
 
 #define TSC_SUPPORTED false
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2026 Datadog, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UNWINDCACHE_H
+#define _UNWINDCACHE_H
+
+#include "arch_dd.h"
+#include <stdint.h>
+#include <string.h>
+
+// A frame of the native stack walked for a previous sample of the thread: the
+// address of the frame record together with the saved frame pointer and the
+// return address it held.
+struct UnwindCheckpoint {
+  uintptr_t fp;
+  uintptr_t saved_fp;
+  const void *pc;
+};
+
+static inline const void *returnAddress(const void *pc) {
+#if defined(__aarch64__)
+  // strip the pointer authentication code, if any
+  return (const void *)((uintptr_t)pc & 0x0000ffffffffffffULL);
+#else
+  return pc;
+#endif
+}
+
+// Per-thread frame pointer chain of the last sample, ordered from the
+// innermost frame. When a later walk reaches a frame record which still holds
+// the same saved frame pointer and return address, the rest of the chain is
+// taken from here instead of being walked again.
+//
+// Only ever used by the owning thread, but a signal may interrupt the handler
+// of another one, so the cache is claimed for the duration of a walk and
+// nested walks bypass it.
+class UnwindCache {
+public:
+  enum {
+    MAX_CHECKPOINTS = 64,
+    // frame records above a matching one checked before splicing
+    VERIFY_DEPTH = 3
+  };
+
+private:
+  UnwindCheckpoint _checkpoints[MAX_CHECKPOINTS];
+  int _count;
+  // where the walk above the last checkpoint ended
+  const void *_java_pc;
+  uintptr_t _java_sp;
+  uintptr_t _java_fp;
+  volatile bool _busy;
+
+public:
+  UnwindCache()
+      : _count(0), _java_pc(NULL), _java_sp(0), _java_fp(0), _busy(false) {}
+
+  bool acquire() {
+    if (_busy) {
+      return false;
+    }
+    _busy = true;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    return true;
+  }
+
+  void release() {
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    _busy = false;
+  }
+
+  int count() const { return _count; }
+
+  const UnwindCheckpoint &checkpoint(int index) const {
+    return _checkpoints[index];
+  }
+
+  const void *javaPC() const { return _java_pc; }
+  uintptr_t javaSP() const { return _java_sp; }
+  uintptr_t javaFP() const { return _java_fp; }
+
+  // Returns the index of the checkpoint describing the given frame record, or
+  // -1 if the record was not part of the last walk or has changed since
+  int find(uintptr_t fp, uintptr_t saved_fp, const void *pc) const {
+    // frame records are at increasing addresses from the innermost frame
+    int low = 0;
+    int high = _count - 1;
+    while (low <= high) {
+      int mid = (unsigned int)(low + high) >> 1;
+      if (_checkpoints[mid].fp < fp) {
+        low = mid + 1;
+      } else if (_checkpoints[mid].fp > fp) {
+        high = mid - 1;
+      } else {
+        return _checkpoints[mid].saved_fp == saved_fp &&
+                       _checkpoints[mid].pc == pc
+                   ? mid
+                   : -1;
+      }
+    }
+    return -1;
+  }
+
+  // Checks that the frame records of the checkpoints following 'from' still
+  // hold the cached saved frame pointers and return addresses. A frame record
+  // left in place by a returned caller may match by chance while the frames
+  // above it belong to a different call path.
+  bool verify(int from) const {
+    int last = from + VERIFY_DEPTH < _count - 1 ? from + VERIFY_DEPTH : _count - 1;
+    for (int i = from + 1; i <= last; i++) {
+      const UnwindCheckpoint &cp = _checkpoints[i];
+      if (((uintptr_t *)cp.fp)[0] != cp.saved_fp ||
+          returnAddress(((const void **)cp.fp)[1]) != cp.pc) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Replaces the cached chain with the frames walked this time followed by
+  // the cached checkpoints starting at 'from' (none if 'from' is negative)
+  void update(const UnwindCheckpoint *walked, int walked_count, int from,
+              const void *java_pc, uintptr_t java_sp, uintptr_t java_fp) {
+    int suffix = from >= 0 ? _count - from : 0;
+    if (walked_count + suffix > MAX_CHECKPOINTS) {
+      _count = 0;
+      return;
+    }
+    if (suffix > 0) {
+      memmove(_checkpoints + walked_count, _checkpoints + from,
+              suffix * sizeof(UnwindCheckpoint));
+    }
+    memcpy(_checkpoints, walked, walked_count * sizeof(UnwindCheckpoint));
+    _count = walked_count + suffix;
+    _java_pc = java_pc;
+    _java_sp = java_sp;
+    _java_fp = java_fp;
+  }
+
+  void clear() { _count = 0; }
+};
+
+#endif // _UNWINDCACHE_H
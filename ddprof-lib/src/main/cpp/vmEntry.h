@@ -32,6 +32,7 @@ enum ASGCT_CallFrameType {
   BCI_PARK = -16,               // class name of the park() blocker
   BCI_THREAD_ID = -17,          // method_id designates a thread
   BCI_ERROR = -18,              // method_id is an error string
+  BCI_NATIVE_PC = -19,          // unresolved native frame address (void*)
 };
 
 // See hotspot/src/share/vm/prims/forte.cpp
@@ -17,6 +17,8 @@
 #include "wallClock.h"
 #include "stackFrame.h"
 #include "context.h"
+#include "ctimer.h"
+#include "counters.h"
 #include "debugSupport.h"
 #include "libraries.h"
 #include "log.h"
@@ -26,6 +28,11 @@
 #include "vmStructs_dd.h"
 #include <math.h>
 #include <random>
+#ifdef __linux__
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
 
 std::atomic<bool> BaseWallClock::_enabled{false};
 
@@ -70,7 +77,7 @@ void WallClockASGCT::signalHandler(int signo, siginfo_t *siginfo, void *ucontext
   u32 call_trace_id = 0;
   if (current != NULL && _collapsing) {
     StackFrame frame(ucontext);
-    Context &context = Contexts::get(tid);
+    Context context = Contexts::get(tid);
     call_trace_id = current->lookupWallclockCallTraceId(
         (u64)frame.pc(), Profiler::instance()->recordingEpoch(),
         context.spanId);
@@ -105,6 +112,10 @@ void WallClockASGCT::signalHandler(int signo, siginfo_t *siginfo, void *ucontext
   event._thread_state = state;
   event._execution_mode = mode;
   event._weight = 1;
+  event._sampling_interval = samplingInterval(tid);
+  if (_schedstat && current != NULL) {
+    current->schedStatDelta(&event._on_cpu_time, &event._run_queue_time);
+  }
   Profiler::instance()->recordSample(ucontext, last_sample, tid, BCI_WALL,
                                      call_trace_id, &event);
   Shims::instance().setSighandlerTid(-1);
@@ -116,8 +127,9 @@ Error BaseWallClock::start(Arguments &args) {
     return Error("interval must be positive");
   }
   _interval = interval ? interval : DEFAULT_WALL_INTERVAL;
+  _sample_interval = _interval;
 
-    _reservoir_size =
+    _reservoir_size = _configured_reservoir_size =
             args._wall_threads_per_tick ?
             args._wall_threads_per_tick
                                                 : DEFAULT_WALL_THREADS_PER_TICK;
@@ -150,6 +162,10 @@ bool BaseWallClock::isEnabled() const {
 
 void WallClockASGCT::initialize(Arguments& args) {
   _collapsing = args._wall_collapsing;
+  _schedstat = args._schedstat;
+  if (_schedstat) {
+    ProfiledThread::resetSchedStats();
+  }
   OS::installSignalHandler(SIGVTALRM, sharedSignalHandler);
 }
 
@@ -190,32 +206,47 @@ void WallClockJVMTI::timerLoop() {
         jvmti->Deallocate((unsigned char*)threads_ptr);
     };
 
-  auto sampleThreads = [&](ThreadEntry& thread_entry, int& num_failures, int& threads_already_exited, int& permission_denied) {
+  std::vector<jthread> java_threads;
+  std::vector<ExecutionEvent> events;
+  auto sampleThreads = [&](std::vector<ThreadEntry>& sample, int& num_failures, int& threads_already_exited, int& permission_denied) {
     static jint max_stack_depth = (jint)Profiler::instance()->max_stack_depth();
+    if (sample.empty()) {
+      return;
+    }
 
-    ExecutionEvent event;
-    ddprof::VMThread* vm_thread = thread_entry.native;
-    int raw_thread_state = vm_thread->state();
-    bool is_initialized = raw_thread_state >= ddprof::JVMJavaThreadState::_thread_in_native &&
-                          raw_thread_state < ddprof::JVMJavaThreadState::_thread_max_state;
-    OSThreadState state = OSThreadState::UNKNOWN;
-    ExecutionMode mode = ExecutionMode::UNKNOWN;
-    if (vm_thread && is_initialized) {
-      OSThreadState os_state = vm_thread->osThreadState();
-      if (os_state != OSThreadState::UNKNOWN) {
-        state = os_state;
-      }
-      mode = convertJvmExecutionState(raw_thread_state);
+    // Thread states are taken before the stacks are, as close as possible to
+    // the moment of sampling
+    java_threads.clear();
+    events.assign(sample.size(), ExecutionEvent());
+    for (size_t i = 0; i < sample.size(); i++) {
+      java_threads.push_back(sample[i].java);
+      fillExecutionEvent(sample[i].native, events[i]);
+      events[i]._sampling_interval = samplingInterval(sample[i].native->osThreadId());
     }
-    if (state == OSThreadState::UNKNOWN) {
-      state = OSThreadState::RUNNABLE;
+
+    // One JVMTI call captures the stacks of all the sampled threads, instead
+    // of an operation on each thread in turn
+    jvmtiStackInfo* stack_info = nullptr;
+    u64 start_time = TSC::ticks();
+    jvmtiError err = VM::jvmti()->GetThreadListStackTraces(
+        (jint)java_threads.size(), java_threads.data(), max_stack_depth, &stack_info);
+    Counters::increment(UNWINDING_TIME_JVMTI, TSC::ticks() - start_time);
+    if (err != JVMTI_ERROR_NONE) {
+      num_failures += sample.size();
+      return;
     }
-    event._thread_state = state;
-    event._execution_mode = mode;
-    event._weight =  1;
 
-    Profiler::instance()->recordJVMTISample(1, thread_entry.native->osThreadId(), thread_entry.java, BCI_WALL, &event, false);
-    return true;
+    for (size_t i = 0; i < sample.size(); i++) {
+      jvmtiStackInfo& info = stack_info[i];
+      if ((info.state & JVMTI_THREAD_STATE_ALIVE) == 0) {
+        // not alive (anymore)
+        num_failures++;
+        threads_already_exited++;
+        continue;
+      }
+      Profiler::instance()->recordJVMTISample(1, sample[i].native->osThreadId(), info.frame_buffer, info.frame_count, BCI_WALL, &events[i]);
+    }
+    VM::jvmti()->Deallocate((unsigned char*)stack_info);
   };
 
   timerLoopCommon<ThreadEntry>(collectThreads, sampleThreads, _reservoir_size, _interval);
@@ -223,6 +254,27 @@ void WallClockJVMTI::timerLoop() {
   VM::detachThread();
 }
 
+void WallClockJVMTI::fillExecutionEvent(ddprof::VMThread* vm_thread, ExecutionEvent& event) {
+  int raw_thread_state = vm_thread->state();
+  bool is_initialized = raw_thread_state >= ddprof::JVMJavaThreadState::_thread_in_native &&
+                        raw_thread_state < ddprof::JVMJavaThreadState::_thread_max_state;
+  OSThreadState state = OSThreadState::UNKNOWN;
+  ExecutionMode mode = ExecutionMode::UNKNOWN;
+  if (vm_thread && is_initialized) {
+    OSThreadState os_state = vm_thread->osThreadState();
+    if (os_state != OSThreadState::UNKNOWN) {
+      state = os_state;
+    }
+    mode = convertJvmExecutionState(raw_thread_state);
+  }
+  if (state == OSThreadState::UNKNOWN) {
+    state = OSThreadState::RUNNABLE;
+  }
+  event._thread_state = state;
+  event._execution_mode = mode;
+  event._weight =  1;
+}
+
 void WallClockASGCT::timerLoop() {
     auto collectThreads = [&](std::vector<int>& tids) {
       if (Profiler::instance()->threadFilter()->enabled()) {
@@ -240,22 +292,152 @@ void WallClockASGCT::timerLoop() {
       }
     };
 
-    auto sampleThreads = [&](int tid, int& num_failures, int& threads_already_exited, int& permission_denied) {
-      if (!OS::sendSignalToThread(tid, SIGVTALRM)) {
-        num_failures++;
-        if (errno != 0) {
-          if (errno == ESRCH) {
-              threads_already_exited++;
-          } else if (errno == EPERM) {
-              permission_denied++;
-          } else {
-              Log::debug("unexpected error %s", strerror(errno));
+    auto sampleThreads = [&](std::vector<int>& sample, int& num_failures, int& threads_already_exited, int& permission_denied) {
+      for (int tid : sample) {
+        if (!OS::sendSignalToThread(tid, SIGVTALRM)) {
+          num_failures++;
+          if (errno != 0) {
+            if (errno == ESRCH) {
+                threads_already_exited++;
+            } else if (errno == EPERM) {
+                permission_denied++;
+            } else {
+                Log::debug("unexpected error %s", strerror(errno));
+            }
           }
         }
-        return false;
       }
-      return true;
     };
 
     timerLoopCommon<int>(collectThreads, sampleThreads, _reservoir_size, _interval);
 }
+
+#ifdef __linux__
+
+void WallClockTimer::timerSignalHandler(int signo, siginfo_t *siginfo,
+                                        void *ucontext) {
+  int saved_errno = errno;
+  WallClockTimer *engine =
+      reinterpret_cast<WallClockTimer *>(Profiler::instance()->wallEngine());
+  if (engine->isEnabled()) {
+    // a thread may leave the filter before its timer is disarmed
+    ThreadFilter *thread_filter = Profiler::instance()->threadFilter();
+    if (!thread_filter->enabled() ||
+        thread_filter->accept(ProfiledThread::currentTid())) {
+      engine->signalHandler(signo, siginfo, ucontext, engine->_interval);
+    }
+  }
+  errno = saved_errno;
+}
+
+void WallClockTimer::initialize(Arguments &args) {
+  WallClockASGCT::initialize(args);
+  OS::installSignalHandler(SIGVTALRM, timerSignalHandler);
+}
+
+Error WallClockTimer::check(Arguments &args) {
+  if (!ThreadHook::supported()) {
+    return Error("Could not set pthread hook");
+  }
+  return Error::OK;
+}
+
+Error WallClockTimer::start(Arguments &args) {
+  int interval = args._event != NULL ? args._interval : args._wall;
+  if (interval < 0) {
+    return Error("interval must be positive");
+  }
+  _interval = interval ? interval : DEFAULT_WALL_INTERVAL;
+  _sample_interval = _interval;
+
+  int max_timers = OS::getMaxThreadId();
+  if (max_timers != _max_timers) {
+    free(_timers);
+    _timers = (int *)calloc(max_timers, sizeof(int));
+    _max_timers = max_timers;
+  }
+
+  initialize(args);
+
+  // Enable pthread hook before traversing currently running threads
+  if (!ThreadHook::install()) {
+    return Error("Could not set pthread hook");
+  }
+  _running = true;
+  int self = OS::threadId();
+  ThreadList *thread_list = OS::listThreads();
+  for (int tid; (tid = thread_list->next()) != -1;) {
+    if (tid != self) {
+      registerThread(tid);
+    }
+  }
+  delete thread_list;
+
+  return Error::OK;
+}
+
+void WallClockTimer::stop() {
+  _running = false;
+  ThreadHook::uninstall();
+  for (int i = 0; i < _max_timers; i++) {
+    unregisterThread(i);
+  }
+}
+
+int WallClockTimer::registerThread(int tid) {
+  if (!_running) {
+    return -1;
+  }
+  if (tid >= _max_timers) {
+    Log::warn("tid[%d] > pid_max[%d]. Restart profiler after changing pid_max",
+              tid, _max_timers);
+    return -1;
+  }
+  // The signals of the threads outside of the filter would be discarded by
+  // the handler: with thousands of threads and a filter of a few, arming them
+  // all costs a signal per thread and interval for nothing
+  ThreadFilter *thread_filter = Profiler::instance()->threadFilter();
+  if (thread_filter->enabled() && !thread_filter->accept(tid)) {
+    return 0;
+  }
+
+  int timer = createThreadTimer(CLOCK_MONOTONIC, tid, SIGVTALRM);
+  if (timer < 0) {
+    return -1;
+  }
+
+  // Kernel timer ID may start with zero, but we use zero as an empty slot
+  if (!__sync_bool_compare_and_swap(&_timers[tid], 0, timer + 1)) {
+    // Lost race
+    syscall(__NR_timer_delete, timer);
+    return -1;
+  }
+  if (!_running) {
+    // stop() may have passed this slot already
+    unregisterThread(tid);
+    return -1;
+  }
+
+  // A random first expiration spreads the threads over the whole interval
+  u64 phase =
+      1 + ((u64)tid * 0x9e3779b97f4a7c15ULL + OS::nanotime()) % _interval;
+  struct itimerspec ts;
+  ts.it_interval.tv_sec = (time_t)(_interval / 1000000000);
+  ts.it_interval.tv_nsec = _interval % 1000000000;
+  ts.it_value.tv_sec = (time_t)(phase / 1000000000);
+  ts.it_value.tv_nsec = phase % 1000000000;
+  syscall(__NR_timer_settime, timer, 0, &ts, NULL);
+  return 0;
+}
+
+void WallClockTimer::unregisterThread(int tid) {
+  if (tid >= _max_timers) {
+    return;
+  }
+  int timer = __atomic_load_n(&_timers[tid], __ATOMIC_ACQUIRE);
+  if (timer != 0 && __sync_bool_compare_and_swap(&_timers[tid], timer--, 0)) {
+    syscall(__NR_timer_delete, timer);
+  }
+}
+
+#endif // __linux__
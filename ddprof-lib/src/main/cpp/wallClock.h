@@ -17,6 +17,7 @@
 #ifndef _WALLCLOCK_H
 #define _WALLCLOCK_H
 
+#include "bursts.h"
 #include "engine.h"
 #include "os.h"
 #include "profiler.h"
@@ -25,11 +26,13 @@
 #include "threadState.h"
 #include "tsc.h"
 #include "vmStructs_dd.h"
+#include <algorithm>
+
+inline int sampledTid(int tid) { return tid; }
 
 class BaseWallClock : public Engine {
   private:
     static std::atomic<bool> _enabled;
-    std::atomic<bool> _running;
   protected:
     long _interval;
     // Maximum number of threads sampled in one iteration. This limit serves as a
@@ -38,6 +41,12 @@ class BaseWallClock : public Engine {
     // limit low enough helps to avoid contention on a spin lock inside
     // Profiler::recordSample().
     int _reservoir_size;
+    int _configured_reservoir_size;
+    // The expected time between two samples of a thread which is not in a
+    // burst, longer than the interval when the reservoir leaves threads out
+    u64 _sample_interval;
+    // Cleared by stop() to end the sampling loop, or the arming of new timers
+    std::atomic<bool> _running;
 
       pthread_t _thread;
       virtual void timerLoop() = 0;
@@ -50,6 +59,38 @@ class BaseWallClock : public Engine {
 
     bool isEnabled() const;
 
+    u64 samplingInterval(int tid) const {
+      return Bursts::factor(tid, OS::nanotime()) > 1
+                 ? _interval
+                 : __atomic_load_n(&_sample_interval, __ATOMIC_RELAXED);
+    }
+
+    // Threads in a burst are sampled on every tick instead of whenever the
+    // reservoir picks them
+    template <typename ThreadType>
+    static void addBursts(const std::vector<ThreadType>& threads, std::vector<ThreadType>& sample,
+                          std::vector<int>& burst_tids) {
+      burst_tids.clear();
+      Bursts::collect(burst_tids, OS::nanotime());
+      if (burst_tids.empty()) {
+        return;
+      }
+      size_t sampled = sample.size();
+      for (const ThreadType& thread : threads) {
+        int tid = sampledTid(thread);
+        if (std::find(burst_tids.begin(), burst_tids.end(), tid) == burst_tids.end()) {
+          continue;
+        }
+        bool in_sample = false;
+        for (size_t i = 0; i < sampled && !in_sample; i++) {
+          in_sample = sampledTid(sample[i]) == tid;
+        }
+        if (!in_sample) {
+          sample.push_back(thread);
+        }
+      }
+    }
+
     template <typename ThreadType, typename CollectThreadsFunc, typename SampleThreadsFunc>
     void timerLoopCommon(CollectThreadsFunc collectThreads, SampleThreadsFunc sampleThreads, int reservoirSize, u64 interval) {
       if (!_enabled.load(std::memory_order_acquire)) {
@@ -65,6 +106,7 @@ class BaseWallClock : public Engine {
 
       std::vector<ThreadType> threads;
       threads.reserve(reservoirSize);
+      std::vector<int> burst_tids;
       int self = OS::threadId();
       ThreadFilter* thread_filter = Profiler::instance()->threadFilter();
       thread_filter->remove(self);
@@ -80,12 +122,20 @@ class BaseWallClock : public Engine {
         int num_failures = 0;
         int threads_already_exited = 0;
         int permission_denied = 0;
+        int reservoir_size = __atomic_load_n(&_reservoir_size, __ATOMIC_RELAXED);
+        if (reservoir_size != reservoir.size()) {
+          reservoir.resize(reservoir_size);
+        }
         std::vector<ThreadType> sample = reservoir.sample(threads);
-        for (ThreadType thread : sample) {
-          if (!sampleThreads(thread, num_failures, threads_already_exited, permission_denied)) {
-            continue;
-          }
+        if (threads.size() > (size_t)reservoir_size) {
+          __atomic_store_n(&_sample_interval, _interval * threads.size() / reservoir_size, __ATOMIC_RELAXED);
+        } else {
+          __atomic_store_n(&_sample_interval, (u64)_interval, __ATOMIC_RELAXED);
+        }
+        if (Bursts::active()) {
+          addBursts(threads, sample, burst_tids);
         }
+        sampleThreads(sample, num_failures, threads_already_exited, permission_denied);
 
         epoch.updateNumSamplableThreads(threads.size());
         epoch.updateNumFailedSamples(num_failures);
@@ -115,6 +165,8 @@ public:
   BaseWallClock() :
         _interval(LONG_MAX),
         _reservoir_size(0),
+        _configured_reservoir_size(0),
+        _sample_interval(0),
         _running(false),
         _thread(0) {}
     virtual ~BaseWallClock() = default;
@@ -127,6 +179,14 @@ public:
 
   long interval() const { return _interval; }
 
+  // The interval stays the same, fewer threads are sampled on each tick.
+  // Returns the number of threads sampled per tick.
+  long setRateScale(double scale) override {
+    int size = std::max(1, (int)(_configured_reservoir_size / scale));
+    __atomic_store_n(&_reservoir_size, size, __ATOMIC_RELAXED);
+    return size;
+  }
+
   inline void enableEvents(bool enabled) {
         _enabled.store(enabled, std::memory_order_release);
     }
@@ -138,17 +198,20 @@ public:
 class WallClockASGCT : public BaseWallClock {
   private:
     bool _collapsing;
+    bool _schedstat;
 
     static bool inSyscall(void* ucontext);
 
     static void sharedSignalHandler(int signo, siginfo_t* siginfo, void* ucontext);
-    void signalHandler(int signo, siginfo_t* siginfo, void* ucontext, u64 last_sample);
 
-    void initialize(Arguments& args) override;
     void timerLoop() override;
 
+  protected:
+    void signalHandler(int signo, siginfo_t* siginfo, void* ucontext, u64 last_sample);
+    void initialize(Arguments& args) override;
+
   public:
-    WallClockASGCT() : BaseWallClock(), _collapsing(false) {}
+    WallClockASGCT() : BaseWallClock(), _collapsing(false), _schedstat(false) {}
     const char* name() override {
         return "WallClock (ASGCT)";
     }
@@ -157,6 +220,7 @@ class WallClockASGCT : public BaseWallClock {
 class WallClockJVMTI : public BaseWallClock {
   private:
     void timerLoop() override;
+    static void fillExecutionEvent(ddprof::VMThread* vm_thread, ExecutionEvent& event);
   public:
     struct ThreadEntry {
         ddprof::VMThread* native;
@@ -168,4 +232,47 @@ class WallClockJVMTI : public BaseWallClock {
   }
 };
 
+inline int sampledTid(const WallClockJVMTI::ThreadEntry& entry) {
+    return entry.native->osThreadId();
+}
+
+#ifdef __linux__
+
+// Arms a CLOCK_MONOTONIC timer for each thread instead of signalling the
+// sampled threads from a timer thread, so that the kernel spreads the signal
+// delivery and there is no central thread to fall behind. Every thread is
+// sampled once per interval, with a random phase.
+class WallClockTimer : public WallClockASGCT {
+  private:
+    int _max_timers;
+    int* _timers;
+
+    static void timerSignalHandler(int signo, siginfo_t* siginfo, void* ucontext);
+
+    void initialize(Arguments& args) override;
+
+  public:
+    WallClockTimer() : WallClockASGCT(), _max_timers(0), _timers(NULL) {}
+    const char* name() override {
+        return "WallClock (timer)";
+    }
+
+    Error check(Arguments& args) override;
+    Error start(Arguments& args) override;
+    void stop() override;
+
+    // Arms the timer of the thread, unless a thread filter is active and the
+    // thread is not part of it. Threads entering or leaving the filter are
+    // (un)registered again, so only the filtered threads are signalled.
+    int registerThread(int tid) override;
+    void unregisterThread(int tid) override;
+
+    // Every thread has its own timer, there is no reservoir to shrink
+    long setRateScale(double scale) override {
+        return -1;
+    }
+};
+
+#endif // __linux__
+
 #endif // _WALLCLOCK_H
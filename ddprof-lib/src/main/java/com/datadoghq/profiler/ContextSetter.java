@@ -41,6 +41,67 @@ public class ContextSetter {
         return 0;
     }
 
+    /**
+     * Encodes the values by attribute offset, interning all values missing from the cache
+     * with a single native call
+     * @param values the values by attribute offset, null values are encoded as 0
+     * @return the encodings, -1 for values which could not be encoded
+     */
+    public int[] encode(String[] values) {
+        int[] encodings = new int[Math.min(values.length, attributes.size())];
+        String[] misses = null;
+        for (int i = 0; i < encodings.length; i++) {
+            String value = values[i];
+            if (value != null) {
+                Integer encoding = jniCache.get(value);
+                if (encoding != null) {
+                    encodings[i] = encoding;
+                } else if (jniCache.size() <= 1 << 16) {
+                    if (misses == null) {
+                        misses = new String[encodings.length];
+                    }
+                    misses[i] = value;
+                } else {
+                    encodings[i] = -1;
+                }
+            }
+        }
+        if (misses != null) {
+            int[] registered = new int[misses.length];
+            profiler.registerConstants(misses, registered);
+            for (int i = 0; i < misses.length; i++) {
+                if (misses[i] != null) {
+                    int e = registered[i];
+                    if (e > 0) {
+                        jniCache.putIfAbsent(misses[i], e);
+                    }
+                    encodings[i] = e;
+                }
+            }
+        }
+        return encodings;
+    }
+
+    /**
+     * Sets the span, root span and all attribute values of the current thread at once
+     * @param spanId the span identifier
+     * @param rootSpanId the root span identifier
+     * @param values the values by attribute offset, missing and null values clear the attribute
+     * @return false if any of the values could not be encoded, in which case that attribute is cleared
+     */
+    public boolean setContext(long spanId, long rootSpanId, String[] values) {
+        int[] encodings = encode(values);
+        boolean encoded = true;
+        for (int i = 0; i < encodings.length; i++) {
+            if (encodings[i] < 0) {
+                encodings[i] = 0;
+                encoded = false;
+            }
+        }
+        profiler.setContext(spanId, rootSpanId, encodings);
+        return encoded;
+    }
+
     public int[] snapshotTags() {
         int[] snapshot = new int[attributes.size()];
         snapshotTags(snapshot);
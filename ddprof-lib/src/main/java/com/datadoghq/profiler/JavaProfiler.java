@@ -55,13 +55,17 @@ public final class JavaProfiler {
         static final long FREQUENCY = tscFrequency0();
     }
     private static JavaProfiler instance;
-    private static final int CONTEXT_SIZE = 64;
+    // must be kept in sync with ContextSlot and Context in context.h
+    private static final int CONTEXT_SIZE = 128;
     // must be kept in sync with PAGE_SIZE in context.h
     private static final int PAGE_SIZE = 1024;
+    private static final int SEQUENCE_OFFSET = 0;
+    private static final int COPY_OFFSET = 8;
+    private static final int COPY_SIZE = 56;
     private static final int SPAN_OFFSET = 0;
     private static final int ROOT_SPAN_OFFSET = 8;
-    private static final int CHECKSUM_OFFSET = 16;
-    private static final int DYNAMIC_TAGS_OFFSET = 24;
+    private static final int DYNAMIC_TAGS_OFFSET = 16;
+    private static final int DYNAMIC_TAGS_CAPACITY = 10;
     private static final ThreadLocal<Integer> TID = ThreadLocal.withInitial(JavaProfiler::getTid0);
 
     private ByteBuffer[] contextStorage;
@@ -202,6 +206,29 @@ public final class JavaProfiler {
         return recordTrace0(rootSpanId, endpoint, null, sizeLimit);
     }
 
+    /**
+     * Samples the current thread {@code factor} times as often as the other threads for a
+     * limited time, e.g. while it serves a request found to be slow. CPU samples are taken
+     * at the higher rate; wall clock samples of the thread are taken on every tick, even
+     * when the wall clock sampler leaves threads out. The {@code samplingInterval} field of
+     * the samples tells them apart from the regular ones.
+     *
+     * @param spanId the burst ends as soon as the thread leaves this span; 0 not to bind it to a span
+     * @param durationNanos the burst ends after this time at the latest
+     * @param factor the rate factor, between 2 and 100
+     * @return false if too many threads are already in a burst
+     * @throws IllegalArgumentException if the duration or factor is out of range
+     */
+    public boolean startBurst(long spanId, long durationNanos, int factor) {
+        if (durationNanos <= 0) {
+            throw new IllegalArgumentException("durationNanos must be positive");
+        }
+        if (factor < 2 || factor > 100) {
+            throw new IllegalArgumentException("factor must be between 2 and 100");
+        }
+        return startBurst0(TID.get(), spanId, durationNanos, factor);
+    }
+
     /**
      * Add the given thread to the set of profiled threads.
      * 'filter' option must be enabled to use this method.
@@ -229,37 +256,84 @@ public final class JavaProfiler {
     public void setContext(long spanId, long rootSpanId) {
         int tid = TID.get();
         if (UNSAFE != null) {
-            setContextJDK8(tid, spanId, rootSpanId);
+            setContextJDK8(tid, spanId, rootSpanId, null);
+        } else {
+            setContextByteBuffer(tid, spanId, rootSpanId, null);
+        }
+    }
+
+    /**
+     * Sets the span, root span and all tag encodings of the current thread at once.
+     * The signal handler observes either the previous or the new context, never a mix of both.
+     * Tags not covered by {@code encodings} are cleared.
+     *
+     * @param spanId Span identifier that should be stored for current thread
+     * @param rootSpanId Root Span identifier that should be stored for current thread
+     * @param encodings the tag encodings by offset, obtained via @see JavaProfiler#registerConstant
+     */
+    public void setContext(long spanId, long rootSpanId, int[] encodings) {
+        if (encodings == null) {
+            throw new NullPointerException();
+        }
+        int tid = TID.get();
+        if (UNSAFE != null) {
+            setContextJDK8(tid, spanId, rootSpanId, encodings);
         } else {
-            setContextByteBuffer(tid, spanId, rootSpanId);
+            setContextByteBuffer(tid, spanId, rootSpanId, encodings);
         }
     }
 
-    private void setContextJDK8(int tid, long spanId, long rootSpanId) {
+    // The context slot holds two copies of the context and a sequence number selecting the
+    // published one. Writers fill the other copy and publish it by incrementing the sequence,
+    // so the signal handler never reads a copy while it is being written (see context.h).
+
+    private void setContextJDK8(int tid, long spanId, long rootSpanId, int[] encodings) {
         if (contextBaseOffsets == null) {
             return;
         }
-        long pageOffset = getPageUnsafe(tid);
-        int index = (tid % PAGE_SIZE) * CONTEXT_SIZE;
-        long base = pageOffset + index;
-        UNSAFE.putLong(base + SPAN_OFFSET, spanId);
-        UNSAFE.putLong(base + ROOT_SPAN_OFFSET, rootSpanId);
-        UNSAFE.putLong(base + CHECKSUM_OFFSET, spanId ^ rootSpanId);
+        long slot = getPageUnsafe(tid) + (long) (tid % PAGE_SIZE) * CONTEXT_SIZE;
+        long sequence = UNSAFE.getLong(slot + SEQUENCE_OFFSET);
+        long next = slot + copyOffset(sequence + 1);
+        if (encodings == null) {
+            UNSAFE.copyMemory(slot + copyOffset(sequence) + DYNAMIC_TAGS_OFFSET,
+                    next + DYNAMIC_TAGS_OFFSET, DYNAMIC_TAGS_CAPACITY * Integer.BYTES);
+        } else {
+            for (int i = 0; i < DYNAMIC_TAGS_CAPACITY; i++) {
+                UNSAFE.putInt(next + DYNAMIC_TAGS_OFFSET + i * Integer.BYTES,
+                        i < encodings.length ? encodings[i] : 0);
+            }
+        }
+        UNSAFE.putLong(next + SPAN_OFFSET, spanId);
+        UNSAFE.putLong(next + ROOT_SPAN_OFFSET, rootSpanId);
+        UNSAFE.putOrderedLong(null, slot + SEQUENCE_OFFSET, sequence + 1);
     }
 
-    private void setContextByteBuffer(int tid, long spanId, long rootSpanId) {
+    private void setContextByteBuffer(int tid, long spanId, long rootSpanId, int[] encodings) {
         if (contextStorage == null) {
             return;
         }
         ByteBuffer page = getPage(tid);
-        int index = (tid % PAGE_SIZE) * CONTEXT_SIZE;
-        page.putLong(index + SPAN_OFFSET, spanId);
-        page.putLong(index + ROOT_SPAN_OFFSET, rootSpanId);
-        page.putLong(index + CHECKSUM_OFFSET, spanId ^ rootSpanId);
+        int slot = (tid % PAGE_SIZE) * CONTEXT_SIZE;
+        long sequence = page.getLong(slot + SEQUENCE_OFFSET);
+        int current = slot + copyOffset(sequence);
+        int next = slot + copyOffset(sequence + 1);
+        for (int i = 0; i < DYNAMIC_TAGS_CAPACITY; i++) {
+            int address = DYNAMIC_TAGS_OFFSET + i * Integer.BYTES;
+            int value;
+            if (encodings == null) {
+                value = page.getInt(current + address);
+            } else {
+                value = i < encodings.length ? encodings[i] : 0;
+            }
+            page.putInt(next + address, value);
+        }
+        page.putLong(next + SPAN_OFFSET, spanId);
+        page.putLong(next + ROOT_SPAN_OFFSET, rootSpanId);
+        // there are no ordered writes on a ByteBuffer, but the sequence is written last
+        // in program order, which is what a signal handler on this thread observes
+        page.putLong(slot + SEQUENCE_OFFSET, sequence + 1);
     }
 
-
-
     private ByteBuffer getPage(int tid) {
         int pageIndex = tid / PAGE_SIZE;
         ByteBuffer page = contextStorage[pageIndex];
@@ -304,8 +378,12 @@ public final class JavaProfiler {
         if (contextBaseOffsets == null) {
             return;
         }
-        long pageOffset = getPageUnsafe(tid);
-        UNSAFE.putInt(pageOffset + addressOf(tid, offset), value);
+        long slot = getPageUnsafe(tid) + (long) (tid % PAGE_SIZE) * CONTEXT_SIZE;
+        long sequence = UNSAFE.getLong(slot + SEQUENCE_OFFSET);
+        long next = slot + copyOffset(sequence + 1);
+        UNSAFE.copyMemory(slot + copyOffset(sequence), next, COPY_SIZE);
+        UNSAFE.putInt(next + tagOffset(offset), value);
+        UNSAFE.putOrderedLong(null, slot + SEQUENCE_OFFSET, sequence + 1);
     }
 
     public void setContextByteBuffer(int tid, int offset, int value) {
@@ -313,7 +391,15 @@ public final class JavaProfiler {
             return;
         }
         ByteBuffer page = getPage(tid);
-        page.putInt(addressOf(tid, offset), value);
+        int slot = (tid % PAGE_SIZE) * CONTEXT_SIZE;
+        long sequence = page.getLong(slot + SEQUENCE_OFFSET);
+        int current = slot + copyOffset(sequence);
+        int next = slot + copyOffset(sequence + 1);
+        for (int i = 0; i < COPY_SIZE; i += Long.BYTES) {
+            page.putLong(next + i, page.getLong(current + i));
+        }
+        page.putInt(next + tagOffset(offset), value);
+        page.putLong(slot + SEQUENCE_OFFSET, sequence + 1);
     }
 
     void copyTags(int[] snapshot) {
@@ -329,8 +415,8 @@ public final class JavaProfiler {
         if (contextBaseOffsets == null) {
             return;
         }
-        long pageOffset = getPageUnsafe(tid);
-        long address = pageOffset + addressOf(tid, 0);
+        long slot = getPageUnsafe(tid) + (long) (tid % PAGE_SIZE) * CONTEXT_SIZE;
+        long address = slot + copyOffset(UNSAFE.getLong(slot + SEQUENCE_OFFSET)) + tagOffset(0);
         for (int i = 0; i < snapshot.length; i++) {
             snapshot[i] = UNSAFE.getInt(address);
             address += Integer.BYTES;
@@ -342,14 +428,19 @@ public final class JavaProfiler {
             return;
         }
         ByteBuffer page = getPage(tid);
-        int address = addressOf(tid, 0);
+        int slot = (tid % PAGE_SIZE) * CONTEXT_SIZE;
+        int address = slot + copyOffset(page.getLong(slot + SEQUENCE_OFFSET)) + tagOffset(0);
         for (int i = 0; i < snapshot.length; i++) {
             snapshot[i] = page.getInt(address + i * Integer.BYTES);
         }
     }
 
-    private static int addressOf(int tid, int offset) {
-        return ((tid % PAGE_SIZE) * CONTEXT_SIZE + DYNAMIC_TAGS_OFFSET)
+    private static int copyOffset(long sequence) {
+        return COPY_OFFSET + (int) (sequence & 1) * COPY_SIZE;
+    }
+
+    private static int tagOffset(int offset) {
+        return DYNAMIC_TAGS_OFFSET
                 // TODO - we want to limit cardinality and a great way to enforce that is with the size of these
                 //  fields to a smaller type, say, u16. This would also allow us to pack more data into each thread's
                 //  slot. However, the current implementation of the dictionary trades monotonicity and minimality for
@@ -366,6 +457,15 @@ public final class JavaProfiler {
         return registerConstant0(key);
     }
 
+    /**
+     * Registers several constants with a single native call
+     * @param keys the keys to be written into the attribute value constant pool, null keys are encoded as 0
+     * @param encodings receives the encoding of each key, or -1 if the constant pool is full
+     */
+    void registerConstants(String[] keys, int[] encodings) {
+        registerConstants0(keys, encodings);
+    }
+
     /**
      * Dumps the JFR recording at the provided path
      * @param recording the path to the recording
@@ -375,6 +475,18 @@ public final class JavaProfiler {
         dump0(recording.toAbsolutePath().toString());
     }
 
+    /**
+     * Writes the chunks kept in memory by a ring recording, started with the 'ring' option,
+     * to the provided path. The ring keeps its content and profiling goes on, so this can be
+     * called when an incident is detected to capture the profile of the preceding period.
+     * @param recording the path to the recording
+     * @throws IllegalStateException if the recording is not a ring
+     * @throws NullPointerException if recording is null
+     */
+    public void dumpRing(Path recording) {
+        dumpRing0(recording.toAbsolutePath().toString());
+    }
+
     /**
      * Records a datadog.ProfilerSetting event with no unit
      * @param name the name
@@ -433,10 +545,11 @@ public final class JavaProfiler {
      */
     public Map<String, Long> getDebugCounters() {
         Map<String, Long> counters = new HashMap<>();
-        ByteBuffer buffer = getDebugCounters0().order(ByteOrder.LITTLE_ENDIAN);
-        if (buffer.hasRemaining()) {
-            String[] names = describeDebugCounters0();
-            for (int i = 0; i < names.length && i * 128 < buffer.capacity(); i++) {
+        String[] names = describeDebugCounters0();
+        // each caller sums the counters into its own buffer, 128 bytes apart
+        ByteBuffer buffer = ByteBuffer.allocateDirect(names.length * 128).order(ByteOrder.LITTLE_ENDIAN);
+        if (names.length > 0 && getDebugCounters0(buffer)) {
+            for (int i = 0; i < names.length; i++) {
                 counters.put(names[i], buffer.getLong(i * 128));
             }
         }
@@ -450,20 +563,25 @@ public final class JavaProfiler {
 
     private static native int getTid0();
     private static native ByteBuffer getContextPage0(int tid);
-    // this is only here because ByteBuffer.putLong splits its argument into 8 bytes
-    // before performing the write, which makes it more likely that writing the context
-    // will be interrupted by the signal, leading to more rejected context values on samples
+    // this is only here because ByteBuffer offers no ordered write to publish the
+    // context sequence with, and ByteBuffer.putLong splits its argument into 8 bytes
     // ByteBuffer is simpler and fit for purpose on modern JDKs
     private static native long getContextPageOffset0(int tid);
     private static native int getMaxContextPages0();
 
     private static native boolean recordTrace0(long rootSpanId, String endpoint, String operation, int sizeLimit);
 
+    private static native boolean startBurst0(int tid, long spanId, long durationNanos, int factor);
+
     private static native int registerConstant0(String value);
 
+    private static native void registerConstants0(String[] values, int[] encodings);
+
     private static native void dump0(String recordingFilePath);
 
-    private static native ByteBuffer getDebugCounters0();
+    private static native void dumpRing0(String recordingFilePath);
+
+    private static native boolean getDebugCounters0(ByteBuffer buffer);
 
     private static native String[] describeDebugCounters0();
 
@@ -2,17 +2,33 @@
 
     #include "asyncSampleMutex.h"
     #include "buffers.h"
+    #include "bursts.h"
+    #include "callTraceStorage.h"
+    #include "cgroupMonitor.h"
     #include "context.h"
     #include "counters.h"
+    #include "eventWriter.h"
+    #include "hwCounters.h"
+    #include "latencyHistogram.h"
     #include "mutex.h"
     #include "os.h"
+    #include "overheadGovernor.h"
+    #include "pprof.h"
+    #include "sampleAggregator.h"
+    #include "symbolCache.h"
+    #include "unwindCache.h"
     #include "unwindStats.h"
     #include "threadFilter.h"
     #include "threadInfo.h"
     #include "threadLocalData.h"
+    #include "tsc.h"
     #include "vmEntry.h"
+    #include <algorithm>
+    #include <atomic>
     #include <map>
+    #include <set>
     #include <thread>
+    #include <unistd.h>
     #include <vector>
 
     ssize_t callback(char* ptr, int len) {
@@ -88,21 +104,156 @@
         free(str);
     }
 
+    TEST(EventWriter, sameAsBuffer) {
+        typedef EventSchema<Var64Field, U8Field, Var32Field, FloatField, ContextField> Schema;
+        EXPECT_EQ(1 + 9 + 1 + 5 + 4 + 2 * 9 + DD_TAGS_CAPACITY * 5, Schema::MAX_SIZE);
+
+        Context context = {};
+        context.spanId = 0x123456789abcdefULL;
+        context.rootSpanId = 42;
+        context.tags[0].value = 7;
+        context.tags[1].value = 300;
+
+        RecordingBuffer expected;
+        int start = expected.skip(1);
+        expected.putVar64(0xffffffffffffffffULL);
+        expected.put8(3);
+        expected.putVar32(1 << 20);
+        expected.putFloat(0.5f);
+        expected.putVar64(context.spanId);
+        expected.putVar64(context.rootSpanId);
+        expected.putVar32(context.tags[0].value);
+        expected.putVar32(context.tags[1].value);
+        expected.put8(start, expected.offset() - start);
+
+        RecordingBuffer buf;
+        buf.put8(0x55);
+        EventWriter<Schema>(&buf)
+            .put(0xffffffffffffffffULL)
+            .put(3)
+            .put(1 << 20)
+            .put(0.5f)
+            .put(context, 2)
+            .commit();
+
+        ASSERT_EQ(expected.offset() + 1, buf.offset());
+        EXPECT_EQ(0x55, buf.data()[0]);
+        EXPECT_EQ(0, memcmp(expected.data(), buf.data() + 1, expected.offset()));
+    }
+
+    TEST(EventWriter, widePrefix) {
+        typedef EventSchema<Var64Field, ArrayField<Var64Field, 16> > Schema;
+        EXPECT_EQ(2, Schema::PREFIX_SIZE);
+        EXPECT_EQ(2 + 17 * 9, Schema::MAX_SIZE);
+
+        u64 values[16];
+        for (int i = 0; i < 16; i++) {
+            values[i] = 0xffffffffffffffffULL;
+        }
+        RecordingBuffer buf;
+        EventWriter<Schema>(&buf).put(1).put(values).commit();
+
+        // the size is a varint padded to two bytes, counting them
+        ASSERT_EQ(2 + 1 + 16 * 9, buf.offset());
+        EXPECT_EQ((char)(buf.offset() | 0x80), buf.data()[0]);
+        EXPECT_EQ((char)(buf.offset() >> 7), buf.data()[1]);
+        EXPECT_EQ(1, buf.data()[2]);
+    }
+
+    TEST(CounterGroup, groupRead) {
+        int slots[] = {HW_INSTRUCTIONS, HW_BRANCH_MISSES};
+        u64 read[] = {3, 1000, 200, 5};
+        u64 counters[HW_COUNTER_COUNT] = {};
+        ASSERT_TRUE(CounterGroup::store(read, sizeof(read), 2, slots, counters));
+        EXPECT_EQ(1000, counters[HW_CYCLES]);
+        EXPECT_EQ(200, counters[HW_INSTRUCTIONS]);
+        EXPECT_EQ(0, counters[HW_CACHE_MISSES]);
+        EXPECT_EQ(5, counters[HW_BRANCH_MISSES]);
+
+        // a short read or a group of another size is not taken
+        EXPECT_FALSE(CounterGroup::store(read, 3 * sizeof(u64), 2, slots, counters));
+        read[0] = 2;
+        EXPECT_FALSE(CounterGroup::store(read, sizeof(read), 2, slots, counters));
+    }
+
+    TEST(CounterGroup, deltas) {
+        int slots[] = {HW_CACHE_MISSES};
+        u64 last[2] = {};
+        u64 counters[HW_COUNTER_COUNT] = {};
+        u64 first[] = {1000, 30};
+        CounterGroup::storeDeltas(first, 1, slots, last, counters);
+        EXPECT_EQ(1000, counters[HW_CYCLES]);
+        EXPECT_EQ(30, counters[HW_CACHE_MISSES]);
+
+        // the values are cumulative, each sample gets the increase
+        u64 second[] = {1500, 42};
+        CounterGroup::storeDeltas(second, 1, slots, last, counters);
+        EXPECT_EQ(500, counters[HW_CYCLES]);
+        EXPECT_EQ(12, counters[HW_CACHE_MISSES]);
+        EXPECT_EQ(1500, last[0]);
+        EXPECT_EQ(42, last[1]);
+    }
+
     TEST(OS, threadId_sanity) {
         EXPECT_FALSE(OS::getMaxThreadId() < 0);
     }
 
+    TEST(OS, schedStatReread) {
+        int fd = OS::openSchedStat(OS::threadId());
+        if (!OS::isLinux()) {
+            EXPECT_EQ(-1, fd);
+            return;
+        }
+        ASSERT_NE(-1, fd);
+        u64 on_cpu, run_queue;
+        ASSERT_TRUE(OS::readSchedStat(fd, &on_cpu, &run_queue));
+        volatile u64 sum = 0;
+        for (int i = 0; i < 10000000; i++) {
+            sum += i;
+        }
+        // the same fd reads the current values again
+        u64 on_cpu_after, run_queue_after;
+        ASSERT_TRUE(OS::readSchedStat(fd, &on_cpu_after, &run_queue_after));
+        EXPECT_GT(on_cpu_after, on_cpu);
+        EXPECT_GE(run_queue_after, run_queue);
+        close(fd);
+    }
+
     TEST(Context, maxtid_sanity) {
         int maxTid = OS::getMaxThreadId();
 
-        Context& ctx1 = Contexts::get(0);
-        Context& ctx2 = Contexts::get(maxTid - 1);
+        Context ctx1 = Contexts::get(0);
+        Context ctx2 = Contexts::get(maxTid - 1);
 
         if (maxTid >= DD_CONTEXT_PAGE_SIZE) {
-            Context& ctx3 = Contexts::get(DD_CONTEXT_PAGE_SIZE);
+            Context ctx3 = Contexts::get(DD_CONTEXT_PAGE_SIZE);
         }
     }
 
+    TEST(Context, publication) {
+        int tid = 1;
+        ContextSlot *slot = (ContextSlot *)Contexts::getPage(tid).storage + tid;
+        EXPECT_EQ(128, sizeof(ContextSlot));
+
+        slot->copies[1].spanId = 42;
+        slot->copies[1].rootSpanId = 24;
+        slot->copies[1].tags[3].value = 7;
+        // not published yet
+        EXPECT_EQ(0, Contexts::get(tid).spanId);
+
+        __atomic_store_n(&slot->sequence, slot->sequence + 1, __ATOMIC_RELEASE);
+        Context context = Contexts::get(tid);
+        EXPECT_EQ(42, context.spanId);
+        EXPECT_EQ(24, context.rootSpanId);
+        EXPECT_EQ(7, context.get_tag(3).value);
+
+        // writing the next copy leaves the published one untouched
+        slot->copies[0].spanId = 1;
+        EXPECT_EQ(42, Contexts::get(tid).spanId);
+
+        Contexts::reset();
+    }
+
     TEST(Context, maxpages) {
         // floored at 128 to mitigate unusual pid_max settings
         int minMaxPages = 128;
@@ -120,6 +271,221 @@
         EXPECT_EQ(2048, Contexts::getMaxPages(2097152));
     }
 
+    static ASGCT_CallFrame frame(int bci, long method_id) {
+        ASGCT_CallFrame frame = {};
+        frame.bci = bci;
+        frame.method_id = (jmethodID)method_id;
+        return frame;
+    }
+
+    static std::map<u32, CallTrace *> collectTraces(CallTraceStorage &storage) {
+        CallTraceList traces;
+        storage.collectTraces(traces);
+        return std::map<u32, CallTrace *>(traces.begin(), traces.end());
+    }
+
+    TEST(CallTraceStorage, collectTouched) {
+        CallTraceStorage storage;
+        std::vector<u32> ids;
+        for (int i = 0; i < 100; i++) {
+            ASGCT_CallFrame trace[] = {frame(i, 0x10), frame(0, 0x20)};
+            ids.push_back(storage.put(2, trace, false, 1));
+            // repeated samples do not duplicate the trace
+            storage.put(2, trace, false, 1);
+        }
+        CallTraceList traces;
+        storage.collectTraces(traces);
+        ASSERT_EQ(100, traces.size());
+        std::sort(ids.begin(), ids.end());
+        for (int i = 0; i < 100; i++) {
+            EXPECT_EQ(ids[i], traces[i].first);
+        }
+
+        // only the traces sampled since the last collection are returned
+        ASGCT_CallFrame trace[] = {frame(7, 0x10), frame(0, 0x20)};
+        u32 id = storage.put(2, trace, false, 1);
+        traces.clear();
+        storage.collectTraces(traces);
+        ASSERT_EQ(1, traces.size());
+        EXPECT_EQ(id, traces[0].first);
+        EXPECT_EQ(7, traces[0].second->frames[0].bci);
+    }
+
+    TEST(CallTraceStorage, collectConcurrently) {
+        CallTraceStorage storage;
+        const int threads = 4;
+        const int traces_per_thread = 10000;
+        std::vector<std::vector<u32> > ids(threads);
+        std::atomic<int> running(threads);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                for (int i = 0; i < traces_per_thread; i++) {
+                    ASGCT_CallFrame trace[] = {frame(i, 0x10 + t)};
+                    ids[t].push_back(storage.put(1, trace, false, 1));
+                }
+                running--;
+            });
+        }
+        // slots touched while a collection is in progress are not lost
+        std::set<u32> collected;
+        CallTraceList traces;
+        while (running > 0) {
+            traces.clear();
+            storage.collectTraces(traces);
+            for (size_t i = 0; i < traces.size(); i++) {
+                collected.insert(traces[i].first);
+            }
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        traces.clear();
+        storage.collectTraces(traces);
+        for (size_t i = 0; i < traces.size(); i++) {
+            collected.insert(traces[i].first);
+        }
+        for (int t = 0; t < threads; t++) {
+            for (u32 id : ids[t]) {
+                ASSERT_TRUE(collected.count(id)) << id;
+            }
+        }
+    }
+
+    TEST(CallTraceStorage, frameTrie) {
+        CallTraceStorage storage;
+        storage.setFrameTrie(true);
+        // innermost frame first, both traces share the two outermost frames
+        ASGCT_CallFrame trace1[] = {frame(1, 0x10), frame(2, 0x20), frame(3, 0x30)};
+        ASGCT_CallFrame trace2[] = {frame(4, 0x40), frame(2, 0x20), frame(3, 0x30)};
+        u32 id1 = storage.put(3, trace1, false, 1);
+        u32 id2 = storage.put(3, trace2, true, 1);
+        EXPECT_NE(id1, id2);
+        EXPECT_EQ(id1, storage.put(3, trace1, false, 1));
+
+        std::map<u32, CallTrace *> traces = collectTraces(storage);
+        ASSERT_EQ(2, traces.size());
+        CallTrace *t1 = traces[id1];
+        CallTrace *t2 = traces[id2];
+        ASSERT_NE(nullptr, t1->leaf);
+        ASSERT_NE(nullptr, t2->leaf);
+        EXPECT_EQ(3, t1->num_frames);
+        EXPECT_TRUE(t2->truncated);
+
+        int depth = 0;
+        for (FrameNode *node = t1->leaf; node != NULL; node = node->parent, depth++) {
+            ASSERT_LT(depth, 3);
+            EXPECT_EQ(trace1[depth].bci, node->frame.bci);
+            EXPECT_EQ(trace1[depth].method_id, node->frame.method_id);
+        }
+        EXPECT_EQ(3, depth);
+        // only the innermost frames differ
+        EXPECT_NE(t1->leaf, t2->leaf);
+        EXPECT_EQ(t1->leaf->parent, t2->leaf->parent);
+    }
+
+    TEST(CallTraceStorage, retainedChunks) {
+        CallTraceStorage storage;
+        storage.setRetainedChunks(1);
+        ASGCT_CallFrame trace1[] = {frame(1, 0x10), frame(2, 0x20)};
+        ASGCT_CallFrame trace2[] = {frame(3, 0x30), frame(2, 0x20)};
+        std::map<u32, CallTrace *> traces;
+
+        u32 id1 = storage.put(2, trace1, false, 1);
+        u32 id2 = storage.put(2, trace2, false, 1);
+        collectTraces(storage);
+        storage.finishChunk();
+        // both were recorded in the last chunk
+        EXPECT_EQ(id1, storage.put(2, trace1, false, 1));
+        traces = collectTraces(storage);
+        ASSERT_EQ(1, traces.size());
+        EXPECT_EQ(0x10, (long)traces[id1]->frames[0].method_id);
+        storage.finishChunk();
+
+        // trace2 has been evicted but keeps its id
+        EXPECT_EQ(id2, storage.put(2, trace2, false, 1));
+        traces = collectTraces(storage);
+        ASSERT_EQ(1, traces.size());
+        EXPECT_EQ(2, traces[id2]->num_frames);
+        EXPECT_EQ(0x30, (long)traces[id2]->frames[0].method_id);
+    }
+
+    TEST(CallTraceStorage, retainedIds) {
+        ASGCT_CallFrame kept[] = {frame(1, 0x10)};
+        ASGCT_CallFrame other[] = {frame(2, 0x30)};
+
+        // enough traces to grow the table: the kept one stays in the first
+        CallTraceStorage grown;
+        grown.setRetainedChunks(1);
+        u32 kept_id = grown.put(1, kept, false, 1);
+        for (int i = 0; i < 60000; i++) {
+            ASGCT_CallFrame trace[] = {frame(i, 0x20)};
+            grown.put(1, trace, false, 1);
+        }
+        EXPECT_EQ(kept_id, grown.put(1, kept, false, 1));
+        collectTraces(grown);
+        grown.finishChunk();
+        EXPECT_EQ(kept_id, grown.put(1, kept, false, 1));
+        EXPECT_EQ(1, collectTraces(grown).size());
+        grown.finishChunk();
+        EXPECT_EQ(kept_id, grown.put(1, kept, false, 1));
+        EXPECT_NE(kept_id, grown.put(1, other, false, 1));
+
+        // evicted traces fill a quarter of the table: new traces go to a
+        // fresh table, the retained one keeps its slot
+        CallTraceStorage rotated;
+        rotated.setRetainedChunks(1);
+        kept_id = rotated.put(1, kept, false, 1);
+        for (int i = 0; i < 20000; i++) {
+            ASGCT_CallFrame trace[] = {frame(i, 0x20)};
+            rotated.put(1, trace, false, 1);
+        }
+        collectTraces(rotated);
+        rotated.finishChunk();
+        rotated.put(1, kept, false, 1);
+        collectTraces(rotated);
+        rotated.finishChunk();
+        u32 other_id = rotated.put(1, other, false, 1);
+        EXPECT_EQ(kept_id, rotated.put(1, kept, false, 1));
+        EXPECT_NE(kept_id, other_id);
+        std::map<u32, CallTrace *> traces = collectTraces(rotated);
+        ASSERT_EQ(2, traces.size());
+        EXPECT_EQ(0x10, (long)traces[kept_id]->frames[0].method_id);
+        EXPECT_EQ(0x30, (long)traces[other_id]->frames[0].method_id);
+    }
+
+    TEST(CallTraceStorage, memoryLimit) {
+        CallTraceStorage storage;
+        storage.setMemoryLimit(1);
+        ASGCT_CallFrame trace[] = {frame(1, 0x10)};
+        u32 id = storage.put(1, trace, false, 1);
+        std::map<u32, CallTrace *> traces = collectTraces(storage);
+        ASSERT_EQ(1, traces.size());
+        EXPECT_EQ(BCI_ERROR, traces[id]->frames[0].bci);
+    }
+
+    TEST(SymbolCache, lookup) {
+        SymbolCache *cache = new SymbolCache();
+        const void *pc = (const void *)0x7f0000001234;
+        CodeCache *lib = (CodeCache *)0x1000;
+        const char *name = "JVM_DoPrivileged";
+        CodeCache *cached_lib;
+        const char *cached_name;
+        EXPECT_FALSE(cache->lookup(pc, 1, &cached_lib, &cached_name));
+        cache->insert(pc, 1, lib, name);
+        ASSERT_TRUE(cache->lookup(pc, 1, &cached_lib, &cached_name));
+        EXPECT_EQ(lib, cached_lib);
+        EXPECT_EQ(name, cached_name);
+        // a library loaded since the insert invalidates the entry
+        EXPECT_FALSE(cache->lookup(pc, 2, &cached_lib, &cached_name));
+        // misses are cached as well
+        const void *unknown = (const void *)0x1234;
+        cache->insert(unknown, 2, NULL, NULL);
+        ASSERT_TRUE(cache->lookup(unknown, 2, &cached_lib, &cached_name));
+        EXPECT_EQ(NULL, cached_name);
+        delete cache;
+    }
+
     TEST(ThreadFilter, testThreadFilter) {
         int maxTid = OS::getMaxThreadId();
         ThreadFilter filter;
@@ -324,6 +690,65 @@
       EXPECT_EQ(1, failures2.count("test_stub1"));
     }
 
+    TEST(UnwindCache, splice) {
+        UnwindCache *cache = new UnwindCache();
+        UnwindCheckpoint walked[] = {{0x1000, 0x1100, (const void *)0xa},
+                                     {0x1100, 0x1200, (const void *)0xb},
+                                     {0x1200, 0x1300, (const void *)0xc}};
+        cache->update(walked, 3, -1, (const void *)0xd, 0x1310, 0x1400);
+        ASSERT_EQ(3, cache->count());
+        EXPECT_EQ(1, cache->find(0x1100, 0x1200, (const void *)0xb));
+        // a frame record holding a different return address is not reused
+        EXPECT_EQ(-1, cache->find(0x1100, 0x1200, (const void *)0xe));
+        EXPECT_EQ(-1, cache->find(0x1050, 0x1200, (const void *)0xb));
+
+        // new inner frames followed by the cached suffix from the second record
+        UnwindCheckpoint inner[] = {{0x0f00, 0x1100, (const void *)0xf}};
+        cache->update(inner, 1, 1, cache->javaPC(), cache->javaSP(), cache->javaFP());
+        ASSERT_EQ(3, cache->count());
+        EXPECT_EQ(0x0f00, cache->checkpoint(0).fp);
+        EXPECT_EQ((const void *)0xb, cache->checkpoint(1).pc);
+        EXPECT_EQ((const void *)0xc, cache->checkpoint(2).pc);
+        EXPECT_EQ((const void *)0xd, cache->javaPC());
+
+        ASSERT_TRUE(cache->acquire());
+        // a nested walk bypasses the cache
+        EXPECT_FALSE(cache->acquire());
+        cache->release();
+        delete cache;
+    }
+
+    TEST(UnwindCache, changedCaller) {
+        // frame records of a fake stack: saved frame pointer, return address
+        uintptr_t stack[12];
+        for (int i = 0; i < 6; i++) {
+            stack[2 * i] = (uintptr_t)&stack[2 * i + 2];
+            stack[2 * i + 1] = 0xa + i;
+        }
+        UnwindCheckpoint walked[6];
+        for (int i = 0; i < 6; i++) {
+            walked[i].fp = (uintptr_t)&stack[2 * i];
+            walked[i].saved_fp = stack[2 * i];
+            walked[i].pc = (const void *)stack[2 * i + 1];
+        }
+        UnwindCache *cache = new UnwindCache();
+        cache->update(walked, 6, -1, NULL, 0, 0);
+        ASSERT_EQ(0, cache->find(walked[0].fp, walked[0].saved_fp, walked[0].pc));
+        EXPECT_TRUE(cache->verify(0));
+
+        // the leaf record is left as it was while its caller returned and a
+        // different one was called in its place
+        stack[3] = 0xf0;
+        EXPECT_EQ(0, cache->find(walked[0].fp, walked[0].saved_fp, walked[0].pc));
+        EXPECT_FALSE(cache->verify(0));
+        // records beyond the next ones checked are trusted
+        stack[3] = 0xb;
+        stack[9] = 0xf0;
+        EXPECT_TRUE(cache->verify(0));
+        EXPECT_FALSE(cache->verify(1));
+        delete cache;
+    }
+
     TEST(UnwindStats, CollectAndReset) {
       // Record some failures
       UnwindFailures failures;
@@ -392,6 +817,342 @@
       EXPECT_TRUE(globalCount > 0);
     }
 
+    TEST(CgroupMonitor, parse) {
+        CgroupCpuStat stat = {};
+        EXPECT_TRUE(CgroupMonitor::parseCpuStat(
+            "usage_usec 5000\nuser_usec 4000\nsystem_usec 1000\n"
+            "nr_periods 20\nnr_throttled 3\nthrottled_usec 1500\n", &stat));
+        EXPECT_EQ(5000, stat.usage);
+        EXPECT_EQ(20, stat.periods);
+        EXPECT_EQ(3, stat.throttled_periods);
+        EXPECT_EQ(1500, stat.throttled);
+        EXPECT_FALSE(CgroupMonitor::parseCpuStat("nr_periods 20\n", &stat));
+
+        float limit = -1;
+        EXPECT_TRUE(CgroupMonitor::parseCpuMax("max 100000\n", &limit));
+        EXPECT_EQ(0, limit);
+        EXPECT_TRUE(CgroupMonitor::parseCpuMax("150000 100000\n", &limit));
+        EXPECT_FLOAT_EQ(1.5f, limit);
+
+        u64 some = 0, full = 0;
+        EXPECT_TRUE(CgroupMonitor::parsePressure(
+            "some avg10=1.00 avg60=0.50 avg300=0.10 total=12345\n"
+            "full avg10=0.00 avg60=0.00 avg300=0.00 total=678\n", &some, &full));
+        EXPECT_EQ(12345, some);
+        EXPECT_EQ(678, full);
+    }
+
+    TEST(Counters, sharded) {
+        Counters::set(UNWIND_SPLICE_HITS, 0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([]() {
+                for (int i = 0; i < 1000; i++) {
+                    Counters::increment(UNWIND_SPLICE_HITS, 2);
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+        EXPECT_EQ(16000, Counters::getCounter(UNWIND_SPLICE_HITS));
+        std::vector<long long> counters(Counters::size() / sizeof(long long));
+        ASSERT_TRUE(Counters::getCounters(counters.data()));
+        EXPECT_EQ(16000, counters[Counters::address(UNWIND_SPLICE_HITS)]);
+
+        // setting a counter replaces what all the shards have accumulated
+        Counters::set(UNWIND_SPLICE_HITS, 5);
+        EXPECT_EQ(5, Counters::getCounter(UNWIND_SPLICE_HITS));
+        Counters::set(UNWIND_SPLICE_HITS, 0);
+    }
+
+    TEST(LatencyHistogram, percentiles) {
+        for (u64 value : {0ULL, 7ULL, 8ULL, 9ULL, 1000ULL, 123456789ULL, ~0ULL}) {
+            int bucket = LatencyHistogram::bucket(value);
+            ASSERT_LT(bucket, LatencyHistogram::BUCKETS);
+            EXPECT_LE(LatencyHistogram::lowerBound(bucket), value);
+            if (bucket + 1 < LatencyHistogram::BUCKETS) {
+                EXPECT_GT(LatencyHistogram::lowerBound(bucket + 1), value);
+            }
+        }
+
+        LatencyHistogram histogram;
+        for (u64 i = 1; i <= 1000; i++) {
+            histogram.record(i * 100);
+        }
+        u64 buckets[LatencyHistogram::BUCKETS];
+        u64 sum, max;
+        u64 count = histogram.drain(buckets, &sum, &max);
+        EXPECT_EQ(1000, count);
+        EXPECT_EQ(100000, max);
+        EXPECT_EQ(50050, sum / count);
+        // within the 12.5% resolution of the buckets, never below the real value
+        u64 p50 = LatencyHistogram::percentile(buckets, count, 0.5);
+        EXPECT_GE(p50, 50000);
+        EXPECT_LE(p50, 50000 * 9 / 8);
+        u64 p99 = LatencyHistogram::percentile(buckets, count, 0.99);
+        EXPECT_GE(p99, 99000);
+        EXPECT_LE(p99, 99000 * 9 / 8);
+
+        // draining starts over, the total does not
+        EXPECT_EQ(0, histogram.drain(buckets, &sum, &max));
+        histogram.record(5);
+        EXPECT_EQ(1, histogram.drain(buckets, &sum, &max));
+        EXPECT_EQ(5, sum);
+        EXPECT_EQ(50050000 + 5, histogram.total());
+    }
+
+    TEST(LatencyHistogram, shards) {
+        LatencyHistogram *histogram = new LatencyHistogram();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([histogram, t]() {
+                for (u64 i = 1; i <= 1000; i++) {
+                    histogram->record(i + t * 1000);
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+        // the snapshot merges what the threads recorded in their shards
+        u64 buckets[LatencyHistogram::BUCKETS];
+        u64 sum, max;
+        EXPECT_EQ(8000, histogram->drain(buckets, &sum, &max));
+        EXPECT_EQ(8000ULL * 8001 / 2, sum);
+        EXPECT_EQ(8000, max);
+        EXPECT_EQ(sum, histogram->total());
+        delete histogram;
+    }
+
+    TEST(Bursts, expiry) {
+        EXPECT_FALSE(Bursts::active());
+        EXPECT_EQ(1, Bursts::factor(7, 0));
+
+        EXPECT_TRUE(Bursts::start(7, 0, 1000, 10));
+        EXPECT_TRUE(Bursts::active());
+        EXPECT_EQ(10, Bursts::factor(7, 999));
+        EXPECT_EQ(1, Bursts::factor(8, 999));
+
+        // a new burst replaces the previous one of the thread
+        EXPECT_TRUE(Bursts::start(7, 0, 2000, 4));
+        EXPECT_EQ(4, Bursts::factor(7, 1500));
+
+        std::vector<int> tids;
+        Bursts::collect(tids, 1500);
+        EXPECT_EQ(std::vector<int>({7}), tids);
+
+        // the slot is released at the deadline
+        EXPECT_EQ(1, Bursts::factor(7, 2000));
+        EXPECT_FALSE(Bursts::active());
+
+        for (int tid = 1; tid <= Bursts::CAPACITY; tid++) {
+            EXPECT_TRUE(Bursts::start(tid, 0, 1000, 2));
+        }
+        EXPECT_FALSE(Bursts::start(Bursts::CAPACITY + 1, 0, 1000, 2));
+        Bursts::reset();
+        EXPECT_FALSE(Bursts::active());
+    }
+
+    TEST(Bursts, span) {
+        int tid = 1;
+        ContextSlot *slot = (ContextSlot *)Contexts::getPage(tid).storage + tid;
+        slot->copies[1].spanId = 42;
+        __atomic_store_n(&slot->sequence, slot->sequence + 1, __ATOMIC_RELEASE);
+
+        EXPECT_TRUE(Bursts::start(tid, 42, 1000, 10));
+        EXPECT_EQ(10, Bursts::factor(tid, 0));
+
+        // the burst ends as soon as the thread leaves the span
+        slot->copies[0].spanId = 43;
+        __atomic_store_n(&slot->sequence, slot->sequence + 1, __ATOMIC_RELEASE);
+        EXPECT_EQ(1, Bursts::factor(tid, 0));
+        EXPECT_FALSE(Bursts::active());
+
+        Contexts::reset();
+    }
+
+    TEST(SampleAggregator, aggregate) {
+        SampleAggregator aggregator(64);
+        SampleKey key;
+        key.call_trace_id = 1;
+        key.context.spanId = 42;
+        EXPECT_TRUE(aggregator.add(key, 1));
+        EXPECT_TRUE(aggregator.add(key, 3));
+        key.wall = 1;
+        EXPECT_TRUE(aggregator.add(key, 1));
+        EXPECT_EQ(2, aggregator.size());
+
+        std::map<int, std::pair<u64, u64>> counts;
+        aggregator.drain([&](const SampleAggregator::Entry &entry) {
+            EXPECT_EQ(1, entry.key.call_trace_id);
+            EXPECT_EQ(42, entry.key.context.spanId);
+            counts[entry.key.wall] = std::make_pair((u64)entry.samples, (u64)entry.weight);
+        });
+        EXPECT_EQ(std::make_pair((u64)2, (u64)4), counts[0]);
+        EXPECT_EQ(std::make_pair((u64)1, (u64)1), counts[1]);
+        EXPECT_EQ(0, aggregator.size());
+
+        // the samples beyond the capacity are left to the caller
+        int added = 0;
+        for (u32 id = 0; id < 128; id++) {
+            key.call_trace_id = id;
+            added += aggregator.add(key, 1) ? 1 : 0;
+        }
+        EXPECT_EQ(64, added);
+        EXPECT_EQ(64, aggregator.size());
+    }
+
+    TEST(SampleAggregator, concurrent) {
+        SampleAggregator aggregator(1024);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&]() {
+                SampleKey key;
+                for (int i = 0; i < 10000; i++) {
+                    key.call_trace_id = i % 100;
+                    aggregator.add(key, 1);
+                }
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        u64 samples = 0;
+        aggregator.drain([&](const SampleAggregator::Entry &entry) {
+            samples += entry.samples;
+        });
+        EXPECT_EQ(40000, samples);
+    }
+
+    static u64 readVarint(const char *&p) {
+        u64 v = 0;
+        for (int shift = 0; ; shift += 7) {
+            u8 b = (u8)*p++;
+            v |= (u64)(b & 0x7f) << shift;
+            if (b < 0x80) {
+                return v;
+            }
+        }
+    }
+
+    TEST(Pprof, varint) {
+        ProtoBuffer buf(4);
+        u64 values[] = {0, 1, 127, 128, 300, 0x1fffff, 0xffffffffULL, 0xffffffffffffffffULL};
+        for (u64 v : values) {
+            buf.putVarint(v);
+        }
+        // unlike the JFR ones, the protobuf varints take up to 10 bytes
+        EXPECT_EQ(10, ProtoBuffer::varintSize(0xffffffffffffffffULL));
+        const char *p = buf.data();
+        for (u64 v : values) {
+            EXPECT_EQ(v, readVarint(p));
+        }
+        EXPECT_EQ(buf.data() + buf.offset(), p);
+    }
+
+    TEST(Pprof, profile) {
+        FILE *file = tmpfile();
+        ASSERT_TRUE(file != NULL);
+        PprofWriter writer(fileno(file));
+        writer.sampleType("cpu-samples", "count");
+        writer.location(1, 7, 42);
+        writer.function(7, writer.string("java.lang.Thread.run"));
+        u64 location_ids[] = {1};
+        u64 values[] = {3, 30000000};
+        PprofLabel label = {writer.string("span id"), 0, 123};
+        writer.sample(location_ids, 1, values, 2, &label, 1);
+        size_t size = writer.finish();
+
+        std::vector<char> data(size);
+        ASSERT_EQ(size, pread(fileno(file), data.data(), size, 0));
+        fclose(file);
+
+        std::vector<std::string> strings;
+        std::vector<u64> sample_values;
+        int sample_types = 0, locations = 0, functions = 0;
+        const char *p = data.data();
+        const char *end = p + size;
+        while (p < end) {
+            u64 tag = readVarint(p);
+            ASSERT_EQ(ProtoBuffer::LENGTH_DELIMITED, (int)(tag & 7));
+            u64 len = readVarint(p);
+            switch (tag >> 3) {
+                case PROFILE_SAMPLE_TYPE: sample_types++; break;
+                case PROFILE_LOCATION: locations++; break;
+                case PROFILE_FUNCTION: functions++; break;
+                case PROFILE_STRING_TABLE: strings.push_back(std::string(p, len)); break;
+                case PROFILE_SAMPLE: {
+                    const char *q = p;
+                    while (q < p + len) {
+                        u64 field = readVarint(q);
+                        u64 field_len = readVarint(q);
+                        const char *field_end = q + field_len;
+                        while ((field >> 3) == SAMPLE_VALUE && q < field_end) {
+                            sample_values.push_back(readVarint(q));
+                        }
+                        q = field_end;
+                    }
+                    break;
+                }
+                default: FAIL();
+            }
+            p += len;
+        }
+        EXPECT_EQ(end, p);
+        EXPECT_EQ(1, sample_types);
+        EXPECT_EQ(1, locations);
+        EXPECT_EQ(1, functions);
+        // the empty string comes first, the others in the order of interning
+        std::vector<std::string> expected = {"", "cpu-samples", "count", "java.lang.Thread.run", "span id"};
+        EXPECT_EQ(expected, strings);
+        EXPECT_EQ(std::vector<u64>({3, 30000000}), sample_values);
+    }
+
+    TEST(OverheadGovernor, converges) {
+        OverheadGovernor governor;
+        double scale = 1;
+        EXPECT_FALSE(governor.adjust(0.5, &scale));
+
+        // the overhead is inversely proportional to the sampling rate
+        governor.start(1, 4);
+        for (int i = 0; i < 60; i++) {
+            governor.adjust(0.05 / scale, &scale);
+        }
+        EXPECT_GT(scale, 4);
+        EXPECT_LT(scale, 6);
+
+        // back under budget, the configured rates are restored
+        for (int i = 0; i < 60 && scale != 1; i++) {
+            governor.adjust(0.001, &scale);
+        }
+        EXPECT_EQ(1, scale);
+
+        // the rate is not lowered without bounds
+        for (int i = 0; i < 1000; i++) {
+            governor.adjust(100, &scale);
+        }
+        EXPECT_EQ(OverheadGovernor::MAX_SCALE, scale);
+        EXPECT_TRUE(governor.stop());
+        EXPECT_FALSE(governor.enabled());
+    }
+
+    TEST(OverheadGovernor, samplingStagesOnly) {
+        OverheadGovernor governor;
+        double scale = 1;
+        governor.start(1, 1);
+        // seconds of chunk and liveness work, which the rates do not reduce
+        Latencies::record(LATENCY_FINISH_CHUNK, TSC::frequency() * 10);
+        Latencies::record(LATENCY_LIVENESS_CLEANUP, TSC::frequency() * 10);
+        EXPECT_FALSE(governor.update(&scale));
+        EXPECT_EQ(1, scale);
+
+        Latencies::record(LATENCY_UNWIND_CPU, TSC::frequency() * 10);
+        EXPECT_TRUE(governor.update(&scale));
+        EXPECT_GT(scale, 1);
+        governor.stop();
+    }
+
     int main(int argc, char **argv) {
       ::testing::InitGoogleTest(&argc, argv);
       return RUN_ALL_TESTS();
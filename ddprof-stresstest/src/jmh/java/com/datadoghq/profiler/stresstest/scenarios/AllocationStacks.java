@@ -0,0 +1,45 @@
+package com.datadoghq.profiler.stresstest.scenarios;
+
+import com.datadoghq.profiler.stresstest.Configuration;
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.CompilerControl;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.Threads;
+
+import java.util.concurrent.ThreadLocalRandom;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Allocates from a configurable stack depth with a small sampling interval, so that the latency
+ * of the allocation path is dominated by collecting the stack traces of the allocation samples
+ */
+@State(Scope.Benchmark)
+public class AllocationStacks extends Configuration {
+
+    @Param({BASE_COMMAND + ",memory=4096:a", BASE_COMMAND + ",memory=4096:l"})
+    public String command;
+
+    @Param({"8", "64"})
+    public int depth;
+
+    @Benchmark
+    @BenchmarkMode(Mode.SampleTime)
+    @OutputTimeUnit(TimeUnit.NANOSECONDS)
+    @Threads(8)
+    public Object allocate() {
+        return allocate(depth);
+    }
+
+    @CompilerControl(CompilerControl.Mode.DONT_INLINE)
+    private Object allocate(int remaining) {
+        if (remaining > 0) {
+            return allocate(remaining - 1);
+        }
+        return new byte[64 + ThreadLocalRandom.current().nextInt(1024)];
+    }
+}
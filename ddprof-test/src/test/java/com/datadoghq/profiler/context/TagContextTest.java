@@ -8,6 +8,7 @@ import java.util.Set;
 import java.util.concurrent.atomic.AtomicLong;
 import java.util.stream.IntStream;
 
+import static org.junit.jupiter.api.Assertions.assertArrayEquals;
 import static org.junit.jupiter.api.Assertions.assertEquals;
 import static org.junit.jupiter.api.Assertions.assertFalse;
 import static org.junit.jupiter.api.Assertions.assertNotEquals;
@@ -100,7 +101,7 @@ public class TagContextTest extends AbstractProfilerTest {
         Map<String, Long> debugCounters = profiler.getDebugCounters();
         assertFalse(debugCounters.isEmpty());
         assertEquals(1, debugCounters.get("context_storage_pages"));
-        assertEquals(0x10000, debugCounters.get("context_storage_bytes"), () -> "invalid context storage: " + debugCounters);
+        assertEquals(0x20000, debugCounters.get("context_storage_bytes"), () -> "invalid context storage: " + debugCounters);
         assertEquals(strings.length, debugCounters.get("dictionary_context_keys"));
         assertEquals(Arrays.stream(strings).mapToInt(s -> s.length() + 1).sum(), debugCounters.get("dictionary_context_keys_bytes"));
         assertBoundedBy(debugCounters.get("dictionary_context_pages"), strings.length, "context storage too many pages");
@@ -131,6 +132,27 @@ public class TagContextTest extends AbstractProfilerTest {
         }
     }
 
+    @Test
+    public void testBulkContext() {
+        Assumptions.assumeTrue(!Platform.isJ9());
+        ContextSetter contextSetter = new ContextSetter(profiler, Arrays.asList("tag1", "tag2", "tag3"));
+        assertTrue(contextSetter.setContextValue("tag3", "stale"));
+
+        assertTrue(contextSetter.setContext(1, 2, new String[] {"bulk1", null}));
+        int[] tags = contextSetter.snapshotTags();
+        assertEquals(contextSetter.encode("bulk1"), tags[0]);
+        assertEquals(0, tags[1]);
+        // tags not passed to the bulk setter are cleared
+        assertEquals(0, tags[2]);
+
+        int[] encodings = contextSetter.encode(new String[] {"bulk1", "bulk2", "bulk3"});
+        assertTrue(contextSetter.setContext(1, 2, new String[] {"bulk1", "bulk2", "bulk3"}));
+        assertArrayEquals(encodings, contextSetter.snapshotTags());
+        profiler.clearContext();
+        // clearing the span leaves the tags in place
+        assertArrayEquals(encodings, contextSetter.snapshotTags());
+    }
+
     private void work(ContextSetter contextSetter, String contextAttribute, String contextValue)
             throws InterruptedException {
         assertTrue(contextSetter.setContextValue(contextAttribute, contextValue));
@@ -0,0 +1,49 @@
+package com.datadoghq.profiler.cpu;
+
+import com.datadoghq.profiler.AbstractProfilerTest;
+import org.junitpioneer.jupiter.RetryingTest;
+import org.openjdk.jmc.common.item.IAttribute;
+import org.openjdk.jmc.common.item.IItem;
+import org.openjdk.jmc.common.item.IItemIterable;
+import org.openjdk.jmc.common.item.IMemberAccessor;
+import org.openjdk.jmc.common.unit.IQuantity;
+
+import static org.junit.jupiter.api.Assertions.assertFalse;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+import static org.openjdk.jmc.common.item.Attribute.attr;
+import static org.openjdk.jmc.common.unit.UnitLookup.NUMBER;
+
+public class AggregatedProfileTest extends AbstractProfilerTest {
+
+    @RetryingTest(3)
+    public void testAggregated() throws Exception {
+        try (ProfiledCode profiledCode = new ProfiledCode(profiler)) {
+            for (int i = 0, id = 1; i < 100; i++, id += 3) {
+                profiledCode.method1(id);
+            }
+        }
+        stopProfiler();
+
+        // the samples are only recorded on their own once the table is full
+        assertFalse(verifyEvents("datadog.ExecutionSample", false).hasItems());
+
+        IAttribute<IQuantity> samplesAttr = attr("samples", "", "", NUMBER);
+        long aggregates = 0;
+        long samples = 0;
+        for (IItemIterable items : verifyEvents("datadog.ExecutionSampleAggregate")) {
+            IMemberAccessor<IQuantity, IItem> samplesAccessor = samplesAttr.getAccessor(items.getType());
+            for (IItem item : items) {
+                aggregates++;
+                samples += samplesAccessor.getMember(item).longValue();
+            }
+        }
+        // the same stack traces are sampled over and over
+        assertTrue(samples > aggregates, samples + " samples in " + aggregates + " aggregates");
+        verifyStackTraces("datadog.ExecutionSampleAggregate", "method1Impl");
+    }
+
+    @Override
+    protected String getProfilerCommand() {
+        return "cpu=1ms,aggregate";
+    }
+}
@@ -0,0 +1,59 @@
+package com.datadoghq.profiler.cpu;
+
+import com.datadoghq.profiler.AbstractProfilerTest;
+import com.datadoghq.profiler.Platform;
+import org.junitpioneer.jupiter.RetryingTest;
+import org.openjdk.jmc.common.item.IAttribute;
+import org.openjdk.jmc.common.item.IItem;
+import org.openjdk.jmc.common.item.IItemIterable;
+import org.openjdk.jmc.common.item.IMemberAccessor;
+import org.openjdk.jmc.common.unit.IQuantity;
+
+import java.util.HashSet;
+import java.util.Set;
+import java.util.concurrent.TimeUnit;
+
+import static org.junit.jupiter.api.Assertions.assertTrue;
+import static org.junit.jupiter.api.Assumptions.assumeTrue;
+import static org.openjdk.jmc.common.item.Attribute.attr;
+import static org.openjdk.jmc.common.unit.UnitLookup.NUMBER;
+
+public class BurstSamplingTest extends AbstractProfilerTest {
+
+    private static volatile int value;
+
+    @RetryingTest(3)
+    public void testBurst() throws Exception {
+        // the per-thread CPU timers are available on Linux only
+        assumeTrue(Platform.isLinux());
+        burn(500);
+        assertTrue(profiler.startBurst(0, TimeUnit.SECONDS.toNanos(1), 10));
+        burn(500);
+        stopProfiler();
+
+        IAttribute<IQuantity> intervalAttr = attr("samplingInterval", "", "", NUMBER);
+        Set<Long> intervals = new HashSet<>();
+        for (IItemIterable samples : verifyEvents("datadog.ExecutionSample")) {
+            IMemberAccessor<IQuantity, IItem> intervalAccessor = intervalAttr.getAccessor(samples.getType());
+            for (IItem sample : samples) {
+                intervals.add(intervalAccessor.getMember(sample).longValue());
+            }
+        }
+        assertTrue(intervals.contains(10_000_000L), intervals.toString());
+        assertTrue(intervals.contains(1_000_000L), intervals.toString());
+    }
+
+    private static void burn(long millis) {
+        long deadline = System.currentTimeMillis() + millis;
+        while (System.currentTimeMillis() < deadline) {
+            for (int i = 0; i < 100000; ++i) {
+                ++value;
+            }
+        }
+    }
+
+    @Override
+    protected String getProfilerCommand() {
+        return "cpu=10ms,event=ctimer";
+    }
+}
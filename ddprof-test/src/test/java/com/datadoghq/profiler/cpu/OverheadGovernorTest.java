@@ -0,0 +1,58 @@
+package com.datadoghq.profiler.cpu;
+
+import com.datadoghq.profiler.AbstractProfilerTest;
+import org.junitpioneer.jupiter.RetryingTest;
+import org.openjdk.jmc.common.item.IAttribute;
+import org.openjdk.jmc.common.item.IItem;
+import org.openjdk.jmc.common.item.IItemIterable;
+import org.openjdk.jmc.common.item.IMemberAccessor;
+
+import java.util.ArrayList;
+import java.util.List;
+
+import static org.junit.jupiter.api.Assertions.assertTrue;
+import static org.openjdk.jmc.common.item.Attribute.attr;
+import static org.openjdk.jmc.common.unit.UnitLookup.PLAIN_TEXT;
+
+public class OverheadGovernorTest extends AbstractProfilerTest {
+
+    @RetryingTest(3)
+    public void testRatesLoweredOverBudget() throws Exception {
+        // the governor runs once per second
+        long deadline = System.currentTimeMillis() + 3000;
+        try (ProfiledCode profiledCode = new ProfiledCode(profiler)) {
+            for (int id = 1; System.currentTimeMillis() < deadline; id += 3) {
+                profiledCode.method1(id);
+            }
+        }
+        stopProfiler();
+
+        IAttribute<String> nameAttr = attr("name", "", "", PLAIN_TEXT);
+        IAttribute<String> valueAttr = attr("value", "", "", PLAIN_TEXT);
+        List<Double> scales = new ArrayList<>();
+        List<Long> cpuIntervals = new ArrayList<>();
+        for (IItemIterable settings : verifyEvents("datadog.ProfilerSetting")) {
+            IMemberAccessor<String, IItem> nameAccessor = nameAttr.getAccessor(settings.getType());
+            IMemberAccessor<String, IItem> valueAccessor = valueAttr.getAccessor(settings.getType());
+            for (IItem setting : settings) {
+                String name = nameAccessor.getMember(setting);
+                if ("overheadScale".equals(name)) {
+                    scales.add(Double.parseDouble(valueAccessor.getMember(setting)));
+                } else if ("cpuInterval".equals(name)) {
+                    cpuIntervals.add(Long.parseLong(valueAccessor.getMember(setting)));
+                }
+            }
+        }
+        assertTrue(scales.stream().anyMatch(scale -> scale > 1), scales.toString());
+        assertTrue(cpuIntervals.stream().anyMatch(interval -> interval > 1_000_000), cpuIntervals.toString());
+        // the configured rates are restored when the profiler stops
+        assertTrue(scales.contains(1.0), scales.toString());
+        assertTrue(cpuIntervals.contains(1_000_000L), cpuIntervals.toString());
+    }
+
+    @Override
+    protected String getProfilerCommand() {
+        // a budget no profiler can meet
+        return "cpu=1ms,overhead=0.0001";
+    }
+}
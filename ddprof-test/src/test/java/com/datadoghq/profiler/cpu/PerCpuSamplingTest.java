@@ -0,0 +1,64 @@
+package com.datadoghq.profiler.cpu;
+
+import com.datadoghq.profiler.AbstractProfilerTest;
+import com.datadoghq.profiler.Platform;
+import org.junitpioneer.jupiter.RetryingTest;
+import org.openjdk.jmc.common.item.IItem;
+import org.openjdk.jmc.common.item.IItemIterable;
+import org.openjdk.jmc.common.item.IMemberAccessor;
+import org.openjdk.jmc.flightrecorder.jdk.JdkAttributes;
+
+import java.nio.file.Files;
+import java.nio.file.Paths;
+
+import static org.junit.jupiter.api.Assertions.assertTrue;
+import static org.junit.jupiter.api.Assumptions.assumeTrue;
+
+public class PerCpuSamplingTest extends AbstractProfilerTest {
+
+    @Override
+    protected void withTestAssumptions() {
+        // per-CPU events need perf_event_paranoid <= 0
+        assumeTrue(Platform.isLinux() && !Platform.isJ9());
+        try {
+            String paranoid = new String(Files.readAllBytes(Paths.get("/proc/sys/kernel/perf_event_paranoid"))).trim();
+            assumeTrue(Integer.parseInt(paranoid) <= 0);
+        } catch (Exception e) {
+            assumeTrue(false, e.getMessage());
+        }
+    }
+
+    @RetryingTest(3)
+    public void testJavaFrames() throws Exception {
+        try (ProfiledCode profiledCode = new ProfiledCode(profiler)) {
+            for (int i = 0, id = 1; i < 100; i++, id += 3) {
+                profiledCode.method1(id);
+            }
+        }
+        stopProfiler();
+
+        // method2Impl and method3Impl run on different threads, while the
+        // signals of the per-CPU events go to any thread of the process
+        verifyStackTraces("datadog.ExecutionSample", "method2Impl", "method3Impl");
+
+        long samples = 0;
+        long withoutJava = 0;
+        for (IItemIterable items : verifyEvents("datadog.ExecutionSample")) {
+            IMemberAccessor<String, IItem> stackTraceAccessor = JdkAttributes.STACK_TRACE_STRING.getAccessor(items.getType());
+            for (IItem item : items) {
+                samples++;
+                String stackTrace = stackTraceAccessor.getMember(item);
+                if (stackTrace == null || stackTrace.contains("no_Java_frame")) {
+                    withoutJava++;
+                }
+            }
+        }
+        // the sampled threads walk their own Java stacks
+        assertTrue(withoutJava * 10 < samples, withoutJava + " of " + samples + " samples without Java frames");
+    }
+
+    @Override
+    protected String getProfilerCommand() {
+        return "cpu=1ms,percpu";
+    }
+}
@@ -0,0 +1,57 @@
+package com.datadoghq.profiler.cpu;
+
+import com.datadoghq.profiler.AbstractProfilerTest;
+import org.junit.jupiter.api.Test;
+import org.openjdk.jmc.common.item.IAttribute;
+import org.openjdk.jmc.common.item.IItem;
+import org.openjdk.jmc.common.item.IItemIterable;
+import org.openjdk.jmc.common.unit.IQuantity;
+
+import java.util.HashSet;
+import java.util.Set;
+
+import static org.junit.jupiter.api.Assertions.assertTrue;
+import static org.openjdk.jmc.common.item.Attribute.attr;
+import static org.openjdk.jmc.common.unit.UnitLookup.NUMBER;
+import static org.openjdk.jmc.common.unit.UnitLookup.PLAIN_TEXT;
+import static org.openjdk.jmc.common.unit.UnitLookup.TIMESPAN;
+
+public class ProfilerLatencyTest extends AbstractProfilerTest {
+
+    @Test
+    public void testLatencies() throws Exception {
+        try (ProfiledCode profiledCode = new ProfiledCode(profiler)) {
+            for (int i = 0, id = 1; i < 100; i++, id += 3) {
+                profiledCode.method1(id);
+            }
+        }
+        stopProfiler();
+
+        IAttribute<String> stageAttr = attr("stage", "", "", PLAIN_TEXT);
+        IAttribute<IQuantity> countAttr = attr("count", "", "", NUMBER);
+        IAttribute<IQuantity> p50Attr = attr("p50", "", "", TIMESPAN);
+        IAttribute<IQuantity> p99Attr = attr("p99", "", "", TIMESPAN);
+        IAttribute<IQuantity> maxAttr = attr("max", "", "", TIMESPAN);
+        Set<String> stages = new HashSet<>();
+        for (IItemIterable it : verifyEvents("datadog.ProfilerLatency")) {
+            for (IItem item : it) {
+                stages.add(stageAttr.getAccessor(it.getType()).getMember(item));
+                assertTrue(countAttr.getAccessor(it.getType()).getMember(item).longValue() > 0);
+                IQuantity p50 = p50Attr.getAccessor(it.getType()).getMember(item);
+                IQuantity p99 = p99Attr.getAccessor(it.getType()).getMember(item);
+                IQuantity max = maxAttr.getAccessor(it.getType()).getMember(item);
+                assertTrue(p50.compareTo(p99) <= 0);
+                // percentiles are rounded up to the end of their bucket
+                assertTrue(p99.compareTo(max.multiply(1.125)) <= 0);
+            }
+        }
+        assertTrue(stages.contains("unwind_cpu"), stages.toString());
+        assertTrue(stages.contains("calltrace_put"), stages.toString());
+        assertTrue(stages.contains("jfr_record"), stages.toString());
+    }
+
+    @Override
+    protected String getProfilerCommand() {
+        return "cpu=1ms";
+    }
+}
@@ -0,0 +1,49 @@
+package com.datadoghq.profiler.jfr;
+
+import com.datadoghq.profiler.AbstractProfilerTest;
+import com.datadoghq.profiler.Platform;
+import org.junit.jupiter.api.Assumptions;
+import org.junit.jupiter.api.Test;
+
+import java.nio.file.Files;
+import java.nio.file.Path;
+
+public class RingDumpTest extends AbstractProfilerTest {
+
+    private static volatile int value;
+
+    @Test
+    public void testDumpRing() throws Exception {
+        Assumptions.assumeTrue(Platform.isLinux());
+        Assumptions.assumeFalse(Platform.isJ9());
+
+        // long enough for the ring to rotate its chunks and drop the oldest
+        for (int j = 0; j < 3; j++) {
+            Path recording = Files.createTempFile("ring-", ".jfr");
+            try {
+                long deadline = System.currentTimeMillis() + 2000;
+                while (System.currentTimeMillis() < deadline) {
+                    burn();
+                }
+                profiler.dumpRing(recording);
+                verifyStackTraces(recording, "datadog.ExecutionSample", "burn");
+            } finally {
+                Files.deleteIfExists(recording);
+            }
+        }
+        // the ring is written to the recording file when the profiler stops
+        stopProfiler();
+        verifyStackTraces("datadog.ExecutionSample", "burn");
+    }
+
+    private static void burn() {
+        for (int i = 0; i < 1000000; ++i) {
+            ++value;
+        }
+    }
+
+    @Override
+    protected String getProfilerCommand() {
+        return "cpu=1ms,ring=2s";
+    }
+}
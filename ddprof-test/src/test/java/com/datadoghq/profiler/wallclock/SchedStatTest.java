@@ -0,0 +1,50 @@
+package com.datadoghq.profiler.wallclock;
+
+import com.datadoghq.profiler.AbstractProfilerTest;
+import com.datadoghq.profiler.Platform;
+import org.junit.jupiter.api.Assumptions;
+import org.junit.jupiter.api.Test;
+import org.openjdk.jmc.common.item.IAttribute;
+import org.openjdk.jmc.common.item.IItem;
+import org.openjdk.jmc.common.item.IItemIterable;
+import org.openjdk.jmc.common.unit.IQuantity;
+
+import static org.junit.jupiter.api.Assertions.assertTrue;
+import static org.openjdk.jmc.common.item.Attribute.attr;
+import static org.openjdk.jmc.common.unit.UnitLookup.NANOSECOND;
+import static org.openjdk.jmc.common.unit.UnitLookup.TIMESPAN;
+
+public class SchedStatTest extends AbstractProfilerTest {
+
+    private static volatile long sink;
+
+    @Test
+    public void testOnCpuTime() {
+        Assumptions.assumeTrue(Platform.isLinux());
+        registerCurrentThreadForWallClockProfiling();
+        long deadline = System.nanoTime() + 1_000_000_000L;
+        long value = 0;
+        while (System.nanoTime() < deadline) {
+            value += System.nanoTime() % 7;
+        }
+        sink = value;
+        stopProfiler();
+
+        IAttribute<IQuantity> cpuTimeAttr = attr("cpuTime", "", "", TIMESPAN);
+        IAttribute<IQuantity> runQueueTimeAttr = attr("runQueueTime", "", "", TIMESPAN);
+        long cpuTime = 0;
+        for (IItemIterable it : verifyEvents("datadog.MethodSample")) {
+            for (IItem item : it) {
+                cpuTime += cpuTimeAttr.getAccessor(it.getType()).getMember(item).longValueIn(NANOSECOND);
+                assertTrue(runQueueTimeAttr.getAccessor(it.getType()).getMember(item).longValueIn(NANOSECOND) >= 0);
+            }
+        }
+        // the thread spun for a second, most of it should be seen on a CPU
+        assertTrue(cpuTime > 100_000_000L, "cpuTime=" + cpuTime);
+    }
+
+    @Override
+    protected String getProfilerCommand() {
+        return "wall=10ms,schedstat";
+    }
+}
@@ -0,0 +1,33 @@
+package com.datadoghq.profiler.wallclock;
+
+import com.datadoghq.profiler.AbstractProfilerTest;
+import com.datadoghq.profiler.Platform;
+import org.junit.jupiter.api.Assumptions;
+import org.junitpioneer.jupiter.RetryingTest;
+
+import java.util.concurrent.ExecutionException;
+
+public class TimerBasedContextWallClockTest extends AbstractProfilerTest {
+    private final BaseContextWallClockTest base = new BaseContextWallClockTest(() -> profiler);
+
+    @Override
+    protected void before() {
+        base.before();
+    }
+
+    @Override
+    protected void after() throws InterruptedException {
+        base.after();
+    }
+
+    @RetryingTest(5)
+    public void test() throws ExecutionException, InterruptedException {
+        Assumptions.assumeTrue(Platform.isLinux() && !Platform.isJ9());
+        base.test(this);
+    }
+
+    @Override
+    protected String getProfilerCommand() {
+        return "wall=~1ms,filter=0,loglevel=warn,wallsampler=timer";
+    }
+}